@@ -148,3 +148,8 @@ math/floattrig.c
 math/number.c
 tests/testfloatnum.c
 )
+
+set(benchmul_SOURCES
+math/number.c
+tests/benchmul.c
+)
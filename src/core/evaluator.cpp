@@ -21,9 +21,14 @@
 
 #include "core/evaluator.h"
 
+#include "core/settings.h"
+
 #include <QCoreApplication>
 #include <QStack>
 
+#include <cfloat>
+#include <cmath>
+
 //#define EVALUATOR_DEBUG
 #ifdef EVALUATOR_DEBUG
 #include <QFile>
@@ -1043,6 +1048,34 @@ void Evaluator::compile(const Tokens& tokens)
     }
 }
 
+// Compiles the expression if it was changed. Returns false if it is invalid.
+bool Evaluator::compileIfDirty()
+{
+    if (!m_dirty)
+        return true;
+
+    Tokens tokens = scan(m_expression);
+
+    // Invalid expression?
+    if (!tokens.valid()) {
+        m_error = tr("invalid expression");
+        return false;
+    }
+
+    // Variable assignment?
+    m_assignId = QString();
+    if (tokens.count() > 2 && tokens.at(0).isIdentifier()
+         && tokens.at(1).asOperator() == Token::Equal)
+    {
+        m_assignId = tokens.at(0).text();
+        tokens.erase(tokens.begin());
+        tokens.erase(tokens.begin());
+    }
+
+    compile(tokens);
+    return true;
+}
+
 HNumber Evaluator::evalNoAssign()
 {
     QStack<HNumber> stack;
@@ -1053,27 +1086,8 @@ HNumber Evaluator::evalNoAssign()
     QString fname;
     Function* function;
 
-    if (m_dirty) {
-        Tokens tokens = scan(m_expression);
-
-        // Invalid expression?
-        if (!tokens.valid()) {
-            m_error = tr("invalid expression");
-            return HNumber(0);
-        }
-
-        // Variable assignment?
-        m_assignId = QString();
-        if (tokens.count() > 2 && tokens.at(0).isIdentifier()
-             && tokens.at(1).asOperator() == Token::Equal)
-        {
-            m_assignId = tokens.at(0).text();
-            tokens.erase(tokens.begin());
-            tokens.erase(tokens.begin());
-        }
-
-        compile(tokens);
-    }
+    if (!compileIfDirty())
+        return HNumber(0);
 
     for (int pc = 0; pc < m_codes.count(); ++pc) {
         const Opcode& opcode = m_codes.at(pc);
@@ -1310,6 +1324,386 @@ bool Evaluator::isBuiltInVariable(const QString& id) const
     return m_variables.value(id).type == Variable::BuiltIn;
 }
 
+// The fast backend of evalApproximate() runs the compiled expression with
+// doubles. Every value carries a bound of its absolute error, so a result
+// is only used when all numbers within the bound are shown the same way.
+
+namespace {
+
+struct FastNumber {
+    double value;
+    double error;
+};
+
+// Relative error of a correctly rounded operation.
+const double FastRounded = DBL_EPSILON;
+// Relative error allowed to the C library functions used below.
+const double FastLibm = 4 * DBL_EPSILON;
+// Larger arguments of sin and cos are left to HMath.
+const double FastMaxAngle = 1e8;
+
+inline bool isFinite(double x)
+{
+    return x - x == 0;
+}
+
+// Adds the rounding error of the last operation to the bound. Fails for
+// values a double cannot hold with full precision.
+bool fastRound(FastNumber* x, double relError)
+{
+    if (!isFinite(x->value) || !isFinite(x->error)
+        || (x->value != 0 && std::fabs(x->value) < DBL_MIN))
+        return false;
+    // The bound is computed with rounding too, so leave it some room.
+    x->error = (x->error + std::fabs(x->value) * relError) * (1 + 4 * DBL_EPSILON);
+    return isFinite(x->error);
+}
+
+bool toFast(const HNumber& n, FastNumber* x)
+{
+    if (n.isNan() || n.format() != 0)
+        return false;
+    char* str = HMath::format(n, 'e', 20);
+    bool ok;
+    x->value = QString::fromLatin1(str).toDouble(&ok);
+    free(str);
+    x->error = 0;
+    // Integers below 2^53 are held exactly.
+    if (ok && n.isInteger() && std::fabs(x->value) <= 9007199254740992.0)
+        return true;
+    return ok && fastRound(x, 2 * FastRounded);
+}
+
+HNumber fromFast(double x)
+{
+    return HNumber(QString::number(x, 'e', 17).toLatin1().constData());
+}
+
+bool fastAdd(FastNumber* x, const FastNumber& y)
+{
+    x->value += y.value;
+    x->error += y.error;
+    return fastRound(x, FastRounded);
+}
+
+bool fastMul(FastNumber* x, const FastNumber& y)
+{
+    x->error = std::fabs(x->value) * y.error + std::fabs(y.value) * x->error + x->error * y.error;
+    x->value *= y.value;
+    return fastRound(x, FastRounded);
+}
+
+bool fastDiv(FastNumber* x, const FastNumber& y)
+{
+    const double d = std::fabs(y.value);
+    if (d <= y.error)
+        return false;
+    x->error = (std::fabs(x->value) * y.error + d * x->error) / (d * (d - y.error));
+    x->value /= y.value;
+    return fastRound(x, FastRounded);
+}
+
+bool fastPow(FastNumber* x, const FastNumber& y)
+{
+    // Negative bases only with exact integer exponents, as in HMath::raise.
+    const double base = std::fabs(x->value);
+    if (base <= x->error)
+        return false;
+    if (x->value < 0 && (y.error != 0 || y.value != std::floor(y.value)))
+        return false;
+    // Bound of the error of y * ln(x).
+    const double lnError = x->error / (base - x->error);
+    const double delta = std::fabs(y.value) * lnError
+                         + std::fabs(std::log(base)) * y.error + y.error * lnError;
+    x->value = std::pow(x->value, y.value);
+    x->error = std::fabs(x->value) * (std::exp(delta) - 1);
+    return fastRound(x, FastLibm);
+}
+
+// Scales an angle between radians and the angle unit of the settings.
+bool fastAngle(FastNumber* x, bool toRadians)
+{
+    if (Settings::instance()->angleUnit != 'd')
+        return true;
+    const double pi = 3.14159265358979323846;
+    FastNumber f = { toRadians ? pi / 180 : 180 / pi, 0 };
+    // The factor itself is rounded twice.
+    fastRound(&f, 2 * FastRounded);
+    return fastMul(x, f);
+}
+
+// Evaluates the functions with a fast kernel, fails for the others.
+bool fastFunction(const QString& id, FastNumber* x)
+{
+    const double v = x->value;
+    const double e = x->error;
+
+    if (id == QLatin1String("abs")) {
+        x->value = std::fabs(v);
+        return true;
+    }
+    if (id == QLatin1String("sqrt")) {
+        if (v - e < 0 || (v == 0 && e != 0))
+            return false;
+        x->value = std::sqrt(v);
+        x->error = v > 0 ? e / x->value : 0;
+        return fastRound(x, FastRounded);
+    }
+    if (id == QLatin1String("exp")) {
+        x->value = std::exp(v);
+        x->error = x->value * (std::exp(e) - 1);
+        return fastRound(x, FastLibm);
+    }
+    if (id == QLatin1String("ln")) {
+        if (v - e <= 0)
+            return false;
+        x->value = std::log(v);
+        x->error = e / (v - e);
+        return fastRound(x, FastLibm);
+    }
+    if (id == QLatin1String("sin") || id == QLatin1String("cos")) {
+        if (!fastAngle(x, true) || std::fabs(x->value) > FastMaxAngle)
+            return false;
+        x->value = id == QLatin1String("sin") ? std::sin(x->value) : std::cos(x->value);
+        return fastRound(x, FastLibm);
+    }
+    if (id == QLatin1String("arctan")) {
+        const double d = std::fabs(v) - e;
+        x->value = std::atan(v);
+        if (d > 0)
+            x->error = e / (1 + d * d);
+        return fastRound(x, FastLibm) && fastAngle(x, false);
+    }
+    if (id == QLatin1String("sinh") || id == QLatin1String("cosh")) {
+        x->value = id == QLatin1String("sinh") ? std::sinh(v) : std::cosh(v);
+        x->error = e * std::cosh(std::fabs(v) + e);
+        return fastRound(x, FastLibm);
+    }
+    if (id == QLatin1String("tanh")) {
+        x->value = std::tanh(v);
+        return fastRound(x, FastLibm);
+    }
+    return false;
+}
+
+} // namespace
+
+// Runs the compiled expression with doubles. Succeeds only if every number
+// within the error bound of the result is shown the same way with the given
+// format and precision, and all operations and functions have a fast kernel.
+bool Evaluator::evalFast(char format, int precision, HNumber* result)
+{
+    QStack<FastNumber> stack;
+    QStack<QString> refs;
+    FastNumber x, y;
+
+    if (!compileIfDirty() || !m_valid)
+        return false;
+
+    for (int pc = 0; pc < m_codes.count(); ++pc) {
+        const Opcode& opcode = m_codes.at(pc);
+        switch (opcode.type) {
+            case Opcode::Nop:
+                break;
+
+            case Opcode::Load:
+                if (!toFast(m_constants.at(opcode.index), &x))
+                    return false;
+                stack.push(x);
+                break;
+
+            case Opcode::Neg:
+                if (stack.count() < 1)
+                    return false;
+                stack.top().value = -stack.top().value;
+                break;
+
+            case Opcode::Add:
+            case Opcode::Sub:
+            case Opcode::Mul:
+            case Opcode::Div:
+            case Opcode::Pow:
+                if (stack.count() < 2)
+                    return false;
+                y = stack.pop();
+                x = stack.pop();
+                switch (opcode.type) {
+                    case Opcode::Add: if (!fastAdd(&x, y)) return false; break;
+                    case Opcode::Sub: y.value = -y.value; if (!fastAdd(&x, y)) return false; break;
+                    case Opcode::Mul: if (!fastMul(&x, y)) return false; break;
+                    case Opcode::Div: if (!fastDiv(&x, y)) return false; break;
+                    default: if (!fastPow(&x, y)) return false;
+                }
+                stack.push(x);
+                break;
+
+            case Opcode::Ref: {
+                const QString name = m_identifiers.at(opcode.index);
+                if (hasVariable(name)) {
+                    if (!toFast(getVariable(name).value, &x))
+                        return false;
+                    stack.push(x);
+                } else {
+                    Function* function = FunctionRepo::instance()->find(name);
+                    if (!function)
+                        return false;
+                    refs.push(function->identifier());
+                }
+                break;
+            }
+
+            case Opcode::Function:
+                if (refs.isEmpty())
+                    break;
+                if (opcode.index != 1 || stack.isEmpty())
+                    return false;
+                if (!fastFunction(refs.pop(), &stack.top()))
+                    return false;
+                break;
+
+            // Factorials, modulo and the integer and logic operations.
+            default:
+                return false;
+        }
+    }
+
+    if (stack.count() != 1)
+        return false;
+    x = stack.pop();
+
+    // The conversion to 18 digits adds at most one more rounding.
+    const double bound = x.error + std::fabs(x.value) * FastRounded;
+    const HNumber value = fromFast(x.value);
+    char* str = HMath::format(value, format, precision);
+    char* str1 = HMath::format(fromFast(x.value - bound), format, precision);
+    char* str2 = HMath::format(fromFast(x.value + bound), format, precision);
+    const bool same = qstrcmp(str, str1) == 0 && qstrcmp(str, str2) == 0;
+    free(str);
+    free(str1);
+    free(str2);
+
+    if (same)
+        *result = value;
+    return same;
+}
+
+// Tells whether the compiled expression rounds to integers or takes bits
+// of its operands, anywhere. Such results can jump by a whole unit when
+// digits far beyond the shown ones change, e.g. (10^50+1) mod 10 is 0 at
+// less than 51 digits, so cheap evaluations that agree prove nothing.
+bool Evaluator::hasDiscontinuities()
+{
+    static const char* const functions[] = {
+        "ceil", "floor", "frac", "int", "round", "trunc", "sgn",
+        "gcd", "ncr", "npr", "idiv", "mod",
+        "mask", "unmask", "not", "and", "or", "xor", "shl", "shr", 0
+    };
+
+    if (!compileIfDirty() || !m_valid)
+        return false;
+
+    for (int pc = 0; pc < m_codes.count(); ++pc) {
+        const Opcode& opcode = m_codes.at(pc);
+        switch (opcode.type) {
+            case Opcode::Fact:
+            case Opcode::Modulo:
+            case Opcode::IntDiv:
+            case Opcode::LSh:
+            case Opcode::RSh:
+            case Opcode::BAnd:
+            case Opcode::BOr:
+                return true;
+
+            case Opcode::Ref: {
+                const QString name = m_identifiers.at(opcode.index);
+                if (hasVariable(name))
+                    break;
+                Function* function = FunctionRepo::instance()->find(name);
+                if (!function)
+                    break;
+                for (int i = 0; functions[i]; ++i)
+                    if (function->identifier() == QLatin1String(functions[i]))
+                        return true;
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+// Returns the number of significant decimal digits of a formatted number.
+static int shownDigits(const char* str)
+{
+    int digits = 0;
+    for (; str && *str && *str != 'e'; ++str)
+        if ((*str >= '1' && *str <= '9') || (digits > 0 && *str == '0'))
+            ++digits;
+    return digits;
+}
+
+// Like evalNoAssign(), but only as precise as needed to show the result
+// with the given format and precision (see HMath::format). Following Ziv,
+// the expression is first evaluated at two cheap precisions, unless it
+// has integer or bit operations (see hasDiscontinuities()). The result is
+// taken if both agree in every shown digit, no subtraction cancelled the
+// extra digits of the second one and fewer digits are shown than the first
+// one carries. If only the last condition fails, the cheap evaluations are
+// repeated with enough digits, otherwise the expression is evaluated again
+// at the working precision. Up to 15 shown digits evalFast() is tried first.
+HNumber Evaluator::evalApproximate(char format, int precision)
+{
+    if (precision >= 0 && precision <= 15 && format != 'h' && format != 'o' && format != 'b') {
+        HNumber result;
+        if (evalFast(format, precision, &result))
+            return result;
+    }
+
+    // Digits shown when the precision is automatic, see HMath::format.
+    const int guard = 8;
+    int low = (precision < 0 ? 20 : precision) + guard;
+    int high = low + low / 2;
+
+    // The cheap evaluations only pay off well below the working precision,
+    // and say nothing about integer and bit operations.
+    const bool cheap = !hasDiscontinuities();
+    while (cheap && 4 * high <= HMath::workingPrecision()
+           && format != 'h' && format != 'o' && format != 'b')
+    {
+        HMath::setEvaluationPrecision(low);
+        const HNumber approx = evalNoAssign();
+        const bool approxOk = m_error.isEmpty() && !approx.isNan();
+        m_error = QString();
+        HMath::setEvaluationPrecision(high);
+        const HNumber result = evalNoAssign();
+        const int cancelled = HMath::cancelledDigits();
+        HMath::setEvaluationPrecision(0);
+
+        format = result.format() != 0 ? result.format() : format;
+        if (!approxOk || !m_error.isEmpty() || result.isNan()
+            || cancelled > high - low || format == 'h' || format == 'o' || format == 'b')
+            break;
+
+        char* str1 = HMath::format(approx, format, precision);
+        char* str2 = HMath::format(result, format, precision);
+        const bool same = qstrcmp(str1, str2) == 0;
+        const int digits = shownDigits(str2);
+        free(str1);
+        free(str2);
+        if (!same)
+            break;
+        if (digits + guard <= low)
+            return result;
+        low = digits + guard;
+        high = low + low / 2;
+    }
+
+    m_error = QString();
+    return evalNoAssign();
+}
+
 HNumber Evaluator::eval()
 {
     HNumber result = evalNoAssign(); // This sets m_assignId.
@@ -97,6 +97,7 @@ public:
     QString dump();
     QString error() const;
     HNumber eval();
+    HNumber evalApproximate(char format, int precision);
     HNumber evalNoAssign();
     HNumber evalUpdateAns();
     QString expression() const;
@@ -117,6 +118,9 @@ public:
 
 protected:
     void compile(const Tokens&);
+    bool compileIfDirty();
+    bool evalFast(char format, int precision, HNumber* result);
+    bool hasDiscontinuities();
 
 private:
     Evaluator();
@@ -83,7 +83,10 @@ HNumber function_abs(Function* f, const Function::ArgumentList& args)
 HNumber function_average(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_POSITIVE_ARGUMENT_COUNT();
-    return std::accumulate(args.begin(), args.end(), HNumber(0)) / HNumber(args.count());
+    HNumber sum = 0;
+    for (int i = 0; i < args.count(); ++i)
+        sum += args.at(i);
+    return sum / HNumber(args.count());
 }
 
 HNumber function_absdev(Function* f, const Function::ArgumentList& args)
@@ -442,21 +445,28 @@ HNumber function_min(Function* f, const Function::ArgumentList& args)
 HNumber function_sum(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_POSITIVE_ARGUMENT_COUNT();
-    return std::accumulate(args.begin(), args.end(), HNumber(0));
+    HNumber result = 0;
+    for (int i = 0; i < args.count(); ++i)
+        result += args.at(i);
+    return result;
 }
 
 HNumber function_product(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_POSITIVE_ARGUMENT_COUNT();
-    return std::accumulate(args.begin(), args.end(), HNumber(1), std::multiplies<HNumber>());
+    HNumber result = 1;
+    for (int i = 0; i < args.count(); ++i)
+        result *= args.at(i);
+    return result;
 }
 
 HNumber function_geomean(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_POSITIVE_ARGUMENT_COUNT();
 
-    HNumber result = std::accumulate(args.begin(), args.end(), HNumber(1),
-        std::multiplies<HNumber>());
+    HNumber result = 1;
+    for (int i = 0; i < args.count(); ++i)
+        result *= args.at(i);
 
     if (result <= HNumber(0))
         return HNumber("NaN");
@@ -587,22 +597,28 @@ HNumber function_not(Function* f, const Function::ArgumentList& args)
 HNumber function_and(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_POSITIVE_ARGUMENT_COUNT();
-    return std::accumulate(args.begin(), args.end(), HNumber(-1),
-        std::mem_fun_ref(&HNumber::operator&));
+    HNumber result = -1;
+    for (int i = 0; i < args.count(); ++i)
+        result &= args.at(i);
+    return result;
 }
 
 HNumber function_or(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_POSITIVE_ARGUMENT_COUNT();
-    return std::accumulate(args.begin(), args.end(), HNumber(0),
-        std::mem_fun_ref(&HNumber::operator|));
+    HNumber result = 0;
+    for (int i = 0; i < args.count(); ++i)
+        result |= args.at(i);
+    return result;
 }
 
 HNumber function_xor(Function* f, const Function::ArgumentList& args)
 {
     ENSURE_POSITIVE_ARGUMENT_COUNT();
-    return std::accumulate(args.begin(), args.end(), HNumber(0),
-        std::mem_fun_ref(&HNumber::operator^));
+    HNumber result = 0;
+    for (int i = 0; i < args.count(); ++i)
+        result ^= args.at(i);
+    return result;
 }
 
 HNumber function_shl(Function* f, const Function::ArgumentList& args)
@@ -21,14 +21,60 @@
 #include "core/settings.h"
 #include "math/hmath.h"
 
+#include <QtCore/QVarLengthArray>
+
+#include <cstring>
+
+// Most numbers fit into the first buffer, larger ones are formatted twice.
+enum { FormatBufferSize = 256 };
+typedef QVarLengthArray<char, FormatBufferSize> FormatBuffer;
+
 QString NumberFormatter::format(const HNumber& number)
 {
     Settings* settings = Settings::instance();
     const char format = number.format() != 0 ? number.format() : settings->resultFormat;
-    char* str = HMath::format(number, format, settings->resultPrecision);
-    QString result = QString::fromLatin1(str);
-    free(str);
+    QString result;
+    append(&result, number, format, settings->resultPrecision);
     if (settings->radixCharacter() != '.')
         result.replace('.', settings->radixCharacter());
     return result;
+}
+
+// Also gives the number with all digits, as kept in the history and in
+// sessions, from the same call into HMath.
+QString NumberFormatter::format(const HNumber& number, QString* exact)
+{
+    Settings* settings = Settings::instance();
+    const char formats[2] = {
+        number.format() != 0 ? number.format() : settings->resultFormat,
+        number.format() != 0 ? number.format() : 'e'
+    };
+    const int precisions[2] = { settings->resultPrecision, HMath::workingPrecision() };
+
+    FormatBuffer buffer(FormatBufferSize);
+    int size = HMath::formatInto(number, formats, precisions, 2, buffer.data(), buffer.size());
+    if (size > buffer.size()) {
+        buffer.resize(size);
+        HMath::formatInto(number, formats, precisions, 2, buffer.data(), buffer.size());
+    }
+
+    QString result = QString::fromLatin1(buffer.constData());
+    *exact = QString::fromLatin1(buffer.constData() + strlen(buffer.constData()) + 1);
+    if (settings->radixCharacter() != '.')
+        result.replace('.', settings->radixCharacter());
+    return result;
+}
+
+// Appends the number as HMath::format() gives it, without radix character
+// replacement.
+void NumberFormatter::append(QString* result, const HNumber& number, char format, int precision)
+{
+    FormatBuffer buffer(FormatBufferSize);
+    int size = HMath::formatInto(number, buffer.data(), buffer.size(), format, precision);
+    if (size > buffer.size()) {
+        buffer.resize(size);
+        size = HMath::formatInto(number, buffer.data(), buffer.size(), format, precision);
+    }
+    if (size > 0)
+        result->append(QLatin1String(buffer.constData()));
 }
\ No newline at end of file
@@ -25,6 +25,8 @@ class HNumber;
 
 struct NumberFormatter {
 	static QString format(const HNumber&);
+	static QString format(const HNumber&, QString* exact);
+	static void append(QString*, const HNumber&, char format, int precision);
 };
 
 #endif
\ No newline at end of file
@@ -22,6 +22,8 @@
 
 #include "thirdparty/binreloc.h"
 #include "math/floatconfig.h"
+#include "math/hmath.h"
+#include "math/number.h"
 
 #include <QDir>
 #include <QLocale>
@@ -32,6 +34,24 @@
 static Settings* s_settingsInstance = 0;
 static char s_radixCharacter = 0;
 
+// Increased whenever the multiplication kernels change, so that the
+// thresholds measured for the old ones are not used.
+static const int s_tuningVersion = 1;
+
+// The compiled multiplication thresholds.
+static const int s_defaultMultiplyBaseDigits = mul_base_digits;
+static const int s_defaultMultiplyToom3Digits = mul_toom3_digits;
+static const int s_defaultMultiplyNttDigits = mul_ntt_digits;
+
+// A measured threshold is trusted within a factor of 4 of the compiled
+// one. Not measured (0) means the compiled one.
+static int clampThreshold(int value, int defaultValue)
+{
+    if (value <= 0)
+        return defaultValue;
+    return qBound(defaultValue / 4, value, defaultValue * 4);
+}
+
 static void s_deleteSettings()
 {
     delete s_settingsInstance;
@@ -99,10 +119,18 @@ void Settings::load()
     else
         resultFormat = format.at(0).toLatin1();
 
+    workingPrecision = settings->value(key + QLatin1String("WorkingPrecision"), DECPRECISION).toInt();
+
+    if (workingPrecision < DECPRECISION)
+        workingPrecision = DECPRECISION;
+    else if (workingPrecision > MAXDECPRECISION)
+        workingPrecision = MAXDECPRECISION;
+    HMath::setWorkingPrecision(workingPrecision);
+
     resultPrecision = settings->value(key + QLatin1String("Precision"), -1).toInt();
 
-    if (resultPrecision > DECPRECISION)
-        resultPrecision = DECPRECISION;
+    if (resultPrecision > workingPrecision)
+        resultPrecision = workingPrecision;
 
     key = KEY + QLatin1String("/Layout/");
     windowOnfullScreen = settings->value(key + QLatin1String("WindowOnFullScreen"), false).toBool();
@@ -121,6 +149,17 @@ void Settings::load()
     windowState = settings->value(key + QLatin1String("State")).toByteArray();
     maximized = settings->value(key + QLatin1String("Maximized"), false).toBool();
 
+    key = KEY + QLatin1String("/Tuning/");
+    // Values measured for other multiplication kernels are dropped.
+    if (settings->value(key + QLatin1String("Version"), 0).toInt() == s_tuningVersion) {
+        multiplyBaseDigits = settings->value(key + QLatin1String("MultiplyBaseDigits"), 0).toInt();
+        multiplyToom3Digits = settings->value(key + QLatin1String("MultiplyToom3Digits"), 0).toInt();
+        multiplyNttDigits = settings->value(key + QLatin1String("MultiplyNttDigits"), 0).toInt();
+    } else {
+        multiplyBaseDigits = multiplyToom3Digits = multiplyNttDigits = 0;
+    }
+    applyMultiplyThresholds();
+
     key = KEY + QLatin1String("/Display/");
     displayFont = settings->value(key + QLatin1String("DisplayFont"), QFont().toString()).toString();
     colorScheme = settings->value(key + QLatin1String("ColorScheme"), 0).toInt();
@@ -181,6 +220,28 @@ void Settings::load()
     delete settings;
 }
 
+// Sets the multiplication thresholds, the measured ones where they are sane.
+void Settings::applyMultiplyThresholds()
+{
+    mul_base_digits = clampThreshold(multiplyBaseDigits, s_defaultMultiplyBaseDigits);
+    mul_toom3_digits = qMax(mul_base_digits,
+                            clampThreshold(multiplyToom3Digits, s_defaultMultiplyToom3Digits));
+    mul_ntt_digits = qMax(mul_toom3_digits,
+                          clampThreshold(multiplyNttDigits, s_defaultMultiplyNttDigits));
+}
+
+// Measures the multiplication thresholds on this machine. It takes about a
+// second, so it is done on request only (see the --calibrate option), and
+// kept with the settings.
+void Settings::calibrateMultiply()
+{
+    bc_tune_multiply();
+    multiplyBaseDigits = mul_base_digits;
+    multiplyToom3Digits = mul_toom3_digits;
+    multiplyNttDigits = mul_ntt_digits;
+    applyMultiplyThresholds();
+}
+
 void Settings::save()
 {
     const QString KEY = QString::fromLatin1("SpeedCrunch");
@@ -215,6 +276,7 @@ void Settings::save()
 
     settings->setValue(key + QLatin1String("Type"), QString(QChar(resultFormat)));
     settings->setValue(key + QLatin1String("Precision"), resultPrecision);
+    settings->setValue(key + QLatin1String("WorkingPrecision"), workingPrecision);
 
     key = KEY + QLatin1String("/Layout/");
 
@@ -233,6 +295,13 @@ void Settings::save()
     settings->setValue(key + QLatin1String("Maximized"), maximized);
     settings->setValue(key + QLatin1String("BitfieldVisible"), bitfieldVisible);
 
+    key = KEY + QLatin1String("/Tuning/");
+
+    settings->setValue(key + QLatin1String("Version"), s_tuningVersion);
+    settings->setValue(key + QLatin1String("MultiplyBaseDigits"), multiplyBaseDigits);
+    settings->setValue(key + QLatin1String("MultiplyToom3Digits"), multiplyToom3Digits);
+    settings->setValue(key + QLatin1String("MultiplyNttDigits"), multiplyNttDigits);
+
     key = KEY + QLatin1String("/Display/");
 
     settings->setValue(key + QLatin1String("DisplayFont"), displayFont);
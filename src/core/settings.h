@@ -31,6 +31,7 @@ public:
 
     void load();
     void save();
+    void calibrateMultiply();
 
     char radixCharacter() const; // 0: Automatic.
     void setRadixCharacter(char c = 0);
@@ -40,6 +41,7 @@ public:
 
     char resultFormat; // See HMath documentation.
     int resultPrecision; // Ditto.
+    int workingPrecision; // Decimal digits results are computed with.
 
     bool autoAns;
     bool autoCalc;
@@ -68,6 +70,12 @@ public:
 
     QString language;
 
+    // Multiplication crossovers in digits, 0 unless measured by
+    // calibrateMultiply().
+    int multiplyBaseDigits;
+    int multiplyToom3Digits;
+    int multiplyNttDigits;
+
     QStringList history;
     QStringList historyResults;
     QStringList variables;
@@ -80,6 +88,8 @@ public:
 private:
     Settings();
     Q_DISABLE_COPY(Settings);
+
+    void applyMultiplyThresholds();
 };
 
 #endif
@@ -486,7 +486,8 @@ void Editor::autoCalc()
 
     // Same reason as above, do not update "ans".
     m_evaluator->setExpression(str);
-    const HNumber num = m_evaluator->evalNoAssign();
+    const Settings* settings = Settings::instance();
+    const HNumber num = m_evaluator->evalApproximate(settings->resultFormat, settings->resultPrecision);
 
     if (m_evaluator->error().isEmpty()) {
         const QString message = tr("Current result: <b>%1</b>").arg(NumberFormatter::format(num));
@@ -538,7 +539,8 @@ void Editor::autoCalcSelection()
 
     // Same reason as above, do not update "ans".
     m_evaluator->setExpression(str);
-    const HNumber num = m_evaluator->evalNoAssign();
+    const Settings* settings = Settings::instance();
+    const HNumber num = m_evaluator->evalApproximate(settings->resultFormat, settings->resultPrecision);
 
     if (m_evaluator->error().isEmpty()) {
         const QString message = tr("Selection result: <b>%1</b>").arg(NumberFormatter::format(num));
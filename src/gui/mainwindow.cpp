@@ -1054,9 +1054,9 @@ void MainWindow::saveSettings()
         QList<Evaluator::Variable> variables = m_evaluator->getUserDefinedVariablesPlusAns();
         for (int i = 0; i < variables.count(); ++i) {
             QString name = variables.at(i).name;
-            char* value = HMath::format(variables.at(i).value, 'e', DECPRECISION);
-            m_settings->variables.append(QString("%1=%2").arg(name).arg(value));
-            free(value);
+            QString value = name + QLatin1Char('=');
+            NumberFormatter::append(&value, variables.at(i).value, 'e', HMath::workingPrecision());
+            m_settings->variables.append(value);
         }
     }
 
@@ -1164,12 +1164,11 @@ void MainWindow::copyResultToClipboard()
 {
     QClipboard* cb = QApplication::clipboard();
     HNumber num = m_evaluator->getVariable(QLatin1String("ans")).value;
-    char* strToCopy = HMath::format(num, m_settings->resultFormat, m_settings->resultPrecision);
-    QString final(strToCopy);
+    QString final;
+    NumberFormatter::append(&final, num, m_settings->resultFormat, m_settings->resultPrecision);
     if (m_settings->radixCharacter() == ',')
         final.replace('.', ',');
     cb->setText(final, QClipboard::Clipboard);
-    free(strToCopy);
 }
 
 void MainWindow::setAngleModeDegree()
@@ -1406,9 +1405,9 @@ void MainWindow::showSessionImportDialog()
             }
         } else {
             m_widgets.display->append(str, result);
-            char* num = HMath::format(result, 'e', DECPRECISION);
+            QString num;
+            NumberFormatter::append(&num, result, 'e', HMath::workingPrecision());
             m_widgets.editor->appendHistory(str, num);
-            free(num);
             m_widgets.editor->setAnsAvailable(true);
             if (m_settings->variablesDockVisible)
                 m_docks.variables->updateList();
@@ -1578,9 +1577,9 @@ void MainWindow::saveSession()
     // Variables.
     for (int i = 0; i < variables.count(); ++i) {
         Evaluator::Variable var = variables.at(i);
-        char* value = HMath::format(var.value);
+        QString value;
+        NumberFormatter::append(&value, var.value, 'g', -1);
         stream << var.name << "\n" << value << "\n";
-        free(value);
     }
 
     file.close();
@@ -2115,10 +2114,7 @@ void MainWindow::evaluateEditorExpression()
     m_widgets.display->append(expr, result);
     m_widgets.display->scrollToBottom();
 
-    const char format = result.format() != 0 ? result.format() : 'e';
-    char* num = HMath::format(result, format, DECPRECISION);
-    m_widgets.editor->appendHistory(expr, num);
-    free(num);
+    m_widgets.editor->appendHistory(expr, m_widgets.display->lastResult());
     m_widgets.editor->setAnsAvailable(true);
 
     if (m_settings->bitfieldVisible)
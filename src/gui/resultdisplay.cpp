@@ -70,16 +70,14 @@ void ResultDisplay::append(const QString& expression, const HNumber& value)
 
     ++m_count;
 
+    QString exact;
     appendPlainText(expression);
-    appendPlainText(QLatin1String("= ") + NumberFormatter::format(value));
+    appendPlainText(QLatin1String("= ") + NumberFormatter::format(value, &exact));
     appendPlainText(QLatin1String(""));
 
     // TODO: Refactor, this only serves to save a session.
     m_expressions.append(expression);
-    const char format = value.format() != 0 ? value.format() : 'e';
-    char* str = HMath::format(value, format, DECPRECISION);
-    m_results.append(str);
-    free(str);
+    m_results.append(exact);
 }
 
 void ResultDisplay::appendHistory(const QStringList& expressions, const QStringList& results)
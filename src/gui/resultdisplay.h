@@ -37,6 +37,7 @@ public:
     void appendHistory(const QStringList& expressions, const QStringList& results);
     int count() const;
     bool isEmpty() const { return m_count == 0; }
+    QString lastResult() const { return m_results.isEmpty() ? QString() : m_results.last(); }
 
 signals:
     void shiftWheelDown();
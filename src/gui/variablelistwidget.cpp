@@ -21,6 +21,7 @@
 #include "gui/variablelistwidget.h"
 
 #include "core/evaluator.h"
+#include "core/numberformatter.h"
 #include "core/settings.h"
 
 #include <QEvent>
@@ -212,10 +213,9 @@ void VariableListWidget::keyPressEvent(QKeyEvent* event)
 
 static QString formatValue(const HNumber& value)
 {
-    char* formatted = HMath::format(value, 'g');
-    QString result = QString::fromLatin1(formatted);
+    QString result;
+    NumberFormatter::append(&result, value, 'g', -1);
     if (Settings::instance()->radixCharacter() != '.')
         result.replace('.', Settings::instance()->radixCharacter());
-    free(formatted);
     return result;
 }
\ No newline at end of file
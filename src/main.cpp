@@ -17,6 +17,7 @@
 // the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
 // Boston, MA 02110-1301, USA.
 
+#include "core/settings.h"
 #include "gui/application.h"
 #include "gui/mainwindow.h"
 
@@ -36,6 +37,14 @@ int main(int argc, char* argv[])
     QCoreApplication::setOrganizationDomain("speedcrunch.org");
     QCoreApplication::setOrganizationName("SpeedCrunch");
 
+    // Measures the multiplication thresholds of this machine for the
+    // following starts as well.
+    if (QCoreApplication::arguments().contains(QLatin1String("--calibrate"))) {
+        Settings* settings = Settings::instance();
+        settings->calibrateMultiply();
+        settings->save();
+    }
+
     MainWindow window;
     window.show();
 
@@ -75,7 +75,7 @@ chckmathparam(
   floatnum x,
   int digits)
 {
-  return _chckparam(x, digits, MATHPRECISION, 1);
+  return _chckparam(x, digits, mathprecision, 1);
 }
 
 int
@@ -243,24 +243,30 @@ float_abscmp(
   signed char sx, sy;
   int result;
 
+  /* positive operands are left alone, they may be constants shared
+     between threads */
   sx = float_getsign(x);
   sy = float_getsign(y);
-  float_abs(x);
-  float_abs(y);
+  if (sx < 0)
+    float_abs(x);
+  if (sy < 0)
+    float_abs(y);
   result = float_cmp(x, y);
-  float_setsign(x, sx);
-  float_setsign(y, sy);
+  if (sx < 0)
+    float_setsign(x, sx);
+  if (sy < 0)
+    float_setsign(y, sy);
   return result;
 }
 
 int
 float_relcmp(
-  floatnum x,
-  floatnum y,
+  cfloatnum x,
+  cfloatnum y,
   int digits)
 {
   /* do not simply use float_sub, because of overflow/underflow */
-  floatstruct tmp;
+  floatstruct tmp, xs, ys;
   int result;
   int expx, expy, expdiff;
 
@@ -274,19 +280,23 @@ float_relcmp(
   expdiff = expx - expy;
   if (expdiff >= 2 || expdiff < -2)
     return result;
+  /* scale copies, x and y may be shared by other threads */
   float_create(&tmp);
-  if (result > 0)
-  float_setexponent(x, 0);
-  float_setexponent(y, expy - expx);
-  float_sub(&tmp, x, y, 2);
+  float_create(&xs);
+  float_create(&ys);
+  float_copy(&xs, x, EXACT);
+  float_copy(&ys, y, EXACT);
+  float_setexponent(&xs, 0);
+  float_setexponent(&ys, expy - expx);
+  float_sub(&tmp, &xs, &ys, 2);
   if ((result * float_getsign(x)) > 0)
-    float_div(&tmp, &tmp, x, 2);
+    float_div(&tmp, &tmp, &xs, 2);
   else
-    float_div(&tmp, &tmp, y, 2);
+    float_div(&tmp, &tmp, &ys, 2);
   if (float_getexponent(&tmp) < -digits)
     result = 0;
-  float_setexponent(x, expx);
-  float_setexponent(y, expy);
+  float_free(&ys);
+  float_free(&xs);
   float_free(&tmp);
   return result;
 }
@@ -400,14 +410,13 @@ float_roundtoint(
 static float _ipwr(float x, int exp){
   int e = exp < 0? -exp : exp;
   double pwr = x;
-  if ((e & 1) == 0)
-    x = 1;
+  double result = (e & 1) != 0? x : 1;
   while (e >>= 1){
     pwr *= pwr;
-    if ((exp & 1) != 0)
-      x *= pwr;
+    if ((e & 1) != 0)
+      result *= pwr;
   }
-  return exp < 0? 1/x : x;
+  return exp < 0? 1/result : result;
 }
 
 /* returns x as a float. Only the first 6 digits
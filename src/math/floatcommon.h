@@ -80,7 +80,7 @@ char float_reciprocal(floatnum x, int digits);
 /* compares two numbers in a normal fashion, but returns equal, if their
    relative difference is less than 1e-<digits>, i.e.
    |(x-y)/max(x,y)| < 1e-<digits> */
-int float_relcmp(floatnum x, floatnum y, int digits);
+int float_relcmp(cfloatnum x, cfloatnum y, int digits);
 
 /* returns whether x is an integer */
 char float_isinteger(cfloatnum x);
@@ -113,6 +113,13 @@
    is less than 10^DECPRECISION */
  #define LOGICRANGE 256
 
+/* DECPRECISION is the default granularity only. It can be raised at run
+   time (floatmath_setprecision) up to MAXDECPRECISION digits. The limit
+   of the math library and the guard value of basic operations move along,
+   keeping their distance to DECPRECISION. The integer range and the
+   domain of logic functions stay fixed. */
+#define MAXDECPRECISION 5000
+
 /***************************************************************************
 
                       END OF USER SETABLE DEFINES
@@ -163,6 +170,10 @@
 #ifndef DECPRECISION
   #define DECPRECISION MATHPRECISION
 #endif
+/* the largest guard value float_setprecision accepts, that is
+   MAXDIGITS with the granularity raised to MAXDECPRECISION */
+#define MAXDIGITSLIMIT (MAXDECPRECISION + MAXDIGITS - DECPRECISION)
+
 #define BINPRECISION ((33219*DECPRECISION)/10000 + 1)
 #define OCTPRECISION ((11073*DECPRECISION)/10000 + 1)
 #define HEXPRECISION ((8305*DECPRECISION)/10000 + 1)
@@ -171,4 +182,22 @@
 # define LOGICRANGE (16*((BINPRECISION-2)/16))
 #endif
 
+/* storage class of the state kept per thread, the error code and the
+   precision and range limits, so that several threads can compute
+   independently of each other. Without it, threads would silently share
+   that state, so a compiler offering none is rejected */
+#if defined(__cplusplus) && (__cplusplus >= 201103L \
+                             || (defined(_MSC_VER) && _MSC_VER >= 1900))
+#  define FLOAT_THREAD_LOCAL thread_local
+#elif !defined(__cplusplus) && defined(__STDC_VERSION__) \
+      && __STDC_VERSION__ >= 201112L
+#  define FLOAT_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#  define FLOAT_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#  define FLOAT_THREAD_LOCAL __thread
+#else
+#  error "no thread-local storage class known for this compiler"
+#endif
+
 #endif /* _FLOATCONFIG_H */
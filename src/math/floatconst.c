@@ -30,87 +30,20 @@
 *************************************************************************/
 
 #include "floatconst.h"
+#include "floatcommon.h"
+#include "floatseries.h"
+#include "floatlog.h"
+#include "floattrig.h"
+#include "floatipower.h"
+#include "floatexp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 
-static char sExp[] =
-"2.7182818284""5904523536""0287471352""6624977572""4709369995"
-  "9574966967""6277240766""3035354759""4571382178""5251664274"
-  "2746639193""2003059921""8174135966""2904357290""0334295260"
-  "5956307381""3232862794""3490763233""8298807531""9525101901"
-  "1573834187";
-
-static char sLn2[] =
-"0.6931471805""5994530941""7232121458""1765680755""0013436025"
-  "5254120680""0094933936""2196969471""5605863326""9964186875"
-  "4200148102""0570685734";
-
-static char sLn3[] =
-"1.0986122886""6810969139""5245236922""5257046474""9055782274"
-  "9451734694""3336374942""9321860896""6873615754""8137320887"
-  "8797002906""5957865742";
-
-static char sLn7[] =
-"1.9459101490""5531330510""5352743443""1797296370""8472958186"
-  "1188459390""1499375798""6275206926""7787658498""5878715269"
-  "9306169420""5851140912";
-
-static char sLn10[] =
-"2.3025850929""9404568401""7991454684""3642076011""0148862877"
-  "2976033327""9009675726""0967735248""0235997205""0895982983"
-  "4196778404""2286248633";
-
-static char sPhi[] =
-"1.6180339887""4989484820""4586834365""6381177203""0917980576"
-  "2862135448""6227052604""6281890244""9707207204""1893911374"
-  "8475408807""5386891752""1266338622""2353693179""3180060766"
-  "7263544333""8908659593""9582905638""3226613199""2829026788"
-  "0675208766";
-
-static char sPi[] =
-"3.1415926535""8979323846""2643383279""5028841971""6939937510"
-  "5820974944""5923078164""0628620899""8628034825""3421170679"
-  "8214808651""3282306647""0938446095""5058223172""5359408128"
-  "4811174502""8410270193""8521105559""6446229489""5493038196"
-  "4428810976";
-
-static char sPiDiv2[] =
-"1.5707963267""9489661923""1321691639""7514420985""8469968755"
-  "2910487472""2961539082""0314310449""9314017412""6710585339"
-  "9107404325""6641153324";
-
-static char sPiDiv4[] =
-"0.7853981633""9744830961""5660845819""8757210492""9234984377"
-  "6455243736""1480769541""0157155224""9657008706""3355292669"
-  "9553702162""8320576662";
-
-static char s2Pi[] =
-"6.2831853071""7958647692""5286766559""0057683943""3879875021"
-  "1641949889""1846156328""1257241799""7256069650""6842341359"
-  "6429617302""6564613294";
-
-static char s1DivPi[] =
-"0.3183098861""8379067153""7767526745""0287240689""1929148091"
-  "2897495334""6881177935""9526845307""0180227605""5325061719"
-  "1214568545""3515916074";
-
-static char sLnSqrt2PiMinusHalf[] =
-"0.4189385332""0467274178""0329736405""6176398613""9747363778"
-  "3412817151""5404827656""9592726039""7694743298""6359541976"
-  "2200564662""4634337446";
-
-static char sSqrtPi[] =
-"1.7724538509""0551602729""8167483341""1451827975""4945612238"
-  "7128213807""7898529112""8459103218""1374950656""7385446654"
-  "1622682362""4282570666";
-
-static char s1DivSqrtPi[] =
-"0.5641895835""4775628694""8079451560""7725858440""5062932899"
-  "8856844085""7217106424""6844149341""4486743660""2021073634"
-  "4302834790""6361707352";
-
-static char s2DivSqrtPi[] =
-"1.1283791670""9551257389""6158903121""5451716881""0125865799"
-  "7713688171""4434212849""3688298682""8973487320""4042147268"
-  "8605669581""2723414703";
+/* places the transcendental constants are kept to. They exceed the
+   math precision to allow for the loss of digits in range reductions */
+#define CONSTDIGITS (mathprecision + DECPRECISION + 32)
 
 static char* sBernoulli[] =
 {
@@ -252,46 +185,870 @@ static char* sBernoulli[] =
 "1"
 };
 
-floatstruct cBernoulliNum[68];
-floatstruct cBernoulliDen[68];
+floatstruct _cBernoulliNum[68];
+floatstruct _cBernoulliDen[68];
 
 floatstruct c1;
 floatstruct c2;
 floatstruct c3;
 floatstruct c12;
 floatstruct c16;
-floatstruct cExp;
+floatstruct _cExp;
 floatstruct cMinus1;
 floatstruct cMinus20;
 floatstruct c1Div2;
-floatstruct cLn2;
-floatstruct cLn3;
-floatstruct cLn7;
-floatstruct cLn10;
-floatstruct cPhi;
-floatstruct cPi;
-floatstruct cPiDiv2;
-floatstruct cPiDiv4;
-floatstruct c2Pi;
-floatstruct c1DivPi;
-floatstruct cSqrtPi;
-floatstruct cLnSqrt2PiMinusHalf;
-floatstruct c1DivSqrtPi;
-floatstruct c2DivSqrtPi;
+floatstruct _cLn2;
+floatstruct _cLn3;
+floatstruct _cLn7;
+floatstruct _cLn10;
+floatstruct _cPhi;
+floatstruct _cPi;
+floatstruct _cPiDiv2;
+floatstruct _cPiDiv4;
+floatstruct _c2Pi;
+floatstruct _c1DivPi;
+floatstruct _cSqrtPi;
+floatstruct _cLnSqrt2PiMinusHalf;
+floatstruct _c1DivSqrtPi;
+floatstruct _c2DivSqrtPi;
 floatstruct cMinus0_4;
-floatstruct cUnsignedBound;
+floatstruct _cUnsignedBound;
 
-int erfcdigits = 0;
-floatstruct erfccoeff[MAXERFCIDX];
-floatstruct erfcalpha;
-floatstruct erfcalphasqr;
-floatstruct erfct2;
-floatstruct erfct3;
+int decprecision = DECPRECISION;
+int mathprecision = MATHPRECISION;
+
+int _erfccount;
+floatstruct _erfccoeff[MAXERFCIDX];
+floatstruct _erfcalpha;
+floatstruct _erfcalphasqr;
+
+/* the transcendental constants, grouped by CONSTE, CONSTLN, CONSTPI
+   and CONSTPHI */
+static floatnum _transcendental[] =
+{
+  &_cExp,
+  &_cLn2, &_cLn3, &_cLn7, &_cLn10,
+  &_cPi, &_cPiDiv2, &_cPiDiv4, &_c2Pi, &_c1DivPi, &_cSqrtPi,
+  &_cLnSqrt2PiMinusHalf, &_c1DivSqrtPi, &_c2DivSqrtPi,
+  &_cPhi
+};
+
+#define TRANSCENDENTALCOUNT \
+  ((int)(sizeof(_transcendental)/sizeof(floatnum)))
+
+/* the first index of each group in _transcendental, and the end of
+   the last one */
+static const int _groupstart[CONSTPHI + 2] = {0, 1, 5, 14, 15};
+
+/* the most precise values of the transcendental constants computed
+   so far, unrounded, and the number of places each group is valid to.
+   Requests for fewer places are served from here */
+static floatstruct _cache[TRANSCENDENTALCOUNT];
+static int _cachedigits[CONSTPHI + 1];
+
+/* set, once a group of constants is ready for use at the current
+   precision. Cleared whenever the precision changes */
+static char _ready[CONSTGROUPS];
+
+/* the lookup tables, indexed by table, then by
+   (level - 1) * TBLSIZE + k + TBLMAXK. An entry is created, and its
+   unrounded value kept in _tblcache, when first computed. _tbldigits
+   is 0 for entries never computed */
+#define TBLSIZE (2*TBLMAXK + 1)
+#define TBLENTRIES (TBLLEVELS*TBLSIZE)
+static floatstruct _tbl[TBLS][TBLENTRIES];
+static floatstruct _tblcache[TBLS][TBLENTRIES];
+static int _tbldigits[TBLS][TBLENTRIES];
+static char _tblready[TBLS][TBLENTRIES];
+
+/* the Bernoulli numbers B(2n), EXACTBERNOULLIIDX < n <= _bernoullicount,
+   valid to _bernoullidigits places (see floatmath_bernoulli), and the
+   powers k^(-2n), 2 <= k, _computebernoulli carries from one n to the
+   next */
+#define MAXZETAIDX (MAXBERNOULLIN/6 + 8)
+static floatstruct _bernoulli[MAXBERNOULLIN - EXACTBERNOULLIIDX];
+static int _bernoullicount;
+static int _bernoullidigits;
+static char _bernoulliready;
+static floatstruct _zetapwr[MAXZETAIDX];
+
+/* processor time spent in floatmath_init, and in setting up constants
+   on demand */
+static clock_t _inittime;
+static clock_t _setuptime;
+
+/*========================   binary splitting   ======================*/
+
+/* A series sum a(0)/b(0) + a(1)/b(1) * p(1)/q(1) + ...
+   + a(n)/b(n) * p(1)...p(n)/(q(1)...q(n)) of rational terms with small
+   integer factors is summed up exactly in integer arithmetic by
+   recursively splitting the index range into halves. For a range
+   [k0, k1), P and Q hold the products of p(k) and q(k), B that of
+   b(k), and T is the range's partial sum, scaled by B*Q. Two adjacent
+   ranges are merged by
+     P = P1*P2, Q = Q1*Q2, B = B1*B2, T = B2*Q2*T1 + B1*P1*T2,
+   so that the expensive multiplications occur on operands of similar
+   size. The integers are bc_nums of scale 0 */
+typedef struct
+{
+  bc_num p;
+  bc_num q;
+  bc_num b;
+  bc_num t;
+} t_bsplit;
+
+/* sets p(k), q(k), b(k) and t(k) = a(k)*p(k) for a single index k of
+   the series selected by <param> */
+typedef void (*t_bsterm)(t_bsplit* s, int k, int param);
+
+static void
+_bsfree(
+  t_bsplit* s)
+{
+  bc_free_num(&s->p);
+  bc_free_num(&s->q);
+  bc_free_num(&s->b);
+  bc_free_num(&s->t);
+}
+
+static void
+_bsplit(
+  t_bsplit* s,
+  int k0,
+  int k1,
+  t_bsterm term,
+  int param)
+{
+  t_bsplit r;
+  bc_num tmp;
+  int km;
+
+  if (k1 - k0 == 1)
+  {
+    s->p = s->q = s->b = s->t = NULL;
+    term(s, k0, param);
+    return;
+  }
+  km = (k0 + k1) / 2;
+  _bsplit(s, k0, km, term, param);
+  _bsplit(&r, km, k1, term, param);
+  tmp = NULL;
+  bc_multiply(r.b, r.q, &tmp, 0);
+  bc_multiply(s->t, tmp, &s->t, 0);
+  bc_multiply(s->b, s->p, &tmp, 0);
+  bc_multiply(r.t, tmp, &tmp, 0);
+  bc_add(s->t, tmp, &s->t, 0);
+  bc_multiply(s->p, r.p, &s->p, 0);
+  bc_multiply(s->q, r.q, &s->q, 0);
+  bc_multiply(s->b, r.b, &s->b, 0);
+  bc_free_num(&tmp);
+  _bsfree(&r);
+}
+
+/* converts the integer <n> to a floatnum. Digits beyond the current
+   maximum precision are cut off */
+static void
+_bc2float(
+  floatnum x,
+  bc_num n)
+{
+  char* str;
+
+  str = bc_num2str(n);
+  float_setscientific(x, str, NULLTERMINATED);
+  free(str);
+}
+
+/* sums up the first <terms> terms of a series to <digits> places */
+static void
+_bssum(
+  floatnum x,
+  int terms,
+  t_bsterm term,
+  int param,
+  int digits)
+{
+  t_bsplit s;
+  floatstruct den;
+
+  _bsplit(&s, 0, terms, term, param);
+  bc_multiply(s.b, s.q, &s.q, 0);
+  float_create(&den);
+  _bc2float(x, s.t);
+  _bc2float(&den, s.q);
+  float_div(x, x, &den, digits);
+  float_free(&den);
+  _bsfree(&s);
+}
+
+/* e - 1 = sum 1/(k+1)! */
+static void
+_bsexpterm(
+  t_bsplit* s,
+  int k,
+  int param)
+{
+  (void)param;
+  bc_int2num(&s->p, 1);
+  bc_int2num(&s->q, k + 1);
+  bc_int2num(&s->b, 1);
+  bc_int2num(&s->t, 1);
+}
+
+/* artanh(1/n) = sum 1/((2k+1)*n^(2k+1)), n = <param> */
+static void
+_bsartanhterm(
+  t_bsplit* s,
+  int k,
+  int param)
+{
+  bc_int2num(&s->p, 1);
+  bc_int2num(&s->q, k == 0? param : param * param);
+  bc_int2num(&s->b, 2*k + 1);
+  bc_int2num(&s->t, 1);
+}
+
+/* Chudnovsky's series
+   426880*sqrt(10005)/pi = sum (-1)^k (6k)! (13591409 + 545140134k)
+                           / ((3k)! (k!)^3 640320^(3k)),
+   p(k) = -(6k-5)(2k-1)(6k-1), q(k) = k^3*640320^3/24 */
+static void
+_bspiterm(
+  t_bsplit* s,
+  int k,
+  int param)
+{
+  bc_num tmp;
+
+  (void)param;
+  bc_int2num(&s->b, 1);
+  if (k == 0)
+  {
+    bc_int2num(&s->p, 1);
+    bc_int2num(&s->q, 1);
+    bc_int2num(&s->t, 13591409);
+    return;
+  }
+  tmp = NULL;
+  bc_int2num(&s->p, -(6*k - 5) * (2*k - 1));
+  bc_int2num(&tmp, 6*k - 1);
+  bc_multiply(s->p, tmp, &s->p, 0);
+  bc_int2num(&s->q, k);
+  bc_multiply(s->q, s->q, &tmp, 0);
+  bc_multiply(s->q, tmp, &s->q, 0);
+  bc_int2num(&tmp, 640320);
+  bc_multiply(s->q, tmp, &s->q, 0);
+  bc_multiply(s->q, tmp, &s->q, 0);
+  bc_int2num(&tmp, 26680);
+  bc_multiply(s->q, tmp, &s->q, 0);
+  bc_int2num(&s->t, k);
+  bc_int2num(&tmp, 545140134);
+  bc_multiply(s->t, tmp, &s->t, 0);
+  bc_int2num(&tmp, 13591409);
+  bc_add(s->t, tmp, &s->t, 0);
+  bc_multiply(s->t, s->p, &s->t, 0);
+  bc_free_num(&tmp);
+}
+
+/* artanh(1/n) for n >= 2 */
+static void
+_artanhinv(
+  floatnum x,
+  int n,
+  int digits)
+{
+  _bssum(x, (int)((digits + 1) / (2 * log10(n))) + 1,
+         _bsartanhterm, n, digits);
+}
+
+/* each term of Chudnovsky's series adds more than 14 digits */
+static void
+_pi(
+  floatnum x,
+  int digits)
+{
+  floatstruct tmp;
+
+  float_create(&tmp);
+  _bssum(x, digits / 14 + 2, _bspiterm, 0, digits);
+  float_setinteger(&tmp, 10005);
+  float_sqrt(&tmp, digits);
+  float_muli(&tmp, &tmp, 426880, digits);
+  float_div(x, &tmp, x, digits);
+  float_free(&tmp);
+}
+
+static void
+_e(
+  floatnum x,
+  int digits)
+{
+  double lgfac;
+  int terms;
+
+  /* (terms+1)! > 10^(digits+1) */
+  lgfac = 0;
+  for (terms = 1; lgfac <= digits + 1; ++terms)
+    lgfac += log10(terms + 1);
+  _bssum(x, terms, _bsexpterm, 0, digits);
+  float_add(x, x, &c1, digits);
+}
+
+/* sum of coef[i]*terms[i], i = 0..3 */
+static void
+_lincomb4(
+  floatnum x,
+  floatstruct* terms,
+  const int* coef,
+  int digits)
+{
+  floatstruct tmp;
+  int i;
+
+  float_create(&tmp);
+  float_setzero(x);
+  for (i = -1; ++i < 4;)
+  {
+    float_muli(&tmp, &terms[i], coef[i], digits);
+    float_add(x, x, &tmp, digits);
+  }
+  float_free(&tmp);
+}
+
+/* ln 2, ln 3, ln 7 and ln 10 are linear combinations of
+   artanh(1/n), n = 251, 449, 4801, 8749 */
+static void
+_computeln(
+  int workprec)
+{
+  static const int args[4] = {251, 449, 4801, 8749};
+  static const int ln2[4] = {144, 54, -38, 62};
+  static const int ln3[4] = {228, 86, -60, 98};
+  static const int ln7[4] = {404, 152, -106, 174};
+  static const int ln10[4] = {478, 180, -126, 206};
+  floatstruct a[4];
+  int i;
+
+  for (i = -1; ++i < 4;)
+  {
+    float_create(&a[i]);
+    _artanhinv(&a[i], args[i], workprec);
+  }
+  _lincomb4(&_cLn2, a, ln2, workprec);
+  _lincomb4(&_cLn3, a, ln3, workprec);
+  _lincomb4(&_cLn7, a, ln7, workprec);
+  _lincomb4(&_cLn10, a, ln10, workprec);
+  for (i = -1; ++i < 4;)
+    float_free(&a[i]);
+}
+
+/* pi follows Chudnovsky's formula, the rest is derived from pi.
+   ln(sqrt(2*pi)) requires the logarithms to be set up (see _setup) */
+static void
+_computepi(
+  int workprec)
+{
+  floatstruct tmp;
+
+  float_create(&tmp);
+  _pi(&_cPi, workprec);
+  float_divi(&_cPiDiv2, &_cPi, 2, workprec);
+  float_divi(&_cPiDiv4, &_cPi, 4, workprec);
+  float_muli(&_c2Pi, &_cPi, 2, workprec);
+  float_div(&_c1DivPi, &c1, &_cPi, workprec);
+  float_copy(&_cSqrtPi, &_cPi, EXACT);
+  float_sqrt(&_cSqrtPi, workprec);
+  float_div(&_c1DivSqrtPi, &c1, &_cSqrtPi, workprec);
+  float_muli(&_c2DivSqrtPi, &_c1DivSqrtPi, 2, workprec);
+  /* ln(sqrt(2*pi)) - 0.5. ln(2*pi) = ln 10 + ln(1 + (0.2*pi - 1)),
+     by the series, as the AGM of _ln would need pi itself */
+  float_copy(&tmp, &_c2Pi, EXACT);
+  float_addexp(&tmp, -1);
+  float_sub(&tmp, &tmp, &c1, workprec);
+  _lnxplus1lt1(&tmp, workprec);
+  float_add(&tmp, &tmp, &_cLn10, workprec);
+  float_mul(&tmp, &tmp, &c1Div2, workprec);
+  float_sub(&_cLnSqrt2PiMinusHalf, &tmp, &c1Div2, workprec);
+  float_free(&tmp);
+}
+
+/* (1 + sqrt 5)/2 */
+static void
+_computephi(
+  int workprec)
+{
+  float_setinteger(&_cPhi, 5);
+  float_sqrt(&_cPhi, workprec);
+  float_add(&_cPhi, &_cPhi, &c1, workprec);
+  float_mul(&_cPhi, &_cPhi, &c1Div2, workprec);
+}
+
+/* evaluates a group of transcendental constants to <digits> places
+   plus a few guard digits, using binary split series only, and no
+   constant but the rational ones. Results are left unrounded */
+static void
+_computeconsts(
+  int group,
+  int digits)
+{
+  int workprec;
+  int save;
+
+  workprec = digits + 5;
+  /* room for the digits cut off in _bc2float */
+  save = float_setprecision(workprec + 35);
+  switch (group)
+  {
+  case CONSTE:
+    _e(&_cExp, workprec);
+    break;
+  case CONSTLN:
+    _computeln(workprec);
+    break;
+  case CONSTPI:
+    _computepi(workprec);
+    break;
+  default:
+    _computephi(workprec);
+  }
+  float_setprecision(save);
+}
+
+/* brings a group of transcendental constants to <digits> places. They
+   are computed only if no earlier call asked for as many places, else
+   they are rounded from the cache */
+static void
+_setconsts(
+  int group,
+  int digits)
+{
+  int i;
+
+  if (digits > _cachedigits[group])
+  {
+    _computeconsts(group, digits);
+    for (i = _groupstart[group]; i < _groupstart[group+1]; ++i)
+      float_copy(&_cache[i], _transcendental[i], EXACT);
+    _cachedigits[group] = digits;
+  }
+  for (i = _groupstart[group]; i < _groupstart[group+1]; ++i)
+    float_round(_transcendental[i], &_cache[i], digits, TONEAREST);
+}
+
+/*==========================   lookup tables   =======================*/
+
+/* evaluates entry <k> of level <level> of table <tbl> to <digits>
+   places plus a few guard digits. The entries of floatconst.h's
+   TBLLN and TBLARCTAN use the series of floatseries.c without any
+   argument reduction that would need a transcendental constant or
+   a table. The result is left unrounded */
+static void
+_computetbl(
+  floatnum x,
+  int tbl,
+  int level,
+  int k,
+  int digits)
+{
+  int workprec;
+  int save;
+
+  workprec = digits + 5;
+  save = float_setprecision(workprec + 5);
+  float_setinteger(x, k);
+  float_addexp(x, -level);
+  switch (tbl)
+  {
+  case TBLLN:
+    _lnxplus1near0(x, workprec);
+    break;
+  default:
+    _arctanlt1(x, workprec);
+  }
+  float_setprecision(save);
+}
+
+/* brings a table entry to <digits> places, computing it only if no
+   earlier call asked for as many places */
+static void
+_settbl(
+  int tbl,
+  int idx,
+  int digits)
+{
+  if (_tbldigits[tbl][idx] == 0)
+  {
+    float_create(&_tbl[tbl][idx]);
+    float_create(&_tblcache[tbl][idx]);
+  }
+  if (digits > _tbldigits[tbl][idx])
+  {
+    _computetbl(&_tblcache[tbl][idx], tbl, idx / TBLSIZE + 1,
+                idx % TBLSIZE - TBLMAXK, digits);
+    _tbldigits[tbl][idx] = digits;
+  }
+  float_round(&_tbl[tbl][idx], &_tblcache[tbl][idx], digits, TONEAREST);
+}
+
+/*========================   Bernoulli numbers   =====================*/
+
+static char
+_isprime(
+  int n)
+{
+  int d;
+
+  if (n < 2)
+    return 0;
+  for (d = 2; d * d <= n; ++d)
+    if (n % d == 0)
+      return 0;
+  return 1;
+}
+
+static void _setup(int group);
+
+/* picks an alpha suitable for <digits> places and evaluates the
+   coefficients exp(-k*k*alpha*alpha) of the erfc sum (see erfcsum in
+   floaterf.c) iteratively, each one only as precise as its contribution
+   to the sum requires */
+static void
+_computeerfc(
+  int digits)
+{
+  floatstruct t2, t3;
+  int i, workprec;
+
+  float_create(&t2);
+  float_create(&t3);
+  /* this alpha need not be high precision, any alpha near the
+     one evaluated here would do */
+  float_setfloat(&_erfcalpha, M_PI / aprxsqrt((digits + 4) * M_LN10));
+  float_round(&_erfcalpha, &_erfcalpha, 3, TONEAREST);
+  float_mul(&_erfcalphasqr, &_erfcalpha, &_erfcalpha, EXACT);
+  float_copy(&t2, &_erfcalphasqr, EXACT);
+  float_neg(&t2);
+  _exp(&t2, digits + 3); /* exp(-alpha*alpha) */
+  float_copy(_erfccoeff, &t2, EXACT);
+  float_mul(&t3, &t2, &t2, digits + 3); /* exp(-2*alpha*alpha) */
+  for (i = 0; ++i < MAXERFCIDX;)
+  {
+    workprec = digits + float_getexponent(&_erfccoeff[i-1]) + 1;
+    if (workprec <= 0)
+      break;
+    float_mul(&t2, &t2, &t3, workprec + 3);
+    float_mul(&_erfccoeff[i], &t2, &_erfccoeff[i-1], workprec + 3);
+  }
+  _erfccount = i;
+  float_free(&t3);
+  float_free(&t2);
+}
+
+/* evaluates B(2n), EXACTBERNOULLIIDX < n <= <count>, to <digits> places,
+   using
+     B(2n) = (-1)^(n+1) * 2*(2n)!/(2*pi)^(2n) * zeta(2n).
+   zeta(2n) = 1 + 2^(-2n) + 3^(-2n) + ... needs about 10^(p/(2n))
+   summands for p places. As long as the numerator of B(2n) is shorter
+   than <digits>, B(2n) is found exactly instead: by the theorem of
+   von Staudt and Clausen, the denominator is the product of all primes
+   q + 1 with q dividing 2n, and the approximation times the denominator
+   is rounded to the nearest integer. So the summands need not be
+   more precise than the numerator is long, and there are less than
+   n/6 of them. The powers k^(-2n) are updated from one n to the next */
+static void
+_computebernoulli(
+  int count,
+  int digits)
+{
+  floatstruct f, c, zeta, den, tmp;
+  floatnum b;
+  int n, k, q, kmax, kvalid, places, save;
+  char exact;
+
+  if (!_ready[CONSTPI])
+    _setup(CONSTPI);
+  /* _raisei adds a few guard digits growing with the exponent */
+  save = float_setprecision(digits + 10);
+  float_create(&f);
+  float_create(&c);
+  float_create(&zeta);
+  float_create(&den);
+  float_create(&tmp);
+  /* c = 1/(2*pi)^2, f = 2*(2n)!/(2*pi)^(2n) */
+  float_mul(&c, &_c2Pi, &_c2Pi, digits+2);
+  float_reciprocal(&c, digits+2);
+  n = EXACTBERNOULLIIDX + 1;
+  float_copy(&f, &_c2Pi, EXACT);
+  _raisei(&f, -2*n, digits+2);
+  float_muli(&f, &f, 2, digits+2);
+  for (k = 1; ++k <= 2*n;)
+    float_muli(&f, &f, k, digits+2);
+  kvalid = 1;
+  for (; n <= count; ++n)
+  {
+    if (n > EXACTBERNOULLIIDX + 1)
+    {
+      float_muli(&f, &f, (2*n - 1)*2*n, digits+2);
+      float_mul(&f, &f, &c, digits+2);
+    }
+    float_copy(&den, &c1, EXACT);
+    for (q = 0; ++q <= 2*n;)
+      if ((2*n) % q == 0 && _isprime(q + 1))
+        float_muli(&den, &den, q + 1, EXACT);
+    places = float_getexponent(&f) + float_getexponent(&den) + 10;
+    exact = places <= digits;
+    if (!exact)
+      places = digits + 2;
+    kmax = (int)pow(10, (places + 1) / (2.0 * n));
+    if (kmax > MAXZETAIDX + 1)
+      kmax = MAXZETAIDX + 1;
+    for (k = 1; ++k <= kmax;)
+      if (k <= kvalid)
+        float_divi(&_zetapwr[k-2], &_zetapwr[k-2], k*k, digits+2);
+      else
+      {
+        float_setinteger(&_zetapwr[k-2], k);
+        _raisei(&_zetapwr[k-2], -2*n, digits+2);
+      }
+    kvalid = kmax;
+    /* add the small summands first */
+    float_copy(&zeta, &c1, EXACT);
+    for (k = kmax + 1; --k >= 2;)
+      float_add(&zeta, &zeta, &_zetapwr[k-2], places+2);
+    b = &_bernoulli[n - EXACTBERNOULLIIDX - 1];
+    float_mul(b, &f, &zeta, places+2);
+    if (exact)
+    {
+      float_mul(&tmp, b, &den, places+2);
+      float_roundtoint(&tmp, TONEAREST);
+      float_div(b, &tmp, &den, digits);
+    }
+    if ((n & 1) == 0)
+      float_neg(b);
+  }
+  float_free(&f);
+  float_free(&c);
+  float_free(&zeta);
+  float_free(&den);
+  float_free(&tmp);
+  for (k = -1; ++k < MAXZETAIDX;)
+    float_free(&_zetapwr[k]);
+  float_setprecision(save);
+}
+
+/*=====================   lazy initialization   ======================*/
+
+/* A group of constants is set up by the first thread that needs it,
+   while holding a lock. The other threads see the flag in _ready only
+   after the constants are written */
+
+#if defined(_WIN32)
+#include <windows.h>
+static SRWLOCK _lock = SRWLOCK_INIT;
+#define _acquire() AcquireSRWLockExclusive(&_lock)
+#define _release() ReleaseSRWLockExclusive(&_lock)
+#else
+#include <pthread.h>
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+#define _acquire() pthread_mutex_lock(&_lock)
+#define _release() pthread_mutex_unlock(&_lock)
+#endif
+
+/* set while the calling thread holds the lock. Setting up a group of
+   constants may need table entries (ln(2*pi) does), these are set up
+   then without taking the lock a second time */
+static FLOAT_THREAD_LOCAL char _holding;
+
+#if defined(__ATOMIC_ACQUIRE)
+#  define _loadflag(f) __atomic_load_n(&(f), __ATOMIC_ACQUIRE)
+#  define _storeflag(f) __atomic_store_n(&(f), 1, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+/* volatile accesses have acquire and release semantics here */
+#  define _loadflag(f) (*(volatile char*)&(f))
+#  define _storeflag(f) (*(volatile char*)&(f) = 1)
+#else
+#  define _loadflag(f) (f)
+#  define _storeflag(f) ((f) = 1)
+#endif
+
+/* sets up a group of constants, with the lock held */
+static void
+_setup(
+  int group)
+{
+  clock_t start;
+  int save;
+  int i;
+
+  if ((group == CONSTPI || group == CONSTERFC) && !_ready[CONSTLN])
+    _setup(CONSTLN);
+  start = clock();
+  switch (group)
+  {
+  case CONSTBERNOULLI:
+    save = float_setprecision(MAXDIGITS);
+    for (i = -1; ++i < MAXBERNOULLIIDX;)
+    {
+      float_setscientific(&_cBernoulliNum[i], sBernoulli[2*i],
+                          NULLTERMINATED);
+      float_setscientific(&_cBernoulliDen[i], sBernoulli[2*i+1],
+                          NULLTERMINATED);
+    }
+    float_setprecision(save);
+    break;
+  case CONSTERFC:
+    _computeerfc(mathprecision);
+    break;
+  case CONSTUNSIGNEDBOUND:
+    float_copy(&_cUnsignedBound, &c1, EXACT);
+    for (i = -1; ++i < 2*(int)sizeof(unsigned);)
+      float_mul(&_cUnsignedBound, &c16, &_cUnsignedBound, EXACT);
+    break;
+  default:
+    _setconsts(group, CONSTDIGITS);
+  }
+  _setuptime += clock() - start;
+  _storeflag(_ready[group]);
+}
+
+void
+floatmath_need(
+  int group)
+{
+  if (_loadflag(_ready[group]))
+    return;
+  _acquire();
+  _holding = 1;
+  if (!_ready[group])
+    _setup(group);
+  _holding = 0;
+  _release();
+}
+
+int
+floatmath_isready(
+  int group)
+{
+  return _loadflag(_ready[group]) != 0;
+}
+
+floatnum
+floatmath_tbl(
+  int tbl,
+  int level,
+  int k)
+{
+  clock_t start;
+  int idx;
+  char nested;
+
+  idx = (level - 1) * TBLSIZE + k + TBLMAXK;
+  if (!_loadflag(_tblready[tbl][idx]))
+  {
+    nested = _holding;
+    if (!nested)
+    {
+      _acquire();
+      _holding = 1;
+    }
+    if (!_tblready[tbl][idx])
+    {
+      start = clock();
+      _settbl(tbl, idx, CONSTDIGITS);
+      if (!nested)
+        _setuptime += clock() - start;
+      _storeflag(_tblready[tbl][idx]);
+    }
+    if (!nested)
+    {
+      _holding = 0;
+      _release();
+    }
+  }
+  return &_tbl[tbl][idx];
+}
+
+floatnum
+floatmath_bernoulli(
+  int n)
+{
+  clock_t start;
+  int count;
+  char nested;
+
+  if (n <= EXACTBERNOULLIIDX || n > MAXBERNOULLIN)
+    return NULL;
+  if (!_loadflag(_bernoulliready))
+  {
+    nested = _holding;
+    if (!nested)
+    {
+      _acquire();
+      _holding = 1;
+    }
+    if (!_bernoulliready)
+    {
+      start = clock();
+      /* as many as the asymptotic series of ln Gamma needs at most,
+         see _findorder in floatgamma.c */
+      count = (5*CONSTDIGITS + 5)/9 + 1;
+      if (count > MAXBERNOULLIN)
+        count = MAXBERNOULLIN;
+      if (count > _bernoullicount || CONSTDIGITS > _bernoullidigits)
+      {
+        _computebernoulli(count, CONSTDIGITS);
+        _bernoullicount = count;
+        _bernoullidigits = CONSTDIGITS;
+      }
+      if (!nested)
+        _setuptime += clock() - start;
+      _storeflag(_bernoulliready);
+    }
+    if (!nested)
+    {
+      _holding = 0;
+      _release();
+    }
+  }
+  return n <= _bernoullicount? &_bernoulli[n - EXACTBERNOULLIIDX - 1] : NULL;
+}
+
+/* each level saves a summand or two of the final series, but costs a
+   few linear time operations, so the number of levels grows with the
+   square root of the number of places */
+int
+floatmath_tbllevels(
+  int digits)
+{
+  int levels;
+
+  levels = (int)aprxsqrt(digits / 2);
+  if (levels < 4)
+    return 4;
+  return levels > TBLLEVELS? TBLLEVELS : levels;
+}
+
+long
+floatmath_inittime()
+{
+  return (long)_inittime;
+}
+
+long
+floatmath_setuptime()
+{
+  return (long)_setuptime;
+}
+
+/*=========================   interface   ============================*/
 
 void
 floatmath_init()
 {
+  clock_t start;
   int i, save;
+
+  start = clock();
   floatnum_init();
 
   save = float_setprecision(MAXDIGITS);
@@ -311,63 +1068,73 @@ floatmath_init()
   float_setinteger(&cMinus20, -20);
   float_create(&c1Div2);
   float_setscientific(&c1Div2, ".5", NULLTERMINATED);
-  float_create(&cExp);
-  float_setscientific(&cExp, sExp, NULLTERMINATED);
-  float_create(&cLn2);
-  float_setscientific(&cLn2, sLn2, NULLTERMINATED);
-  float_create(&cLn3);
-  float_setscientific(&cLn3, sLn3, NULLTERMINATED);
-  float_create(&cLn7);
-  float_setscientific(&cLn7, sLn7, NULLTERMINATED);
-  float_create(&cLn10);
-  float_setscientific(&cLn10, sLn10, NULLTERMINATED);
-  float_create(&cPhi);
-  float_setscientific(&cPhi, sPhi, NULLTERMINATED);
-  float_create(&cPi);
-  float_setscientific(&cPi, sPi, NULLTERMINATED);
-  float_create(&cPiDiv2);
-  float_setscientific(&cPiDiv2, sPiDiv2, NULLTERMINATED);
-  float_create(&cPiDiv4);
-  float_setscientific(&cPiDiv4, sPiDiv4, NULLTERMINATED);
-  float_create(&c2Pi);
-  float_setscientific(&c2Pi, s2Pi, NULLTERMINATED);
-  float_create(&c1DivPi);
-  float_setscientific(&c1DivPi, s1DivPi, NULLTERMINATED);
-  float_create(&cSqrtPi);
-  float_setscientific(&cSqrtPi, sSqrtPi, NULLTERMINATED);
-  float_create(&cLnSqrt2PiMinusHalf);
-  float_setscientific(&cLnSqrt2PiMinusHalf, sLnSqrt2PiMinusHalf,
-                      NULLTERMINATED);
-  float_create(&c1DivSqrtPi);
-  float_setscientific(&c1DivSqrtPi, s1DivSqrtPi, NULLTERMINATED);
-  float_create(&c2DivSqrtPi);
-  float_setscientific(&c2DivSqrtPi, s2DivSqrtPi, NULLTERMINATED);
   float_create(&cMinus0_4);
   float_setscientific(&cMinus0_4, "-.4", NULLTERMINATED);
+  /* everything else is set up by floatmath_need */
+  for (i = -1; ++i < TRANSCENDENTALCOUNT;)
+  {
+    float_create(_transcendental[i]);
+    float_create(&_cache[i]);
+  }
+  for (i = -1; ++i <= CONSTPHI;)
+    _cachedigits[i] = 0;
   for (i = -1; ++i < MAXBERNOULLIIDX;)
   {
-    float_create(&cBernoulliNum[i]);
-    float_create(&cBernoulliDen[i]);
-    float_setscientific(&cBernoulliNum[i], sBernoulli[2*i], NULLTERMINATED);
-    float_setscientific(&cBernoulliDen[i], sBernoulli[2*i+1], NULLTERMINATED);
+    float_create(&_cBernoulliNum[i]);
+    float_create(&_cBernoulliDen[i]);
   }
-  float_create(&cUnsignedBound);
-  float_copy(&cUnsignedBound, &c1, EXACT);
-  for (i = -1; ++i < 2*(int)sizeof(unsigned);)
-    float_mul(&cUnsignedBound, &c16, &cUnsignedBound, EXACT);
+  float_create(&_cUnsignedBound);
+  for (i = -1; ++i < CONSTGROUPS;)
+    _ready[i] = 0;
+  memset(_tbldigits, 0, sizeof(_tbldigits));
+  memset(_tblready, 0, sizeof(_tblready));
+  for (i = -1; ++i < MAXBERNOULLIN - EXACTBERNOULLIIDX;)
+    float_create(&_bernoulli[i]);
+  for (i = -1; ++i < MAXZETAIDX;)
+    float_create(&_zetapwr[i]);
+  _bernoullicount = EXACTBERNOULLIIDX;
+  _bernoullidigits = 0;
+  _bernoulliready = 0;
   for (i = -1; ++i < MAXERFCIDX;)
-    float_create(&erfccoeff[i]);
-  float_create(&erfcalpha);
-  float_create(&erfcalphasqr);
-  float_create(&erfct2);
-  float_create(&erfct3);
+    float_create(&_erfccoeff[i]);
+  float_create(&_erfcalpha);
+  float_create(&_erfcalphasqr);
+  _erfccount = 0;
   float_setprecision(save);
+  _setuptime = 0;
+  _inittime = clock() - start;
+}
+
+int
+floatmath_setprecision(
+  int digits)
+{
+  int result;
+  int i;
+
+  result = decprecision;
+  if (digits < DECPRECISION)
+    digits = DECPRECISION;
+  if (digits > MAXDECPRECISION)
+    digits = MAXDECPRECISION;
+  decprecision = digits;
+  mathprecision = digits + MATHPRECISION - DECPRECISION;
+  float_setprecision(MATHDIGITS);
+  if (digits != result)
+  {
+    for (i = -1; ++i <= CONSTPHI;)
+      _ready[i] = 0;
+    _ready[CONSTERFC] = 0;
+    memset(_tblready, 0, sizeof(_tblready));
+    _bernoulliready = 0;
+  }
+  return result;
 }
 
 void
 floatmath_exit()
 {
-  int i;
+  int i, t;
 
   float_free(&c1);
   float_free(&c2);
@@ -377,32 +1144,39 @@ floatmath_exit()
   float_free(&cMinus1);
   float_free(&cMinus20);
   float_free(&c1Div2);
-  float_free(&cExp);
-  float_free(&cLn2);
-  float_free(&cLn3);
-  float_free(&cLn7);
-  float_free(&cLn10);
-  float_free(&cPhi);
-  float_free(&cPi);
-  float_free(&cPiDiv2);
-  float_free(&cPiDiv4);
-  float_free(&c2Pi);
-  float_free(&c1DivPi);
-  float_free(&cSqrtPi);
-  float_free(&cLnSqrt2PiMinusHalf);
-  float_free(&c1DivSqrtPi);
-  float_free(&c2DivSqrtPi);
   float_free(&cMinus0_4);
+  for (i = -1; ++i < TRANSCENDENTALCOUNT;)
+  {
+    float_free(_transcendental[i]);
+    float_free(&_cache[i]);
+  }
+  for (i = -1; ++i <= CONSTPHI;)
+    _cachedigits[i] = 0;
   for (i = -1; ++i < MAXBERNOULLIIDX;)
   {
-    float_free(&cBernoulliNum[i]);
-    float_free(&cBernoulliDen[i]);
+    float_free(&_cBernoulliNum[i]);
+    float_free(&_cBernoulliDen[i]);
   }
-  float_free(&cUnsignedBound);
+  float_free(&_cUnsignedBound);
+  for (i = -1; ++i < CONSTGROUPS;)
+    _ready[i] = 0;
+  for (t = -1; ++t < TBLS;)
+    for (i = -1; ++i < TBLENTRIES;)
+      if (_tbldigits[t][i] != 0)
+      {
+        float_free(&_tbl[t][i]);
+        float_free(&_tblcache[t][i]);
+      }
+  memset(_tbldigits, 0, sizeof(_tbldigits));
+  memset(_tblready, 0, sizeof(_tblready));
+  for (i = -1; ++i < MAXBERNOULLIN - EXACTBERNOULLIIDX;)
+    float_free(&_bernoulli[i]);
+  _bernoullicount = EXACTBERNOULLIIDX;
+  _bernoullidigits = 0;
+  _bernoulliready = 0;
   for (i = -1; ++i < MAXERFCIDX;)
-    float_free(&erfccoeff[i]);
-  float_free(&erfcalpha);
-  float_free(&erfcalphasqr);
-  float_free(&erfct2);
-  float_free(&erfct3);
+    float_free(&_erfccoeff[i]);
+  float_free(&_erfcalpha);
+  float_free(&_erfcalphasqr);
+  _erfccount = 0;
 }
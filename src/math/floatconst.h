@@ -35,7 +35,17 @@
 #include "floatnum.h"
 
 #define MAXBERNOULLIIDX 68
-#define MAXERFCIDX 80
+/* cBernoulliNum holds B(2n) exactly up to this index, the remaining
+   entries are rounded to 66 digits, good enough for MATHPRECISION */
+#define EXACTBERNOULLIIDX 47
+/* the Bernoulli numbers beyond the table are evaluated on demand, as
+   many as ln Gamma needs for the longest results */
+#define MAXBERNOULLIN \
+  ((5*(MAXDECPRECISION + MATHPRECISION + 40) + 5)/9 + 1)
+/* erfcsum needs about (digits + 4)*ln 10/pi coefficients, enough
+   room is reserved for the longest results, see MAXDECPRECISION */
+#define MAXERFCIDX \
+  ((MAXDECPRECISION + MATHPRECISION - DECPRECISION + 4) * 733 / 1000 + 4)
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,39 +55,145 @@ extern floatstruct c1;
 extern floatstruct c2;
 extern floatstruct c3;
 extern floatstruct c12;
-extern floatstruct cExp;
 extern floatstruct cMinus1;
 extern floatstruct cMinus20;
 extern floatstruct c1Div2;
-extern floatstruct cLn2;
-extern floatstruct cLn3;
-extern floatstruct cLn7;
-extern floatstruct cLn10;
-extern floatstruct cPhi;
-extern floatstruct cPi;
-extern floatstruct cPiDiv2;
-extern floatstruct cPiDiv4;
-extern floatstruct c2Pi;
-extern floatstruct c1DivPi;
-extern floatstruct cSqrtPi;
-extern floatstruct c1DivSqrtPi;
-extern floatstruct cLnSqrt2PiMinusHalf;
-extern floatstruct c2DivSqrtPi;
 extern floatstruct cMinus0_4;
-extern floatstruct cBernoulliNum[68];
-extern floatstruct cBernoulliDen[68];
-extern floatstruct cUnsignedBound;
 
-extern int erfcdigits;
-extern floatstruct erfccoeff[MAXERFCIDX];
-extern floatstruct erfcalpha;
-extern floatstruct erfcalphasqr;
-extern floatstruct erfct2;
-extern floatstruct erfct3;
+/* The remaining constants are set up on first use, a group at a time,
+   so that no time is spent on constants never used. Their values are
+   stored in the variables prefixed with an underscore, but must be
+   accessed by the names defined below only, because these make sure
+   the value is ready */
+enum
+{
+  CONSTE,
+  CONSTLN,
+  CONSTPI,
+  CONSTPHI,
+  CONSTBERNOULLI,
+  CONSTUNSIGNEDBOUND,
+  CONSTERFC,
+  CONSTGROUPS
+};
+
+extern floatstruct _cExp;
+extern floatstruct _cLn2;
+extern floatstruct _cLn3;
+extern floatstruct _cLn7;
+extern floatstruct _cLn10;
+extern floatstruct _cPhi;
+extern floatstruct _cPi;
+extern floatstruct _cPiDiv2;
+extern floatstruct _cPiDiv4;
+extern floatstruct _c2Pi;
+extern floatstruct _c1DivPi;
+extern floatstruct _cSqrtPi;
+extern floatstruct _c1DivSqrtPi;
+extern floatstruct _cLnSqrt2PiMinusHalf;
+extern floatstruct _c2DivSqrtPi;
+extern floatstruct _cBernoulliNum[68];
+extern floatstruct _cBernoulliDen[68];
+extern floatstruct _cUnsignedBound;
+extern int _erfccount;
+extern floatstruct _erfccoeff[MAXERFCIDX];
+extern floatstruct _erfcalpha;
+extern floatstruct _erfcalphasqr;
+
+#define _CONST(group, c) (floatmath_need(group), c)
+
+#define cExp (*_CONST(CONSTE, &_cExp))
+#define cLn2 (*_CONST(CONSTLN, &_cLn2))
+#define cLn3 (*_CONST(CONSTLN, &_cLn3))
+#define cLn7 (*_CONST(CONSTLN, &_cLn7))
+#define cLn10 (*_CONST(CONSTLN, &_cLn10))
+#define cPhi (*_CONST(CONSTPHI, &_cPhi))
+#define cPi (*_CONST(CONSTPI, &_cPi))
+#define cPiDiv2 (*_CONST(CONSTPI, &_cPiDiv2))
+#define cPiDiv4 (*_CONST(CONSTPI, &_cPiDiv4))
+#define c2Pi (*_CONST(CONSTPI, &_c2Pi))
+#define c1DivPi (*_CONST(CONSTPI, &_c1DivPi))
+#define cSqrtPi (*_CONST(CONSTPI, &_cSqrtPi))
+#define c1DivSqrtPi (*_CONST(CONSTPI, &_c1DivSqrtPi))
+#define cLnSqrt2PiMinusHalf (*_CONST(CONSTPI, &_cLnSqrt2PiMinusHalf))
+#define c2DivSqrtPi (*_CONST(CONSTPI, &_c2DivSqrtPi))
+#define cBernoulliNum _CONST(CONSTBERNOULLI, _cBernoulliNum)
+#define cBernoulliDen _CONST(CONSTBERNOULLI, _cBernoulliDen)
+#define cUnsignedBound (*_CONST(CONSTUNSIGNEDBOUND, &_cUnsignedBound))
+/* the parameter alpha of the erfc sum in floaterf.c, its square, and
+   the coefficients exp(-k*k*alpha*alpha), 0 < k <= erfccount, down to
+   the first one negligible at the current precision */
+#define erfccount (*_CONST(CONSTERFC, &_erfccount))
+#define erfccoeff _CONST(CONSTERFC, _erfccoeff)
+#define erfcalpha (*_CONST(CONSTERFC, &_erfcalpha))
+#define erfcalphasqr (*_CONST(CONSTERFC, &_erfcalphasqr))
+
+/* lookup tables for the argument reductions of ln, exp and the
+   trigonometric functions. Entry k, -TBLMAXK <= k <= TBLMAXK, of
+   level j, 1 <= j <= TBLLEVELS, holds, with m = k*10^-j,
+     TBLLN:      ln(1 + m), for m > -1 only,
+     TBLARCTAN:  arctan m, for |m| <= 1 only.
+   Factors 1 + m are short, so multiplying by them takes linear time.
+   Entries are set up on first use, like the constants above */
+#define TBLLEVELS 30
+#define TBLMAXK 12
+
+enum
+{
+  TBLLN,
+  TBLARCTAN,
+  TBLS
+};
+
+/* returns entry <k> of level <level> in table <tbl> (TBLLN...),
+   set up for the current precision. Safe to call from any thread */
+floatnum floatmath_tbl(int tbl, int level, int k);
+
+/* returns the Bernoulli number B(2n), EXACTBERNOULLIIDX < n, set up
+   for the current precision (cBernoulliNum/cBernoulliDen hold the
+   smaller ones exactly). NULL, if the current precision never needs B(2n).
+   Safe to call from any thread */
+floatnum floatmath_bernoulli(int n);
+
+/* the number of table levels worth using in an argument reduction
+   for a result of <digits> places */
+int floatmath_tbllevels(int digits);
+
+/* the granularity and the limit of the math library currently in
+   effect, DECPRECISION and MATHPRECISION unless changed by
+   floatmath_setprecision */
+extern int decprecision;
+extern int mathprecision;
+
+/* the guard value (see float_setprecision) the math library needs
+   for its intermediate results at the current precision */
+#define MATHDIGITS (mathprecision + MAXDIGITS - MATHPRECISION)
 
 void floatmath_init();
 void floatmath_exit();
 
+/* sets the granularity to <digits> decimal places, at least DECPRECISION
+   and at most MAXDECPRECISION. The limit of the math library becomes
+   <digits> + MATHPRECISION - DECPRECISION, the constants are
+   recomputed to match (or rounded from an earlier, more precise
+   evaluation), and the guard value of the calling thread is set
+   to MATHDIGITS. Other threads have to adjust their guard value
+   themselves. This function must not be called while another thread
+   evaluates a math function.
+   Returns the old granularity */
+int floatmath_setprecision(int digits);
+
+/* sets up a group of constants (CONSTE...), unless this is done
+   already for the current precision. Safe to call from any thread */
+void floatmath_need(int group);
+
+/* instrumentation: whether a group of constants is set up, and the
+   processor time in clock ticks spent in the last floatmath_init and
+   in setting up constants on demand since then */
+int floatmath_isready(int group);
+long floatmath_inittime();
+long floatmath_setuptime();
+
 #ifdef __cplusplus
 }
 #endif
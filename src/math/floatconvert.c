@@ -279,13 +279,13 @@ _packdec2int(
   int exp;
   int bufsz;
   int i;
-  char buf[DECPRECISION];
+  char buf[MAXDECPRECISION];
 
   float_setnan(x);
   ofs = n->seq.leadingSignDigits;
   exp = n->seq.trailing0;
   bufsz = n->seq.digits - ofs - exp;
-  if (bufsz > DECPRECISION)
+  if (bufsz > decprecision)
     return IOBufferOverflow;
   if (bufsz == 0)
     float_setzero(x);
@@ -388,10 +388,10 @@ pack2floatnum(
   float_create(&tmp);
   float_move(&tmp, x);
   float_setzero(x);
-  digits = DECPRECISION - float_getexponent(&tmp);
+  digits = decprecision - float_getexponent(&tmp);
   if (digits <= 0
       || (result = _pack2frac(x, &n->fracpart, digits)) == Success)
-    float_add(x, x, &tmp, DECPRECISION);
+    float_add(x, x, &tmp, decprecision);
   if (result != Success)
     return result;
   if (!float_getlength(x) == 0) /* no zero, no NaN? */
@@ -400,13 +400,13 @@ pack2floatnum(
     float_setinteger(&tmp, base);
     if (n->exp >= 0)
     {
-      _raiseposi_(&tmp, n->exp, DECPRECISION + 2);
-      float_mul(x, x, &tmp, DECPRECISION + 2);
+      _raiseposi_(&tmp, n->exp, decprecision + 2);
+      float_mul(x, x, &tmp, decprecision + 2);
     }
     else
     {
-      _raiseposi_(&tmp, -n->exp, DECPRECISION + 2);
-      float_div(x, x, &tmp, DECPRECISION + 2);
+      _raiseposi_(&tmp, -n->exp, decprecision + 2);
+      float_div(x, x, &tmp, decprecision + 2);
     }
   }
   float_free(&tmp);
@@ -53,7 +53,8 @@ void _longint2floatnum(floatnum f, t_longint* longint);
 /* the output process destroys x
    'digits' are the number of digits after the dot.
    Regardless of the value of 'digits', a conversion is always
-   done to DECPRECISION places
+   done to DECPRECISION places (the current granularity, see
+   floatmath_setprecision)
    Before reducing to 'digits' places the (converted) value is rounded.
    Trailing zeros are padded, if necessary, to fill to the right size.
    Errors: InvalidParam (if any of the parameters makes no sense
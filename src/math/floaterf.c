@@ -127,14 +127,17 @@ erfcasymptotic(floatnum x,
    becomes dominant and renders the result incorrect for large x. Fortunately,
    the valid range seems to overlap with the range of the asymptotic formula.
 
-   Picks a fixed alpha suitable for the desired precision and evaluates the sum
+   Uses a fixed alpha suitable for the current precision, and evaluates
+   the sum
    f(t, alpha) = Sum[k>0](exp(-k*k*alpha*alpha)/(k*k*alpha*alpha + t)
    f(t, alpha) is used in the evaluation of erfc(sqrt(t))
 
    alpha is dependent on the desired precision; For a precision of p
    places, alpha should be < pi/sqrt(p*ln 10). Unfortunately, the
    smaller alpha is, the worse is the convergence rate, so alpha is
-   usually approximately its upper limit.
+   usually approximately its upper limit. alpha and the coefficients
+   exp(-k*k*alpha*alpha) are constants set up once per precision (see
+   CONSTERFC), shared by all threads
 
    relative error for 100-digit evaluation < 5e-100 */
 
@@ -142,47 +145,19 @@ char
 erfcsum(floatnum x, /* should be the square of the parameter to erfc */
         int digits)
 {
-  int i;
-  int workprec = 0;
+  int i, count;
+  int workprec;
   floatstruct sum, smd;
-  floatnum Ei;
-
-  if (digits > erfcdigits)
-  {
-    /* cannot re-use last evaluation's intermediate results */
-    for (i = MAXERFCIDX; --i >= 0;)
-      /* clear all exp(-k*k*alpha*alpha) to indicate their absence */
-      float_free(&erfccoeff[i]);
-    /* current precision */
-    erfcdigits = digits;
-    /* create new alpha appropriate for the desired precision
-    This alpha need not be high precision, any alpha near the
-    one evaluated here would do */
-    float_setfloat(&erfcalpha, M_PI / aprxsqrt((digits + 4) * M_LN10));
-    float_round(&erfcalpha, &erfcalpha, 3, TONEAREST);
+  floatnum coeff, Ei;
 
-    float_mul(&erfcalphasqr, &erfcalpha, &erfcalpha, EXACT);
-    /* the exp(-k*k*alpha*alpha) are later evaluated iteratively.
-    Initiate the iteration here */
-    float_copy(&erfct2, &erfcalphasqr, EXACT);
-    float_neg(&erfct2);
-    _exp(&erfct2, digits + 3); /* exp(-alpha*alpha) */
-    float_copy(erfccoeff, &erfct2, EXACT); /* start value */
-    float_mul(&erfct3, &erfct2, &erfct2, digits + 3); /* exp(-2*alpha*alpha) */
-  }
+  count = erfccount;
+  coeff = erfccoeff;
   float_create(&sum);
   float_create(&smd);
   float_setzero(&sum);
-  for (i = 0; ++i < MAXERFCIDX;)
+  for (i = 0; ++i <= count;)
   {
-    Ei = &erfccoeff[i-1];
-    if (float_isnan(Ei))
-    {
-      /* if exp(-i*i*alpha*alpha) is not available, evaluate it from
-      the coefficient of the last summand */
-      float_mul(&erfct2, &erfct2, &erfct3, workprec + 3);
-      float_mul(Ei, &erfct2, &erfccoeff[i-2], workprec + 3);
-    }
+    Ei = &coeff[i-1];
     /* Ei finally decays rapidly. save some time by adjusting the
     working precision */
     workprec = digits + float_getexponent(Ei) + 1;
@@ -267,11 +242,22 @@ _erf(
   floatnum x,
   int digits)
 {
-  int workprec;
+  int workprec, places, n;
   signed char sign;
 
   sign = float_getsign(x);
   float_abs(x);
+  /* for x >= 10^e, erfc(x) < exp(-x*x) < 10^(-0.43*100^e), which is
+     negligible if 100^e exceeds 10*digits. _erfc would underflow on
+     such x */
+  for (places = 0, n = digits; n > 0; n /= 10)
+    ++places;
+  if (float_getexponent(x) > 0 && 2*float_getexponent(x) > places)
+  {
+    float_copy(x, &c1, EXACT);
+    float_setsign(x, sign);
+    return 1;
+  }
   if (float_cmp(x, &c1Div2) > 0)
   {
     workprec = digits - _logexpxsqr(float_getexponent(x));
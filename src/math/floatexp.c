@@ -32,6 +32,18 @@
 #include "floatcommon.h"
 #include "floatseries.h"
 #include "floatexp.h"
+#include "floatlog.h"
+#include <math.h>
+
+/* From this many digits on, _expltln10 refines a result of half the
+   length by a Newton step, see _expnewton. This pays off only, if the
+   logarithm is cheaper than the series here, so the default follows
+   LN_AGM_DIGITS */
+#ifndef EXP_NEWTON_DIGITS
+#define EXP_NEWTON_DIGITS 200000
+#endif
+
+int exp_newton_digits = EXP_NEWTON_DIGITS;
 
 /* uses the addition theorem
    cosh(2x)-1 == 2*(cosh x - 1)*(cosh x + 1)
@@ -130,17 +142,105 @@ _expminus1lt1(
   float_free(&tmp);
 }
 
-/* exp(x) for 0 <= x < ln 10
+/* splits exp(x) into f * exp(r), where f is a product of short
+   factors whose logarithms are known, and r is tiny. First, f is the
+   special factor of _lnfactor for 1/exp(x) (which is approx.
+   exp(x)), leaving |r| < 0.01, then the factors 1 + k*10^-j of the
+   table TBLLN follow, one decimal place at a time, as many as
+   floatmath_tbllevels suggests. Returns f, rounded to <digits>+2
+   places, and places r in x. Valid for -0.55 <= x <= 0.5 */
+static void
+_expreduce(
+  floatnum x,
+  floatnum f,
+  int digits)
+{
+  floatstruct tmp, lnf;
+  double xf, scale;
+  int level, levels, k;
+
+  float_create(&tmp);
+  float_create(&lnf);
+  float_copy(f, &c1, EXACT);
+  xf = float_asfloat(x);
+  if (float_getexponent(x) >= -2 && exp(-xf) != 1)
+  {
+    float_setfloat(&tmp, (float)(exp(-xf) - 1));
+    if (float_getexponent(&tmp) >= -2)
+    {
+      _lnfactor(&tmp, f, &lnf, digits+4);
+      float_sub(x, x, &lnf, digits+1);
+    }
+  }
+  levels = floatmath_tbllevels(digits);
+  scale = 100;
+  for (level = 2; ++level <= levels && !float_iszero(x);)
+  {
+    /* 1 + k*10^-level approx.== exp x */
+    scale *= 10;
+    xf = float_asfloat(x);
+    k = (int)floor(xf * (1 + xf * (0.5 + xf / 6)) * scale + 0.5);
+    if (k == 0)
+      continue;
+    if (k > TBLMAXK || k < -TBLMAXK)
+      k = k > 0? TBLMAXK : -TBLMAXK;
+    float_setinteger(&tmp, k);
+    float_addexp(&tmp, -level);
+    float_add(&tmp, &tmp, &c1, EXACT);
+    float_mul(f, f, &tmp, digits+2);
+    float_sub(x, x, floatmath_tbl(TBLLN, level, k), digits+1);
+  }
+  float_free(&tmp);
+  float_free(&lnf);
+}
+
+/* exp(x) for 0 <= x < ln 10, inverting the logarithm by Newton's
+   method: if y approx.== exp x to half of the digits, the step
+   y*(1 + x - ln y) yields all of them. y comes from _expltln10, that
+   halves the length again, if it is still long enough. So the costs
+   are about those of the final ln, which is fast for long results
+   (see _lnagm) */
+static void
+_expnewton(
+  floatnum x,
+  int digits)
+{
+  floatstruct y, tmp;
+  int halfdigits;
+
+  float_create(&y);
+  float_create(&tmp);
+  halfdigits = digits/2 + 3;
+  float_copy(&y, x, halfdigits);
+  _expltln10(&y, halfdigits);
+  float_copy(&tmp, &y, EXACT);
+  _ln(&tmp, digits+2);
+  float_sub(&tmp, x, &tmp, digits+2);
+  float_mul(&tmp, &tmp, &y, halfdigits);
+  float_add(x, &y, &tmp, digits+1);
+  float_free(&y);
+  float_free(&tmp);
+}
+
+/* exp(x) for 0 <= x < ln 10. The logarithm of a small integer is
+   subtracted first, _expreduce does the rest.
    relative error < 5e-100 */
 void
 _expltln10(
   floatnum x,
   int digits)
 {
+  floatstruct f;
   int expx;
   int factor;
   char sgnf;
 
+  /* halving the length must make progress */
+  if (digits >= exp_newton_digits && digits > 6)
+  {
+    _expnewton(x, digits);
+    return;
+  }
   expx = float_getexponent(x);
   factor = 1;
   if (expx >= -1)
@@ -170,10 +270,14 @@ _expltln10(
       }
     }
   }
-  _expminus1lt1(x, digits);
-  float_add(x, x, &c1, digits+1);
+  float_create(&f);
+  _expreduce(x, &f, digits);
+  expminus1series(x, digits);
+  float_mul(x, x, &f, digits+1);
+  float_add(x, x, &f, digits+1);
   if (factor != 1)
     float_muli(x, x, factor, digits+1);
+  float_free(&f);
 }
 
 /* exp(x) for all x. Underflow or overflow is
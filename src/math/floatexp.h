@@ -38,6 +38,10 @@
 extern "C" {
 #endif
 
+/* from this many digits on, exp inverts the logarithm by Newton's
+   method */
+extern int exp_newton_digits;
+
 char _coshminus1lt1(floatnum x, int digits);
 void _sinhlt1(floatnum x, int digits);
 void _expminus1lt1(floatnum x, int digits);
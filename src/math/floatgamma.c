@@ -40,8 +40,11 @@
    for x >= 77 and a 100 digit computation, the
    relative error is < 9e-100.
    the series converges, if x and digits comply to
-     100 >= digits >= 2
+     digits >= 2
      x >= sqrt((digits*ln 10 + 0.5*ln 2)/1.0033).
+   Beyond the exact part of the table cBernoulliNum, the
+   Bernoulli numbers come from floatmath_bernoulli, unless the
+   rounded entries are good enough.
    As a special case, for digits == 1, convergence is guaranteed,
    if x >= 1.8. */
 
@@ -53,6 +56,7 @@ binetasymptotic(floatnum x,
   floatstruct sum;
   floatstruct smd;
   floatstruct pwr;
+  floatnum bernoulli;
   int i, workprec;
 
   if (float_getexponent(x) >= digits)
@@ -79,20 +83,35 @@ binetasymptotic(floatnum x,
     float_mul(&recsqr, x, x, workprec);
     float_reciprocal(&recsqr, workprec);
     while (float_getexponent(&smd) > -digits-1
-           && ++i <= MAXBERNOULLIIDX)
+           && ++i <= MAXBERNOULLIN)
     {
       workprec = digits + float_getexponent(&smd) + 3;
       float_add(&sum, &sum, &smd, digits+1);
       float_mul(&pwr, &recsqr, &pwr, workprec);
-      float_muli(&smd, &cBernoulliDen[i-1], 2*i*(2*i-1), workprec);
-      float_div(&smd, &pwr, &smd, workprec);
-      float_mul(&smd, &smd, &cBernoulliNum[i-1], workprec);
+      if (i <= EXACTBERNOULLIIDX
+          || (i <= MAXBERNOULLIIDX && digits <= MATHPRECISION))
+      {
+        float_muli(&smd, &cBernoulliDen[i-1], 2*i*(2*i-1), workprec);
+        float_div(&smd, &pwr, &smd, workprec);
+        float_mul(&smd, &smd, &cBernoulliNum[i-1], workprec);
+      }
+      else
+      {
+        bernoulli = floatmath_bernoulli(i);
+        if (!bernoulli)
+        {
+          i = MAXBERNOULLIN + 1;
+          break;
+        }
+        float_divi(&smd, &pwr, 2*i*(2*i-1), workprec);
+        float_mul(&smd, &smd, bernoulli, workprec);
+      }
     }
   }
   else
     /* sum reduces to the first summand*/
     float_move(&sum, &smd);
-  if (i > MAXBERNOULLIIDX)
+  if (i > MAXBERNOULLIN)
       /* x was not big enough for the asymptotic
     series to converge sufficiently */
     float_setnan(x);
@@ -102,7 +121,7 @@ binetasymptotic(floatnum x,
   float_free(&smd);
   float_free(&sum);
   float_free(&recsqr);
-  return i <= MAXBERNOULLIIDX;
+  return i <= MAXBERNOULLIN;
 }
 
 /* returns the number of summands needed in the asymptotic
@@ -447,6 +466,7 @@ _pochhammer_i(
   /* do not use the expensive Gamma function when a few
      multiplications do the same */
   /* pre: n is an integer */
+  floatstruct negn;
   int ni;
   signed char result;
 
@@ -455,16 +475,18 @@ _pochhammer_i(
   if (float_isinteger(x))
   {
     result = -1;
-    float_neg((floatnum)n);
-    if (float_getsign(x) <= 0 && float_cmp(x, n) > 0)
+    float_create(&negn);
+    float_copy(&negn, n, EXACT);
+    float_neg(&negn);
+    if (float_getsign(x) <= 0 && float_cmp(x, &negn) > 0)
       /* x and x+n have opposite signs, meaning 0 is
          among the factors */
       result = _setzero(x);
-    else if (float_getsign(x) > 0 && float_cmp(x, n) <= 0)
+    else if (float_getsign(x) > 0 && float_cmp(x, &negn) <= 0)
       /* x and x+n have opposite signs, meaning at one point
       you have to divide by 0 */
       result = _seterror(x, ZeroDivide);
-    float_neg((floatnum)n);
+    float_free(&negn);
     if (result >= 0)
       return result;
   }
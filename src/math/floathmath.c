@@ -451,7 +451,7 @@ float_raise(
 
   if (float_isnan(exponent) || float_isnan(base))
     return _seterror(power, NoOperand);
-  if (digits <= 0 || digits > MATHPRECISION)
+  if (digits <= 0 || digits > mathprecision)
     return _seterror(power, InvalidPrecision);
   if (float_iszero(base))
   {
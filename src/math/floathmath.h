@@ -38,6 +38,9 @@
 extern "C" {
 #endif
 
+/* MATHPRECISION in the error descriptions below stands for the limit
+   currently in effect, see floatmath_setprecision. */
+
 /* evaluates ln(1+x) for x > -1. This function is especially useful
    for small x, where its computation is more precise than that of
    float_ln.
@@ -32,6 +32,18 @@
 #include "floatconst.h"
 #include "floatcommon.h"
 #include "floatseries.h"
+#include <math.h>
+
+/* From this many digits on, _ln and _lnxplus1 evaluate the logarithm
+   by the arithmetic-geometric mean, see _lnagm. Against the table
+   driven series, the AGM was still 6 times slower at 5000 digits and
+   4.5 times at 40000, so the default waits for builds with a far
+   larger MAXDECPRECISION (or a faster square root) */
+#ifndef LN_AGM_DIGITS
+#define LN_AGM_DIGITS 200000
+#endif
+
+int ln_agm_digits = LN_AGM_DIGITS;
 
 typedef struct
 {
@@ -144,15 +156,40 @@ _lnguess(
   _addcoef(dest, _lincombtbl[idx].c5-_lincombtbl[idx].c10, &cLn10, digits);
 }
 
-/* reduces x using a special factor whose prime factors
-   are 2, 3, 5 and 7 only. x is multiplied by this
-   factor, yielding a value near a power of ten.
-   Then x is divided by this power of ten.
-   The logarithm of this factor is returned in
-   lnguess. Valid for -0.4 <= x < 1. Relative error < 5e-100 for
-   100 digit result.
-   This algorithm reduces x to a value < 0.01, which
-   is appropriately small for submitting to a series evaluation */
+/* determines a special factor f whose prime factors are 2, 3, 5
+   and 7 only, divided by a power of ten, so that (1+x)*f is near 1.
+   f is returned exactly, its logarithm to <digits> places in lnf.
+   Valid for -0.4 <= x < 1, the product deviates from 1 by less
+   than 0.01 then */
+void
+_lnfactor(
+  cfloatnum x,
+  floatnum f,
+  floatnum lnf,
+  int digits)
+{
+  int idx;
+  signed char pos;
+
+  idx = leadingdigits(x, 3 + float_getexponent(x)) + 39;
+  if (idx < 0)
+    idx = 0;
+  pos = idx >= 40? 1 : 0;
+  idx += pos;
+  float_setinteger(f, _factor(idx));
+  float_setexponent(f, -pos);
+  float_setzero(lnf);
+  _lnguess(lnf, digits, idx);
+}
+
+/* reduces x using a special factor (see _lnfactor), that yields
+   a value < 0.01. The reduction continues with the short factors
+   1 + k*10^-j of the table TBLLN, one decimal place at a time, so
+   that the series evaluation following needs a few summands only.
+   x is multiplied by all these factors, the logarithm of their
+   product is returned in lnguess.
+   Valid for -0.4 <= x < 1. Relative error < 5e-100 for
+   100 digit result */
 void
 _lnreduce(
   floatnum x,
@@ -160,32 +197,89 @@ _lnreduce(
   int digits)
 {
   floatstruct tmp1, tmp2;
-  int idx;
-  int expx;
-  signed char pos;
+  double xf, scale;
+  int level, levels, k;
 
   float_setzero(lnguess);
-  expx = float_getexponent(x);
-  if (expx < -2)
-    return;
   float_create(&tmp1);
   float_create(&tmp2);
-
-  idx = leadingdigits(x, 3 + expx) + 39;
-  if (idx < 0)
-    idx = 0;
-  pos = idx >= 40? 1 : 0;
-  idx += pos;
-  float_setinteger(&tmp1, _factor(idx));
-  float_setexponent(&tmp1, -pos);
-  float_sub(&tmp1, &tmp1, &c1, EXACT);
-  float_mul(&tmp2, x, &tmp1, digits);
-  float_add(&tmp1, &tmp1, &tmp2, digits+1);
-  float_add(x, x, &tmp1, digits);
-  _lnguess(lnguess, digits+4, idx);
+  if (float_getexponent(x) >= -2)
+  {
+    _lnfactor(x, &tmp1, lnguess, digits+4);
+    float_sub(&tmp1, &tmp1, &c1, EXACT);
+    float_mul(&tmp2, x, &tmp1, digits);
+    float_add(&tmp1, &tmp1, &tmp2, digits+1);
+    float_add(x, x, &tmp1, digits);
+  }
+  levels = floatmath_tbllevels(digits);
+  scale = 100;
+  for (level = 2; ++level <= levels && !float_iszero(x);)
+  {
+    /* (1+x)*(1+k*10^-level) approx.== 1 */
+    scale *= 10;
+    xf = float_asfloat(x);
+    k = (int)floor(-xf / (1 + xf) * scale + 0.5);
+    if (k == 0)
+      continue;
+    if (k > TBLMAXK || k < -TBLMAXK)
+      k = k > 0? TBLMAXK : -TBLMAXK;
+    float_muli(&tmp1, x, k, digits);
+    float_setinteger(&tmp2, k);
+    float_add(&tmp1, &tmp1, &tmp2, digits+1);
+    float_addexp(&tmp1, -level);
+    float_add(x, x, &tmp1, digits);
+    float_add(lnguess, lnguess, floatmath_tbl(TBLLN, level, k), digits+4);
+  }
   float_free(&tmp1);
   float_free(&tmp2);
-  return;
+}
+
+/* evaluates ln x for x > 0 by the arithmetic-geometric mean:
+   if s >= 10^(d/2), ln s and pi/(2*AGM(1, 4/s)) agree in d digits.
+   s = x*10^m is found by shifting the exponent of x, so
+   ln x = pi/(2*AGM(1, 4/s)) - m*ln 10. The AGM converges
+   quadratically, but each step takes a square root. Costs grow with
+   the multiplication only, while the series need more summands with
+   each digit, so this pays off for very long results. The
+   subtraction of m*ln 10 cancels about log10(ln s) + |log10 ln x|
+   digits, the caller adds them to <digits> */
+static void
+_lnagm(
+  floatnum x,
+  int digits)
+{
+  floatstruct a, b, tmp;
+  int m;
+
+  float_create(&a);
+  float_create(&b);
+  float_create(&tmp);
+  m = digits/2 + 2 - float_getexponent(x);
+  float_setinteger(&b, 4);
+  float_div(&b, &b, x, digits);
+  float_addexp(&b, -m);
+  float_copy(&a, &c1, EXACT);
+  /* once a and b agree in half of the digits, the next arithmetic
+     mean is exact to all of them */
+  for (;;)
+  {
+    float_sub(&tmp, &a, &b, digits);
+    if (float_iszero(&tmp)
+        || 2*(float_getexponent(&tmp) - float_getexponent(&a)) < -digits)
+      break;
+    float_mul(&tmp, &a, &b, digits+1);
+    float_add(&a, &a, &b, digits+1);
+    float_mul(&a, &a, &c1Div2, digits+1);
+    float_sqrt(&tmp, digits+1);
+    float_move(&b, &tmp);
+  }
+  float_add(&a, &a, &b, digits+1);
+  float_div(x, &cPi, &a, digits+1);
+  float_muli(&tmp, &cLn10, m, digits+1);
+  float_sub(x, x, &tmp, digits);
+  float_free(&a);
+  float_free(&b);
+  float_free(&tmp);
 }
 
 /* for -0.4 <= x < 1.0 */
@@ -203,6 +297,25 @@ _lnxplus1lt1(
   float_free(&lnfactor);
 }
 
+/* for -0.4 <= x < 1.0, like _lnxplus1lt1, but long results, that do
+   not suffer too much from cancellation, are left to _lnagm */
+static void
+_lnxplus1reduced(
+  floatnum x,
+  int digits)
+{
+  int expx;
+
+  expx = float_getexponent(x);
+  if (digits < ln_agm_digits || expx < -2)
+    _lnxplus1lt1(x, digits);
+  else
+  {
+    float_add(x, x, &c1, EXACT);
+    _lnagm(x, digits + 5 - expx + (int)log10(digits));
+  }
+}
+
 /* the general purpose routine evaluating ln(x) for all
    positive arguments. It uses multiplication and division to
    reduce the argument to a value near 1. The factors are
@@ -217,7 +330,7 @@ _lnxplus1lt1(
    require taking square roots several times. A test showed,
    a hundred digits calculation using AGM is 8 times slower than
    the algorithm here. For extreme precision, of course, AGM will be
-   superior.
+   superior, see ln_agm_digits.
    The relative error seems to be less than 7e-101 for 100-digits
    computations */
 void
@@ -248,7 +361,7 @@ _ln(
       float_mul(x, x, &c3, digits+1);
   }
   float_sub(x, x, &c1, digits+1);
-  _lnxplus1lt1(x, digits);
+  _lnxplus1reduced(x, digits);
   if (coef10 != 0)
   {
     float_muli(&tmp, &cLn10, coef10, digits+1);
@@ -265,7 +378,7 @@ _lnxplus1(
   int digits)
 {
   if (float_cmp(x, &cMinus0_4) >= 0 && float_cmp(x, &c1) < 0)
-    _lnxplus1lt1(x, digits);
+    _lnxplus1reduced(x, digits);
   else
   {
     float_add(x, x, &c1, digits+1);
@@ -38,7 +38,11 @@
 extern "C" {
 #endif
 
+/* from this many digits on, the logarithm uses the AGM */
+extern int ln_agm_digits;
+
 void _lnxplus1near0(floatnum x, int digits);
+void _lnfactor(cfloatnum x, floatnum f, floatnum lnf, int digits);
 void _lnreduce(floatnum x, floatnum lnguess, int digits);
 void _lnxplus1lt1(floatnum x, int digits);
 void _ln(floatnum x, int digits);
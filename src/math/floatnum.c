@@ -43,11 +43,11 @@
 
 #define NOSPECIALVALUE 1
 
-int maxdigits = MAXDIGITS;
+FLOAT_THREAD_LOCAL int maxdigits = MAXDIGITS;
 
-Error float_error;
-int expmax = EXPMAX;
-int expmin = EXPMIN;
+static FLOAT_THREAD_LOCAL Error float_error = Success;
+static FLOAT_THREAD_LOCAL int expmax = EXPMAX;
+static FLOAT_THREAD_LOCAL int expmin = EXPMIN;
 
 /*  general helper routines  */
 
@@ -171,7 +171,8 @@ _is_special(
    <dest> may then be modified freely in the course
    of an operation, without effecting source,
    *except* that the digits in *(dest->significand->n_value)
-   have to be retained (or restored).
+   are shared with <source> and must not be written to
+   (see _owndigits).
    <dest> must *never* be the destination of a
    float_xxx operation, in particiular, it must not be
    freed. Neither must b be modified (or freed) in a bc_num
@@ -195,17 +196,38 @@ _copyfn(
    it is a waste of computation time to pass operands
    with a longer scale, because bc lets the operand's
    scale override your limit. This function hides superfluous
-   digits from bc, returning the original scale for restoring
-   purposes */
-static int
+   digits from bc.
+   Apply it to a working copy (see _copyfn) only, never to an operand
+   owned by the caller: constants are shared between threads */
+static void
 _limit_scale(
   floatnum f,
   int newscale)
 {
-  int oldscale;
-  oldscale = _scaleof(f);
-  _setscale(f, _min(oldscale, newscale));
-  return oldscale;
+  _setscale(f, _min(_scaleof(f), newscale));
+}
+
+/* replaces the significand of the working copy <f> (see _copyfn)
+   by a private one, so that its leading digits may be changed.
+   Not more than <digits> digits after the first one are copied,
+   except when <digits> is EXACT. The private significand is
+   returned and has to be freed by the caller */
+static bc_num
+_owndigits(
+  floatnum f,
+  int digits)
+{
+  bc_num mant;
+  int scale;
+
+  scale = _scaleof(f);
+  if (digits != EXACT && digits < scale)
+    scale = digits;
+  mant = bc_new_num(1, scale);
+  memcpy(mant->n_value, _valueof(f), scale+1);
+  mant->n_sign = f->significand->n_sign;
+  f->significand = mant;
+  return mant;
 }
 
 /*============================   floatnum routines  ===================*/
@@ -241,7 +263,7 @@ float_setprecision(
   int result;
 
   result = maxdigits;
-  maxdigits = _max(_min(digits, MAXDIGITS), 1);
+  maxdigits = _max(_min(digits, MAXDIGITSLIMIT), 1);
   return result;
 }
 
@@ -274,6 +296,25 @@ float_seterror(
     float_error = code;
 }
 
+void
+float_getcontext(
+  floatcontext* ctx)
+{
+  ctx->error = float_error;
+  ctx->maxdigits = maxdigits;
+  ctx->expmax = expmax;
+}
+
+void
+float_setcontext(
+  const floatcontext* ctx)
+{
+  float_error = ctx->error;
+  maxdigits = ctx->maxdigits;
+  expmax = ctx->expmax;
+  expmin = -expmax - 1;
+}
+
 void
 floatnum_init()
 {
@@ -991,7 +1032,10 @@ _scaled_clone(
     scale = _scaleof(source);
   if (dest == source && scale <= _scaleof(source))
   {
-    _setscale(dest, scale);
+    /* the significand may be a shared constant like _one_,
+       do not write to it unless something changes */
+    if (scale < _scaleof(source))
+      _setscale(dest, scale);
     return;
   }
   mant = bc_new_num(1, scale);
@@ -1014,7 +1058,7 @@ float_copy(
   cfloatnum source,
   int digits)
 {
-  int scale, save;
+  int scale;
 
   if (digits == EXACT)
     digits = _max(1, float_getlength(source));
@@ -1028,13 +1072,11 @@ float_copy(
   }
   else
   {
-    // invariant: source has to be restored, if it is != dest
+    /* drop trailing zeros of the copied part, source itself
+       is left untouched */
     scale = _min(digits - 1, _scaleof(source));
-    save = _limit_scale((floatnum)source, scale);
-    _corr_trailing_zeros((floatnum)source);
-    _scaled_clone(dest, source, EXACT);
-    if (dest != source)
-      _setscale(source, save);
+    scale -= _bscandigit(source, scale, 0);
+    _scaled_clone(dest, source, scale);
   }
   return TRUE;
 }
@@ -1267,9 +1309,7 @@ _sub_checkborrow(
   int result;
   int borrow;
   int scale1, scale2;
-  char save;
-  char* v1;
-  char* v2;
+  bc_num own1, own2;
 
 /* Cancellation occurs, when the operands are of type
    p.000...yyy - q.999...xxx, p-q == 1, because a borrow
@@ -1277,6 +1317,8 @@ _sub_checkborrow(
    leaving zeros in the first part. We check for this here. */
 
   borrow = 0;
+  own1 = NULL;
+  own2 = NULL;
   if (_digit(summand1, 0) - _digit(summand2, 0) == 1)
   {
     scale1 = _scaleof(summand1);
@@ -1318,22 +1360,20 @@ _sub_checkborrow(
       _hidefirst(summand2, borrow);
 
       /* we replace the last found 0 - 9 pair by a 9 - 8 pair,
-         avoiding a carry, yet yielding the correct result */
-      save = *(v1 = _valueof(summand1));
-      *v1 = 9;
-      *(v2 = _valueof(summand2)) = 8;
+         avoiding a carry, yet yielding the correct result.
+         The digits of the operands are shared, so we change
+         a private copy */
+      if (summand1 != dest)
+        own1 = _owndigits(summand1, digits);
+      if (summand2 != dest)
+        own2 = _owndigits(summand2, digits);
+      *_valueof(summand1) = 9;
+      *_valueof(summand2) = 8;
     }
   }
   result = _addsub_normal(dest, summand1, summand2, digits);
-
-  /* restore the modified digits */
-  if (borrow > 0)
-  {
-    if (summand1 != dest)
-      *v1 = save;
-    if (summand2 != dest)
-      *v2 = 9;
-  }
+  bc_free_num(&own1);
+  bc_free_num(&own2);
   return result;
 }
 
@@ -1404,8 +1444,7 @@ _sub_expdiff1(
 
   int result;
   char singledigit;
-  char* v1;
-  char* v2;
+  bc_num own1, own2;
 
   /* the operands have different sign, are ordered by their
      exponent, and the difference of the exponents is 1 */
@@ -1430,19 +1469,20 @@ _sub_expdiff1(
     _hidefirst(summand1, 1);
   /* we change the leading digits into a '9' and a '8' resp.
      So we finally subtract .8xxx from .9yyy, yielding
-     the correct result. */
-  v1 = _valueof(summand1);
-  v2 = _valueof(summand2);
-  *v1 = 9;
-  *v2 = 8;
-  summand1->exponent--;
-  result = _sub_checkborrow(dest, summand1, summand2, digits);
-
-  /* restore the original digits */
+     the correct result. The digits of the operands are
+     shared, so we change a private copy. */
+  own1 = NULL;
+  own2 = NULL;
   if (summand1 != dest)
-    *v1 = singledigit? 1 : 0;
+    own1 = _owndigits(summand1, digits);
   if (summand2 != dest)
-    *v2 = 9;
+    own2 = _owndigits(summand2, digits);
+  *_valueof(summand1) = 9;
+  *_valueof(summand2) = 8;
+  summand1->exponent--;
+  result = _sub_checkborrow(dest, summand1, summand2, digits);
+  bc_free_num(&own1);
+  bc_free_num(&own2);
   return result;
 }
 
@@ -1549,21 +1589,28 @@ float_sub(
   cfloatnum subtrahend,
   int scale)
 {
-  int result;
+  bc_struct bc;
+  floatstruct tmp;
+
   if (minuend == subtrahend)
   {
     /* changing the sign of one operand would change that of
        the other as well. So this is a special case */
     if(!_checknan(minuend))
       return FALSE;
-    _setzero(dest);
+    return _setzero(dest);
   }
-  /* do not use float_neg, because it may change float_error */
-  float_setsign((floatnum)subtrahend, -float_getsign(subtrahend));
-  result = float_add(dest, minuend, subtrahend, scale);
-  if (dest != subtrahend)
-    float_setsign((floatnum)subtrahend, -float_getsign(subtrahend));
-  return result;
+  /* do not use float_neg, because it may change float_error.
+     The sign is changed in a working copy, subtrahend is
+     read-only */
+  if (dest == subtrahend)
+  {
+    float_setsign(dest, -float_getsign(dest));
+    return float_add(dest, minuend, dest, scale);
+  }
+  _copyfn(&tmp, subtrahend, &bc);
+  float_setsign(&tmp, -float_getsign(&tmp));
+  return float_add(dest, minuend, &tmp, scale);
 }
 
 char
@@ -1573,9 +1620,10 @@ float_mul(
   cfloatnum factor2,
   int digits)
 {
+  bc_struct bc1, bc2;
+  floatstruct tmp1, tmp2;
   int result;
   int fullscale;
-  int savescale1, savescale2;
   int scale;
 
   /* handle a bunch of special cases */
@@ -1596,20 +1644,20 @@ float_mul(
     /* scale too large */
     return _seterror(dest, InvalidPrecision);
 
-  /* limit the scale of the operands to sane sizes */
-  savescale1 = _limit_scale((floatnum)factor1, scale);
-  savescale2 = _limit_scale((floatnum)factor2, scale);
+  /* limit the scale of the operands to sane sizes. This is
+     done on working copies, the operands are read-only */
+  _copyfn(&tmp1, factor1, &bc1);
+  _copyfn(&tmp2, factor2, &bc2);
+  _limit_scale(&tmp1, scale);
+  _limit_scale(&tmp2, scale);
 
   /* multiply */
   dest->exponent = factor1->exponent + factor2->exponent;
-  bc_multiply(factor1->significand, factor2->significand, &(dest->significand), scale);
+  if (factor1->significand == factor2->significand)
+    bc_square(tmp1.significand, &(dest->significand), scale);
+  else
+    bc_multiply(tmp1.significand, tmp2.significand, &(dest->significand), scale);
   result = _normalize(dest);
-
-  /* reverse order is necessary in case factor1 == factor2 */
-  if (dest != factor2)
-    _setscale(factor2, savescale2);
-  if (dest != factor1)
-    _setscale(factor1, savescale1);
   return result;
 }
 
@@ -1620,8 +1668,9 @@ float_div(
   cfloatnum divisor,
   int digits)
 {
+  bc_struct bc1, bc2;
+  floatstruct tmp1, tmp2;
   int result;
-  int savescale1, savescale2;
   int exp;
 
   /* handle a bunch of special cases */
@@ -1648,27 +1697,24 @@ float_div(
   if(digits > maxdigits)
     return _seterror(dest, InvalidPrecision);
 
-  /* limit the scale of the operands to sane sizes */
-  savescale1 = _limit_scale((floatnum)dividend, digits);
-  savescale2 = _limit_scale((floatnum)divisor, digits);
+  /* limit the scale of the operands to sane sizes. This is
+     done on working copies, the operands are read-only */
+  _copyfn(&tmp1, dividend, &bc1);
+  _copyfn(&tmp2, divisor, &bc2);
+  _limit_scale(&tmp1, digits);
+  _limit_scale(&tmp2, digits);
 
   /* divide */
   result = TRUE;
   dest->exponent = exp;
-  bc_divide(dividend->significand,
-            divisor->significand,
+  bc_divide(tmp1.significand,
+            tmp2.significand,
             &(dest->significand),
             digits);
   if (bc_is_zero(dest->significand))
     float_setzero(dest);
   else
     result = _normalize(dest);
-
-  /* reverse order is necessary in case divisor == dividend */
-  if (dest != divisor)
-    _setscale(divisor, savescale2);
-  if (dest != dividend)
-    _setscale(dividend, savescale1);
   return result;
 }
 
@@ -1769,3 +1815,31 @@ float_sqrt(floatnum value, int digits)
     value->exponent = -((1-value->exponent) >> 1);
   return TRUE;
 }
+
+char
+float_rsqrt(floatnum value, int digits)
+{
+  if (!_checkdigits(digits, NOSPECIALVALUE) || !_checknan(value))
+    return _setnan(value);
+  switch (float_getsign(value))
+  {
+    case -1:
+      return _seterror(value, OutOfDomain);
+    case 0:
+      return _seterror(value, ZeroDivide);
+  }
+  if ((value->exponent & 1) != 0)
+  {
+    if (float_getlength(value) == 1)
+      _scaled_clone(value, value, 1);
+    _movepoint(value, 1);
+  }
+  /* the significand is in [1, 100) now, its reciprocal square root
+     in (0.1, 1] */
+  bc_rsqrt(&value->significand, digits);
+  if (value->exponent >= 0)
+    value->exponent = -(value->exponent >> 1);
+  else
+    value->exponent = (1-value->exponent) >> 1;
+  return _normalize(value);
+}
@@ -47,7 +47,7 @@
 extern "C" {
 #endif
 
-extern int maxdigits;
+extern FLOAT_THREAD_LOCAL int maxdigits;
 
 typedef struct {
   bc_num significand;
@@ -62,10 +62,27 @@ typedef const floatstruct* cfloatnum;
 
 typedef enum {TONEAREST, TOZERO, TOINFINITY, TOPLUSINFINITY, TOMINUSINFINITY} roundmode;
 
+/* the state the following functions work with: the pending error
+   and the precision and range limits. Each thread has its own
+   context, initially without error, with MAXDIGITS precision and
+   the largest range */
+typedef struct {
+  Error error;
+  int maxdigits;
+  int expmax;
+} floatcontext;
+
 /* initializes this module. Has to be called prior to the first
    use of any of the following functions */
 void floatnum_init();
 
+/* copies the context of the calling thread to `ctx' */
+void float_getcontext(floatcontext* ctx);
+
+/* makes `ctx' the context of the calling thread. The values
+   are taken as is, they are not checked */
+void float_setcontext(const floatcontext* ctx);
+
 /* sets the error to `code' unless it is already set */
 void float_seterror(Error code);
 
@@ -94,7 +111,8 @@ int float_setrange(int maxexp);
 int float_getprecision();
 
 /* sets the current maximum precision (in decimal digits) that is used by basic
-   arithmetic operations. The precision is at least 1 and at most MAXDIGITS.
+   arithmetic operations. The precision is at least 1 and at most
+   MAXDIGITSLIMIT, the initial value is MAXDIGITS.
    An exceeding argument is replaced by the respective limit.
    Setting a new precision affects future operations only; currently set
    variables are kept unmodified.
@@ -437,6 +455,20 @@ char float_divmod(floatnum quotient, floatnum remainder, cfloatnum dividend,
            OutOfDomain */
 char float_sqrt(floatnum value, int digits);
 
+/* computes the reciprocal of the square root of `value' to `digits'
+   digits, truncated.
+   `digits' == EXACT is not allowed.
+   NaN is returned, if
+   - the operand is NaN,
+   - `digits' exceeds `maxdigits'
+   - the operand is zero or negative.
+   A return value 0 indicates an error.
+   errors: NaNOperand
+           InvalidPrecision
+           OutOfDomain
+           ZeroDivide */
+char float_rsqrt(floatnum value, int digits);
+
 /* a few convenience functions used everywhere */
 
 char _setnan(floatnum result);
@@ -32,6 +32,7 @@
 #include "floatpower.h"
 #include "floatipower.h"
 #include "floatcommon.h"
+#include "floatconst.h"
 #include "floatlog.h"
 #include "floatexp.h"
 
@@ -53,8 +54,8 @@ _raise(
     if (float_iszero(exponent) || iexp !=  0)
       return _raisei(x, iexp, digits+extra);
   }
-  if (digits + extra > MATHPRECISION)
-    extra = MATHPRECISION - digits;
+  if (digits + extra > mathprecision)
+    extra = mathprecision - digits;
   _ln(x, digits+extra);
   if (!float_mul(x, x, exponent, digits+extra))
     return 0;
@@ -32,12 +32,153 @@
 #include "floatconst.h"
 #include "floatcommon.h"
 #include "floatexp.h"
+#include <limits.h>
 
 /* Though all these serieses can be used with arguments |x| < 1 or
    even more, the computation time increases rapidly with x.
    Tests show, that for 100 digit results, it is best to limit x
    to |x| < 0.01..0.02, and use reduction formulas for greater x */
 
+/* the powers of the argument kept by _pssum */
+#define MAXPSPOWERS 64
+
+/* the divisor b(k) that defines the k-th coefficient of a series */
+typedef int (*t_psdivisor)(int k);
+
+/* divides x by b(k1)*...*b(k2-1), using as few divisions as possible */
+static void
+_psdivide(
+  floatnum x,
+  t_psdivisor b,
+  int k1,
+  int k2,
+  int digits)
+{
+  int d, bk;
+
+  while (k1 < k2)
+  {
+    d = b(k1++);
+    while (k1 < k2 && d <= INT_MAX / (bk = b(k1)))
+    {
+      d *= bk;
+      ++k1;
+    }
+    float_divi(x, x, d, digits);
+  }
+}
+
+/* sums up c1*y + c2*y^2 + c3*y^3 + ... to <digits> places relative
+   to the first summand. The coefficients are ck = 1/b(k), or, if
+   <product> is set, ck = 1/(b(1)*...*b(k)).
+   The series is split into blocks of m terms, m approx. the square
+   root of the number of terms. Only the powers y^2..y^m and the
+   Horner scheme over the blocks, which steps by y^m, need full
+   multiplications, the coefficients are applied by dividing by small
+   integers, which takes linear time only (Paterson-Stockmeyer).
+   The working precision of a block is reduced according to the
+   magnitude of its powers of y. |y| < 1 is required */
+static void
+_pssum(
+  floatnum sum,
+  cfloatnum y,
+  t_psdivisor b,
+  char product,
+  int digits)
+{
+  floatstruct pwr[MAXPSPOWERS];
+  floatstruct blk;
+  float lgy;
+  int terms, m, blocks, j, i, k0, prec;
+
+  float_setzero(sum);
+  lgy = aprxlog10fn(y);
+  if (lgy >= 0 || float_iszero(y))
+    return;
+  terms = (int)((digits + 2) / -lgy) + 1;
+  m = (int)aprxsqrt(terms) + 1;
+  if (m > MAXPSPOWERS)
+    m = MAXPSPOWERS;
+  blocks = (terms + m - 1) / m;
+
+  /* pwr[i] = y^(i+1) */
+  float_create(&pwr[0]);
+  float_copy(&pwr[0], y, digits + 2);
+  for (i = 0; ++i < m;)
+  {
+    float_create(&pwr[i]);
+    float_mul(&pwr[i], &pwr[i-1], y, digits + 2);
+  }
+  float_create(&blk);
+  for (j = blocks; --j >= 0;)
+  {
+    /* the block covers the terms k0+1..k0+m */
+    k0 = j * m;
+    prec = digits + 2 + (int)(k0 * lgy);
+    if (prec <= 0)
+      continue;
+    if (!float_iszero(sum))
+    {
+      if (product)
+        _psdivide(sum, b, k0 + 1, k0 + m + 1, prec);
+      float_mul(sum, sum, &pwr[m-1], prec);
+    }
+    if (product)
+    {
+      /* Horner scheme, backwards from y^m */
+      float_copy(&blk, &pwr[m-1], prec);
+      for (i = m - 1; --i >= 0;)
+      {
+        float_divi(&blk, &blk, b(k0 + i + 2), prec);
+        float_add(&blk, &blk, &pwr[i], prec);
+      }
+      float_divi(&blk, &blk, b(k0 + 1), prec);
+      float_add(sum, sum, &blk, prec);
+    }
+    else
+      for (i = -1; ++i < m;)
+      {
+        float_divi(&blk, &pwr[i], b(k0 + i + 1), prec);
+        float_add(sum, sum, &blk, prec);
+      }
+  }
+  float_free(&blk);
+  for (i = -1; ++i < m;)
+    float_free(&pwr[i]);
+}
+
+/* arctan x/x - 1 = -x^2/3 + x^4/5 - ... */
+static int
+_arctandivisor(
+  int k)
+{
+  return 2*k + 1;
+}
+
+/* (cos x - 1)/y - 1 = y/(2*3) + y^2/(2*3*3*5) + ... with y = -x^2/2 */
+static int
+_cosdivisor(
+  int k)
+{
+  return (k + 1) * (2*k + 1);
+}
+
+/* sin x/x - 1 = y/(2*3) + y^2/(2*3*4*5) + ... with y = -x^2 */
+static int
+_sindivisor(
+  int k)
+{
+  return 2*k * (2*k + 1);
+}
+
+/* (exp x - 1)/x - 1 = x/2 + x^2/(2*3) + ... */
+static int
+_expdivisor(
+  int k)
+{
+  return k + 1;
+}
+
 /* the Taylor series of arctan/arctanh x at x == 0. For small
    |x| < 0.01 this series converges very fast, yielding 4 or
    more digits of the result with every summand. The working
@@ -51,13 +192,7 @@ arctanseries(
   char alternating)
 {
   int expx;
-  int expsqrx;
-  int pwrsz;
-  int addsz;
-  int i;
   floatstruct xsqr;
-  floatstruct pwr;
-  floatstruct smd;
   floatstruct sum;
 
   /* upper limit of log(x) and log(result) */
@@ -79,43 +214,16 @@ arctanseries(
     /* for very tiny arguments arctan/arctanh x is approx.== x */
     return;
   float_create(&xsqr);
-  float_create(&pwr);
-  float_create(&smd);
   float_create(&sum);
 
-  /* we adapt the working precision to the decreasing
-     summands, saving time when multiplying. Unfortunately,
-     there is no error bound given for the operations of
-     bc_num. Tests show, that the last digit in an incomplete
-     multiplication is usually not correct up to 5 ULP's. */
-  pwrsz = digits + 2*expx + 1;
-  /* the precision of the addition must not decrease, of course */
-  addsz = pwrsz;
-  i = 3;
-  float_mul(&xsqr, x, x, pwrsz);
+  float_mul(&xsqr, x, x, digits + 2);
   float_setsign(&xsqr, alternating? -1 : 1);
-  expsqrx = float_getexponent(&xsqr);
-  float_copy(&pwr, x, pwrsz);
-  float_setzero(&sum);
-
-  for(; pwrsz > 0; )
-  {
-    /* x^i */
-    float_mul(&pwr, &pwr, &xsqr, pwrsz+1);
-    /* x^i/i */
-    float_divi(&smd, &pwr, i, pwrsz);
-    /* The addition virtually does not introduce errors */
-    float_add(&sum, &sum, &smd, addsz);
-    /* reduce the working precision according to the decreasing powers */
-    pwrsz = digits - expx + float_getexponent(&smd) + expsqrx + 3;
-    i += 2;
-  }
+  _pssum(&sum, &xsqr, _arctandivisor, 0, digits + 1);
+  float_mul(&sum, &sum, x, digits + 2);
   /* add the first summand */
   float_add(x, x, &sum, digits+1);
 
   float_free(&xsqr);
-  float_free(&pwr);
-  float_free(&smd);
   float_free(&sum);
 }
 
@@ -130,8 +238,8 @@ cosminus1series(
   int digits,
   char alternating)
 {
-  floatstruct sum, smd;
-  int expsqrx, pwrsz, addsz, i;
+  floatstruct sum;
+  int expsqrx;
 
   expsqrx = 2 * float_getexponent(x);
   float_setexponent(x, 0);
@@ -146,26 +254,60 @@ cosminus1series(
     return expsqrx == 0;
   }
   float_setexponent(x, expsqrx);
-  pwrsz = digits + expsqrx + 2;
-  if (pwrsz <= 0)
+  if (digits + expsqrx + 2 <= 0)
     /* for very small x, cos/cosh(x) - 1 = (-/+)0.5*x*x */
     return 1;
-  addsz = pwrsz;
   float_create(&sum);
-  float_create(&smd);
-  float_copy(&smd, x, pwrsz);
-  float_setzero(&sum);
-  i = 2;
-  while (pwrsz > 0)
-  {
-    float_mul(&smd, &smd, x, pwrsz+1);
-    float_divi(&smd, &smd, i*(2*i-1), pwrsz);
-    float_add(&sum, &sum, &smd, addsz);
-    ++i;
-    pwrsz = digits + float_getexponent(&smd);
-  }
+  _pssum(&sum, x, _cosdivisor, 1, digits + 1);
+  float_mul(&sum, &sum, x, digits + 2);
   float_add(x, x, &sum, digits+1);
   float_free(&sum);
-  float_free(&smd);
   return 1;
 }
+
+/* the Taylor series of sin/sinh x at x == 0, used for the tiny
+   arguments left over by the table driven reduction in floattrig.c.
+   The relative error is in the order of 1 unit in the <digits>-th
+   place */
+void
+sinseries(
+  floatnum x,
+  int digits,
+  char alternating)
+{
+  floatstruct xsqr;
+  floatstruct sum;
+
+  /* sin/sinh x == x - (+) x^3/6..., see arctanseries */
+  if (float_iszero(x) || 2*(float_getexponent(x)+1) < -digits)
+    return;
+  float_create(&xsqr);
+  float_create(&sum);
+  float_mul(&xsqr, x, x, digits + 2);
+  float_setsign(&xsqr, alternating? -1 : 1);
+  _pssum(&sum, &xsqr, _sindivisor, 1, digits + 1);
+  float_mul(&sum, &sum, x, digits + 2);
+  float_add(x, x, &sum, digits+1);
+  float_free(&xsqr);
+  float_free(&sum);
+}
+
+/* the Taylor series of exp x - 1 at x == 0, for |x| < 0.01. Unlike
+   _expminus1lt1 in floatexp.c, no square root is involved. The
+   relative error is in the order of 1 unit in the <digits>-th place */
+void
+expminus1series(
+  floatnum x,
+  int digits)
+{
+  floatstruct sum;
+
+  /* for very small x: exp(x)-1 approx.== x */
+  if (float_iszero(x) || float_getexponent(x) < -digits)
+    return;
+  float_create(&sum);
+  _pssum(&sum, x, _expdivisor, 1, digits + 1);
+  float_mul(&sum, &sum, x, digits + 2);
+  float_add(x, x, &sum, digits+1);
+  float_free(&sum);
+}
@@ -37,6 +37,7 @@
 #define arctannear0(x, digits) arctanseries(x, digits, 1)
 #define coshminus1near0(x, digits) cosminus1series(x, digits, 0)
 #define cosminus1near0(x, digits) cosminus1series(x, digits, 1)
+#define sinnear0(x, digits) sinseries(x, digits, 1)
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,6 +45,8 @@ extern "C" {
 
 void arctanseries(floatnum x, int digits, char alternating);
 char cosminus1series(floatnum x, int digits, char alternating);
+void sinseries(floatnum x, int digits, char alternating);
+void expminus1series(floatnum x, int digits);
 
 #ifdef __cplusplus
 }
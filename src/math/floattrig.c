@@ -33,6 +33,7 @@
 #include "floatseries.h"
 #include "floatconst.h"
 #include "floatcommon.h"
+#include <math.h>
 
 /* evaluates arctan x for |x| <= 1
    relative error for a 100 digit result is 6e-100 */
@@ -192,7 +193,92 @@ _arcsin(
   }
 }
 
-/* evaluates cos x - 1 for x < |pi/4|
+/* evaluates sin x and cos x for 0 <= x <= pi/4, placing sin x in x
+   and cos x in c. x is split into arctan m_1 + ... + arctan m_n + r,
+   with m_j = k_j*10^-j taken from the table TBLARCTAN, one decimal
+   place of tan x at a time. Multiplying cos r + i*sin r by 1 + i*m_j
+   turns it by arctan m_j. As m_j is short, each turn takes linear
+   time only. Each turn stretches the result by sqrt(1 + m_j^2); the
+   product of the (short) 1 + m_j^2 is collected exactly, and a single
+   reciprocal square root scales the result back to unit length. The
+   series for r converge after a few summands */
+static void
+_sincos(
+  floatnum x,
+  floatnum c,
+  int digits)
+{
+  floatstruct norm, tmp1, tmp2;
+  signed char k[TBLLEVELS+1];
+  double scale;
+  int level, levels, kmax, prec;
+
+  prec = digits + 2;
+  levels = floatmath_tbllevels(digits);
+  float_create(&norm);
+  float_create(&tmp1);
+  float_create(&tmp2);
+  float_copy(&norm, &c1, EXACT);
+  scale = 1;
+  for (level = 0; ++level <= levels;)
+  {
+    scale *= 10;
+    k[level] = 0;
+    if (float_iszero(x))
+      continue;
+    kmax = level == 1? 10 : TBLMAXK;
+    k[level] = (int)floor(tan(float_asfloat(x)) * scale + 0.5);
+    if (k[level] > kmax || k[level] < -kmax)
+      k[level] = k[level] > 0? kmax : -kmax;
+    if (k[level] != 0)
+    {
+      float_sub(x, x, floatmath_tbl(TBLARCTAN, level, k[level]), prec);
+      float_setinteger(&tmp1, k[level]*k[level]);
+      float_addexp(&tmp1, -2*level);
+      float_add(&tmp1, &tmp1, &c1, EXACT);
+      float_mul(&norm, &norm, &tmp1, prec);
+    }
+  }
+  float_copy(c, x, EXACT);
+  sinnear0(x, prec);
+  if (!float_iszero(c))
+    cosminus1near0(c, prec);
+  float_add(c, c, &c1, prec);
+  for (level = levels + 1; --level > 0;)
+    if (k[level] != 0)
+    {
+      float_muli(&tmp1, x, k[level], prec);
+      float_addexp(&tmp1, -level);
+      float_muli(&tmp2, c, k[level], prec);
+      float_addexp(&tmp2, -level);
+      float_sub(c, c, &tmp1, prec);
+      float_add(x, x, &tmp2, prec);
+    }
+  float_rsqrt(&norm, prec);
+  float_mul(x, x, &norm, prec);
+  float_mul(c, c, &norm, prec);
+  float_free(&norm);
+  float_free(&tmp1);
+  float_free(&tmp2);
+}
+
+/* evaluates cos x for 0 <= x <= pi/4 */
+static void
+_cosltPiDiv4(
+  floatnum x,
+  int digits)
+{
+  floatstruct c;
+
+  float_create(&c);
+  _sincos(x, &c, digits);
+  float_move(x, &c);
+}
+
+/* evaluates cos x - 1 for x < |pi/4|, using
+   cos x - 1 = -sin^2 x/(1 + cos x) for those x, that
+   the tables reduce. Tinier x are submitted to the
+   series directly.
    relative error for 100 digit results is < 5e-100 */
 
 char
@@ -200,55 +286,42 @@ _cosminus1ltPiDiv4(
   floatnum x,
   int digits)
 {
-  floatstruct tmp;
-  int reductions;
+  floatstruct c;
 
   if (float_iszero(x))
     return 1;
   float_abs(x);
-  reductions = 0;
-  while(float_getexponent(x) >= -2)
-  {
-    float_mul(x, x, &c1Div2, digits+1);
-    ++reductions;
-  }
-  if (!cosminus1near0(x, digits) && reductions == 0)
-    return !float_iszero(x);
-  float_create(&tmp);
-  for(; reductions-- > 0;)
-  {
-    float_mul(&tmp, x, x, digits);
-    float_add(x, x, x, digits+2);
-    float_add(x, x, &tmp, digits+2);
-    float_add(x, x, x, digits+2);
-  }
-  float_free(&tmp);
+  if (float_getexponent(x) < -floatmath_tbllevels(digits))
+    return cosminus1near0(x, digits) || !float_iszero(x);
+  float_create(&c);
+  _sincos(x, &c, digits+1);
+  float_mul(x, x, x, digits+1);
+  float_add(&c, &c, &c1, digits+1);
+  float_div(x, x, &c, digits+1);
+  float_neg(x);
+  float_free(&c);
   return 1;
 }
 
-/* evaluate sin x for |x| <= pi/4,
-   using |sin x| = sqrt((1-cos x)*(2 + cos x-1)) 
+/* evaluate sin x for |x| <= pi/4, see _sincos
    relative error for 100 digit results is < 6e-100*/
 void
 _sinltPiDiv4(
   floatnum x,
   int digits)
 {
-  floatstruct tmp;
+  floatstruct c;
   signed char sgn;
 
   if (2*float_getexponent(x)+2 < -digits)
     /* for small x: sin x approx.== x */
     return;
-  float_create(&tmp);
+  float_create(&c);
   sgn = float_getsign(x);
-  _cosminus1ltPiDiv4(x, digits);
-  float_add(&tmp, x, &c2, digits+1);
-  float_mul(x, x, &tmp, digits+1);
   float_abs(x);
-  float_sqrt(x, digits);
+  _sincos(x, &c, digits);
   float_setsign(x, sgn);
-  float_free(&tmp);
+  float_free(&c);
 }
 
 /* evaluates tan x for |x| <= pi/4.
@@ -259,23 +332,19 @@ _tanltPiDiv4(
   floatnum x,
   int digits)
 {
-  floatstruct tmp;
+  floatstruct c;
   signed char sgn;
 
   if (2*float_getexponent(x)+2 < -digits)
     /* for small x: tan x approx.== x */
     return;
-  float_create(&tmp);
+  float_create(&c);
   sgn = float_getsign(x);
-  _cosminus1ltPiDiv4(x, digits);
-  float_add(&tmp, x, &c2, digits+1);
-  float_mul(x, x, &tmp, digits+1);
   float_abs(x);
-  float_sqrt(x, digits);
-  float_sub(&tmp, &tmp, &c1, digits);
-  float_div(x, x, &tmp, digits+1);
+  _sincos(x, &c, digits+1);
+  float_div(x, x, &c, digits+1);
   float_setsign(x, sgn);
-  float_free(&tmp);
+  float_free(&c);
 }
 
 /* evaluates cos x for |x| <= pi */
@@ -297,10 +366,9 @@ _cos(
   if (float_cmp(x, &cPiDiv4) <= 0)
   {
     if (2*float_getexponent(x)+2 < - digits)
-      float_setzero(x);
+      float_copy(x, &c1, EXACT);
     else
-      _cosminus1ltPiDiv4(x, digits);
-    float_add(x, x, &c1, digits);
+      _cosltPiDiv4(x, digits);
   }
   else
   {
@@ -344,10 +412,9 @@ _sin(
   {
     float_sub(x, &cPiDiv2, x, digits+1);
     if (2*float_getexponent(x)+2 < - digits)
-      float_setzero(x);
+      float_copy(x, &c1, EXACT);
     else
-      _cosminus1ltPiDiv4(x, digits);
-    float_add(x, x, &c1, digits);
+      _cosltPiDiv4(x, digits);
   }
   float_setsign(x, sgn);
 }
@@ -385,13 +452,20 @@ _tan(
   return 1;
 }
 
+/* reduces x to -pi <= x <= pi, keeping the sign of x and adding or
+   subtracting an even multiple of pi. The quotient x/pi is found from a
+   few places only and corrected afterwards, so that, unless it
+   exceeds the integer range, a multiplication by an integer replaces
+   the full division by pi.
+   A return value 0 indicates that x is too large for pi being known
+   to sufficiently many places */
 char
 _trigreduce(
   floatnum x,
   int digits)
 {
   floatstruct tmp;
-  int expx, save;
+  int expx, save, q;
   signed char sgn;
   char odd;
 
@@ -400,13 +474,35 @@ _trigreduce(
   expx = float_getexponent(x);
   if (expx > float_getlength(&cPi) - digits)
     return 0;
-  save = float_setprecision(MAXDIGITS);
+  save = float_setprecision(MATHDIGITS);
   float_create(&tmp);
   sgn = float_getsign(x);
   float_abs(x);
-  float_divmod(&tmp, x, x, &cPi, INTQUOT);
+  if (expx < 9)
+  {
+    float_div(&tmp, x, &cPi, expx + 3);
+    float_int(&tmp);
+    q = float_asinteger(&tmp);
+    float_muli(&tmp, &cPi, q, EXACT);
+    float_sub(x, x, &tmp, EXACT);
+    if (float_getsign(x) < 0)
+    {
+      float_add(x, x, &cPi, EXACT);
+      --q;
+    }
+    else if (float_cmp(x, &cPi) >= 0)
+    {
+      float_sub(x, x, &cPi, EXACT);
+      ++q;
+    }
+    odd = q & 1;
+  }
+  else
+  {
+    float_divmod(&tmp, x, x, &cPi, INTQUOT);
+    odd = float_isodd(&tmp);
+  }
   float_setprecision(save);
-  odd = float_isodd(&tmp);
   if (odd)
     float_sub(x, x, &cPi, digits+1);
   if (sgn < 0)
@@ -26,12 +26,23 @@
 #include "math/floathmath.h"
 
 #include <sstream>
+#include <utility>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
-//TODO make this configurable
-#define HMATH_WORKING_PREC (DECPRECISION + 3)
+// the working precision in decimal digits, see HMath::setWorkingPrecision
+static int h_precision = DECPRECISION;
+// the guard value of basic operations set for the current thread
+static FLOAT_THREAD_LOCAL int h_threaddigits = MAXDIGITS;
+// a lower precision for the current thread, see HMath::setEvaluationPrecision
+static FLOAT_THREAD_LOCAL int h_evalprecision = 0;
+// leading digits lost in additions and subtractions, see
+// HMath::cancelledDigits
+static FLOAT_THREAD_LOCAL int h_cancelled = 0;
+
+#define HMATH_DIGITS (h_evalprecision > 0 ? h_evalprecision : h_precision)
+#define HMATH_WORKING_PREC (HMATH_DIGITS + 3)
 #define HMATH_EVAL_PREC (HMATH_WORKING_PREC + 2)
 
 //TODO should go into a separate format file
@@ -46,15 +57,21 @@
 static void checkfullcancellation( cfloatnum op1, cfloatnum op2,
                                    floatnum r )
 {
-  if (float_getlength(op1) != 0
-      && float_getlength(op2) != 0
-      && float_getlength(r) != 0)
+  if (float_getlength(op1) != 0 && float_getlength(op2) != 0)
   {
     /* NaN or zero not involved in computation */
-    int expr = float_getexponent(r);
-    if (float_getexponent(op1) - expr >= HMATH_WORKING_PREC - 1
-        || float_getexponent(op2) - expr >= HMATH_WORKING_PREC - 1)
-      float_setzero(r);
+    int lost = HMATH_WORKING_PREC;
+    if (float_getlength(r) != 0)
+    {
+      int expr = float_getexponent(r);
+      lost = float_getexponent(op1) - expr;
+      if (lost < float_getexponent(op2) - expr)
+        lost = float_getexponent(op2) - expr;
+      if (lost >= HMATH_WORKING_PREC - 1)
+        float_setzero(r);
+    }
+    if (lost > h_cancelled)
+      h_cancelled = lost;
   }
 }
 
@@ -74,19 +91,30 @@ static char checkSub(floatnum dest, cfloatnum s1, cfloatnum s2, int digits)
   return float_isnan(dest);
 }
 
+static bool h_doinit()
+{
+//   floatmath_init();
+  //TODO related to formats, get rid of it.
+  float_stdconvert();
+  return true;
+}
+
 static void h_init()
 {
-  static bool h_initialized = false;
-  if( !h_initialized )
+  // a local static is initialized once, even if several threads create
+  // their first number at the same time
+  static const bool h_initialized = h_doinit();
+  (void)h_initialized;
+  // threads started before the last precision change still use the old
+  // guard value
+  if (h_threaddigits != MATHDIGITS)
   {
-    h_initialized = true;
-//     floatmath_init();
-    //TODO related to formats, get rid of it.
-    float_stdconvert();
+    float_setprecision(MATHDIGITS);
+    h_threaddigits = MATHDIGITS;
   }
 }
 
-static void checkpoleorzero( floatnum result, floatnum x )
+static void checkpoleorzero( floatnum result, cfloatnum x )
 {
   if (float_getlength(result) == 0 || float_getlength(x) == 0)
     return;
@@ -110,28 +138,215 @@ static char roundResult( floatnum x )
 
 /*---------------------------   HNumberPrivate   --------------------*/
 
+// copies of a number share its HNumberPrivate, which may be read by
+// several threads at once, so the count of owners is changed atomically
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#  define HMATH_REF(x) _InterlockedIncrement(&(x))
+#  define HMATH_DEREF(x) _InterlockedDecrement(&(x))
+#  define HMATH_REFCOUNT(x) _InterlockedCompareExchange(&(x), 0, 0)
+#elif defined(__GNUC__)
+#  define HMATH_REF(x) __sync_add_and_fetch(&(x), 1)
+#  define HMATH_DEREF(x) __sync_sub_and_fetch(&(x), 1)
+#  define HMATH_REFCOUNT(x) __sync_fetch_and_add(&(x), 0)
+#else
+#  define HMATH_REF(x) (++(x))
+#  define HMATH_DEREF(x) (--(x))
+#  define HMATH_REFCOUNT(x) (x)
+#endif
+
+// integers up to this magnitude may be kept without a floatnum, so that
+// sums of two of them cannot overflow a long long
+#define HMATH_SMALL_MAX 0x3FFFFFFFFFFFFFFFLL
+
 class HNumberPrivate
 {
 public:
   HNumberPrivate();
   ~HNumberPrivate();
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+  floatnum fnum();
+  bool setSmall(long long value);
+  void setFloat(floatnum value);
   //TODO make this a variant
-  floatstruct fnum;
   Error error;
   //TODO do not keep formats with numbers
   char format;
+  // true if the value is the integer small, then the floatnum is created
+  // when it is changed only
+  bool isSmall;
+  long long small;
+  // the number of HNumbers sharing this value, which is not changed
+  // unless it is 1
+  long ref;
+private:
+  friend class ConstFloat;
+  floatstruct num;
+  bool numValid;
+};
+
+// reads a number as floatnum. Other threads may read the number at the
+// same time, so a small integer is converted into a floatnum owned by the
+// reader, not into the number. A temporary reader lasts until the end of
+// the expression it is created in.
+class ConstFloat
+{
+public:
+  explicit ConstFloat(const HNumberPrivate* p);
+  ~ConstFloat();
+  operator cfloatnum() const { return x; }
+private:
+  ConstFloat(const ConstFloat&);
+  ConstFloat& operator=(const ConstFloat&);
+  floatstruct tmp;
+  cfloatnum x;
 };
 
 HNumberPrivate::HNumberPrivate()
-  : error(Success), format(0)
+  : error(Success), format(0), isSmall(false), small(0), ref(1),
+    numValid(true)
 {
   h_init();
-  float_create(&fnum);
+  float_create(&num);
 }
 
 HNumberPrivate::~HNumberPrivate()
 {
-  float_free(&fnum);
+  float_free(&num);
+}
+
+// freed numbers are kept per thread for reuse, up to HMATH_POOL_LIMIT of
+// them; a number freed by another thread than its creator joins the pool
+// of the freeing thread. The significands are pooled by number.c.
+#define HMATH_POOL_LIMIT 1024
+
+union HNumberBlock
+{
+  HNumberBlock* next;
+  char data[sizeof(HNumberPrivate)];
+};
+
+static FLOAT_THREAD_LOCAL HNumberBlock* h_pool = 0;
+static FLOAT_THREAD_LOCAL int h_poolsize = 0;
+static FLOAT_THREAD_LOCAL long h_numbercount = 0;
+static FLOAT_THREAD_LOCAL long h_numberalloccount = 0;
+
+void* HNumberPrivate::operator new(size_t size)
+{
+  ++h_numbercount;
+  if (h_pool)
+  {
+    HNumberBlock* block = h_pool;
+    h_pool = block->next;
+    --h_poolsize;
+    return block;
+  }
+  ++h_numberalloccount;
+  return ::operator new(size);
+}
+
+void HNumberPrivate::operator delete(void* p)
+{
+  if (!p)
+    return;
+  if (h_poolsize >= HMATH_POOL_LIMIT)
+  {
+    ::operator delete(p);
+    return;
+  }
+  HNumberBlock* block = static_cast<HNumberBlock*>(p);
+  block->next = h_pool;
+  h_pool = block;
+  ++h_poolsize;
+}
+
+static void setlonglong(floatnum x, long long value)
+{
+  char buf[24];
+
+  sprintf(buf, "%lld", value);
+  float_setscientific(x, buf, NULLTERMINATED);
+}
+
+ConstFloat::ConstFloat(const HNumberPrivate* p)
+{
+  float_create(&tmp);
+  if (p->numValid)
+    x = &p->num;
+  else
+  {
+    setlonglong(&tmp, p->small);
+    x = &tmp;
+  }
+}
+
+ConstFloat::~ConstFloat()
+{
+  float_free(&tmp);
+}
+
+/**
+ * Returns the value as floatnum for changing it.
+ */
+floatnum HNumberPrivate::fnum()
+{
+  if (!numValid)
+  {
+    setlonglong(&num, small);
+    numValid = true;
+  }
+  isSmall = false;
+  return &num;
+}
+
+/**
+ * Keeps value as small integer, if it is in range.
+ */
+bool HNumberPrivate::setSmall(long long value)
+{
+  if (value > HMATH_SMALL_MAX || value < -HMATH_SMALL_MAX)
+    return false;
+  isSmall = true;
+  small = value;
+  numValid = false;
+  error = Success;
+  return true;
+}
+
+/**
+ * Takes over value, which is NaN afterwards.
+ */
+void HNumberPrivate::setFloat(floatnum value)
+{
+  float_move(&num, value);
+  numValid = true;
+  isSmall = false;
+}
+
+static bool isShared(HNumberPrivate* p)
+{
+  return HMATH_REFCOUNT(p->ref) != 1;
+}
+
+static void release(HNumberPrivate* p)
+{
+  if (p && HMATH_DEREF(p->ref) == 0)
+    delete p;
+}
+
+static bool bothSmall(const HNumberPrivate* n1, const HNumberPrivate* n2)
+{
+  return n1->isSmall && n2->isSmall;
+}
+
+static bool smallFactors(const HNumberPrivate* n1, const HNumberPrivate* n2)
+{
+  /* the product of factors below 2^31 is below 2^62 */
+  const long long limit = 0x7FFFFFFFLL;
+  return bothSmall(n1, n2)
+         && n1->small <= limit && n1->small >= -limit
+         && n2->small <= limit && n2->small >= -limit;
 }
 
 typedef char (*Float1ArgND)(floatnum x);
@@ -142,7 +357,7 @@ typedef char (*Float2Args)(floatnum result, cfloatnum p1, cfloatnum p2, int digi
 static Error checkNaNParam(const HNumberPrivate& v1,
                             const HNumberPrivate* v2 = 0)
 {
-  if ( !float_isnan(&v1.fnum) && (!v2 || !float_isnan(&v2->fnum)))
+  if ( !float_isnan(ConstFloat(&v1)) && (!v2 || !float_isnan(ConstFloat(v2))))
     return Success;
   Error error = v1.error;
   if ( error == Success && v2 )
@@ -153,22 +368,35 @@ static Error checkNaNParam(const HNumberPrivate& v1,
 void roundSetError(HNumberPrivate* dest)
 {
   dest->error = float_geterror();
-  floatnum dfnum = &dest->fnum;
+  floatnum dfnum = dest->fnum();
   if (dest->error != Success)
     float_setnan(dfnum);
   if (!float_isnan(dfnum))
     float_round(dfnum, dfnum, HMATH_WORKING_PREC, TONEAREST);
 }
 
+// dest may be one of the operands: the floatnum functions (and the
+// cancellation checks after them) read an operand after the result is
+// written, so the result goes to a temporary then. A NaN operand leaves
+// dest NaN as well.
 void call2Args(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2, Float2Args func)
 {
   dest->error = checkNaNParam(*n1, n2);
   if (dest->error == Success)
   {
-    floatnum dfnum = &dest->fnum;
-    func(dfnum, &n1->fnum, &n2->fnum, HMATH_EVAL_PREC);
+    if (dest == n1 || dest == n2)
+    {
+      floatstruct tmp;
+      float_create(&tmp);
+      func(&tmp, ConstFloat(n1), ConstFloat(n2), HMATH_EVAL_PREC);
+      dest->setFloat(&tmp);
+    }
+    else
+      func(dest->fnum(), ConstFloat(n1), ConstFloat(n2), HMATH_EVAL_PREC);
     roundSetError(dest);
   }
+  else if (dest == n1 || dest == n2)
+    float_setnan(dest->fnum());
 }
 
 void call2ArgsND(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2, Float2ArgsND func)
@@ -176,10 +404,19 @@ void call2ArgsND(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2, F
   dest->error = checkNaNParam(*n1, n2);
   if (dest->error == Success)
   {
-    floatnum dfnum = &dest->fnum;
-    func(dfnum, &n1->fnum, &n2->fnum);
+    if (dest == n1 || dest == n2)
+    {
+      floatstruct tmp;
+      float_create(&tmp);
+      func(&tmp, ConstFloat(n1), ConstFloat(n2));
+      dest->setFloat(&tmp);
+    }
+    else
+      func(dest->fnum(), ConstFloat(n1), ConstFloat(n2));
     roundSetError(dest);
   }
+  else if (dest == n1 || dest == n2)
+    float_setnan(dest->fnum());
 }
 
 void call1Arg(HNumberPrivate* dest, HNumberPrivate* n, Float1Arg func)
@@ -187,8 +424,8 @@ void call1Arg(HNumberPrivate* dest, HNumberPrivate* n, Float1Arg func)
   dest->error = checkNaNParam(*n);
   if (dest->error == Success)
   {
-    floatnum dfnum = &dest->fnum;
-    float_copy(dfnum, &n->fnum, HMATH_EVAL_PREC);
+    floatnum dfnum = dest->fnum();
+    float_copy(dfnum, ConstFloat(n), HMATH_EVAL_PREC);
     func(dfnum, HMATH_EVAL_PREC);
     roundSetError(dest);
   }
@@ -199,10 +436,10 @@ void call1ArgPoleCheck(HNumberPrivate* dest, HNumberPrivate* n, Float1Arg func)
   dest->error = checkNaNParam(*n);
   if (dest->error == Success)
   {
-    floatnum dfnum = &dest->fnum;
-    float_copy(dfnum, &n->fnum, HMATH_EVAL_PREC);
+    floatnum dfnum = dest->fnum();
+    float_copy(dfnum, ConstFloat(n), HMATH_EVAL_PREC);
     if (func(dfnum, HMATH_EVAL_PREC))
-      checkpoleorzero(dfnum, &n->fnum);
+      checkpoleorzero(dfnum, ConstFloat(n));
     roundSetError(dest);
   }
 }
@@ -212,8 +449,8 @@ void call1ArgND(HNumberPrivate* dest, HNumberPrivate* n, Float1ArgND func)
   dest->error = checkNaNParam(*n);
   if (dest->error == Success)
   {
-    floatnum dfnum = &dest->fnum;
-    float_copy(dfnum, &n->fnum, HMATH_EVAL_PREC);
+    floatnum dfnum = dest->fnum();
+    float_copy(dfnum, ConstFloat(n), HMATH_EVAL_PREC);
     func(dfnum);
     roundSetError(dest);
   }
@@ -231,7 +468,7 @@ static char modwrap(floatnum result, cfloatnum p1, cfloatnum p2, int /*digits*/)
 char idivwrap(floatnum result, cfloatnum p1, cfloatnum p2)
 {
   floatstruct tmp;
-  int save = float_setprecision(DECPRECISION);
+  int save = float_setprecision(h_precision);
   float_create(&tmp);
   char ok = float_divmod(result, &tmp, p1, p2, INTQUOT);
   float_free(&tmp);
@@ -239,6 +476,67 @@ char idivwrap(floatnum result, cfloatnum p1, cfloatnum p2)
   return ok;
 }
 
+// the operations below store into dest, which may be one of the operands;
+// like a newly created number, the result has no format
+
+static void addInto(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2)
+{
+  dest->format = 0;
+  if (!bothSmall(n1, n2) || !dest->setSmall(n1->small + n2->small))
+    call2Args(dest, n1, n2, checkAdd);
+}
+
+static void subInto(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2)
+{
+  dest->format = 0;
+  if (!bothSmall(n1, n2) || !dest->setSmall(n1->small - n2->small))
+    call2Args(dest, n1, n2, checkSub);
+}
+
+static void mulInto(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2)
+{
+  dest->format = 0;
+  if (!smallFactors(n1, n2) || !dest->setSmall(n1->small * n2->small))
+    call2Args(dest, n1, n2, float_mul);
+}
+
+static void divInto(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2)
+{
+  dest->format = 0;
+  if (!bothSmall(n1, n2) || n2->small == 0
+      || n1->small % n2->small != 0
+      || !dest->setSmall(n1->small / n2->small))
+    call2Args(dest, n1, n2, float_div);
+}
+
+static void andInto(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2)
+{
+  dest->format = 0;
+  if (!bothSmall(n1, n2) || !dest->setSmall(n1->small & n2->small))
+    call2ArgsND(dest, n1, n2, float_and);
+}
+
+static void orInto(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2)
+{
+  dest->format = 0;
+  if (!bothSmall(n1, n2) || !dest->setSmall(n1->small | n2->small))
+    call2ArgsND(dest, n1, n2, float_or);
+}
+
+static void xorInto(HNumberPrivate* dest, HNumberPrivate* n1, HNumberPrivate* n2)
+{
+  dest->format = 0;
+  if (!bothSmall(n1, n2) || !dest->setSmall(n1->small ^ n2->small))
+    call2ArgsND(dest, n1, n2, float_xor);
+}
+
+static void negInto(HNumberPrivate* dest, HNumberPrivate* n)
+{
+  dest->format = 0;
+  if (!n->isSmall || !dest->setSmall(-n->small))
+    call1ArgND(dest, n, float_neg);
+}
+
 /*--------------------------   HNumber   -------------------*/
 
 /**
@@ -249,19 +547,31 @@ HNumber::HNumber() : d( new HNumberPrivate )
 }
 
 /**
- * Copies from another number.
+ * Copies from another number. Both share the value until one of them
+ * is changed.
  */
-HNumber::HNumber( const HNumber& hn ) : d( new HNumberPrivate )
+HNumber::HNumber( const HNumber& hn ) : d( hn.d )
 {
-  operator=( hn );
+  HMATH_REF(d->ref);
 }
 
+#if __cplusplus >= 201103L
+/**
+ * Takes over the value of another number. The other number may only be
+ * assigned to or destroyed afterwards.
+ */
+HNumber::HNumber( HNumber&& hn ) : d( hn.d )
+{
+  hn.d = 0;
+}
+#endif
+
 /**
  * Creates a new number from an integer value.
  */
 HNumber::HNumber( int i ) : d( new HNumberPrivate )
 {
-  float_setinteger(&d->fnum, i);
+  d->setSmall(i);
 }
 
 /**
@@ -272,8 +582,15 @@ HNumber::HNumber( const char* str ) : d( new HNumberPrivate )
   t_itokens tokens;
 
   if ((d->error = parse(&tokens, &str)) == Success && *str == 0)
-    d->error = float_in(&d->fnum, &tokens);
+    d->error = float_in(d->fnum(), &tokens);
   float_geterror();
+  ConstFloat x(d);
+  if (float_isinteger(x) && float_getexponent(x) < 9)
+  {
+    /* keeps the floatnum as well */
+    d->isSmall = true;
+    d->small = float_asinteger(x);
+  }
 }
 
 /**
@@ -281,7 +598,25 @@ HNumber::HNumber( const char* str ) : d( new HNumberPrivate )
  */
 HNumber::~HNumber()
 {
-  delete d;
+  release(d);
+}
+
+/**
+ * Gives this number a value of its own, before it is changed.
+ */
+void HNumber::detach()
+{
+  if (!isShared(d))
+    return;
+  HNumberPrivate * p = new HNumberPrivate;
+  p->format = d->format;
+  p->error = d->error;
+  if (d->isSmall)
+    p->setSmall(d->small);
+  else
+    float_copy(p->fnum(), ConstFloat(d), EXACT);
+  release(d);
+  d = p;
 }
 
 /**
@@ -297,7 +632,7 @@ Error HNumber::error() const
  */
 bool HNumber::isNan() const
 {
-  return float_isnan(&d->fnum) != 0;
+  return !d->isSmall && float_isnan(ConstFloat(d)) != 0;
 }
 
 /**
@@ -305,7 +640,9 @@ bool HNumber::isNan() const
  */
 bool HNumber::isZero() const
 {
-  return float_iszero(&d->fnum) != 0;
+  if (d->isSmall)
+    return d->small == 0;
+  return float_iszero(ConstFloat(d)) != 0;
 }
 
 /**
@@ -313,7 +650,9 @@ bool HNumber::isZero() const
  */
 bool HNumber::isPositive() const
 {
-  return float_getsign(&d->fnum) > 0;
+  if (d->isSmall)
+    return d->small > 0;
+  return float_getsign(ConstFloat(d)) > 0;
 }
 
 /**
@@ -321,7 +660,9 @@ bool HNumber::isPositive() const
  */
 bool HNumber::isNegative() const
 {
-  return float_getsign(&d->fnum) < 0;
+  if (d->isSmall)
+    return d->small < 0;
+  return float_getsign(ConstFloat(d)) < 0;
 }
 
 /**
@@ -329,7 +670,7 @@ bool HNumber::isNegative() const
  */
 bool HNumber::isInteger() const
 {
-  return float_isinteger(&d->fnum) != 0;
+  return d->isSmall || float_isinteger(ConstFloat(d)) != 0;
 }
 
 /**
@@ -345,7 +686,8 @@ char HNumber::format() const
  */
 HNumber& HNumber::setFormat(char c)
 {
-   d->format = float_isnan(&d->fnum)?0:c;
+   detach();
+   d->format = isNan()?0:c;
    return *this;
 }
 
@@ -356,7 +698,9 @@ HNumber& HNumber::setFormat(char c)
  */
 int HNumber::toInt() const
 {
-  return float_asinteger(&d->fnum);
+  if (d->isSmall)
+    return (int)d->small;
+  return float_asinteger(ConstFloat(d));
 }
 
 /**
@@ -364,19 +708,36 @@ int HNumber::toInt() const
  */
 HNumber& HNumber::operator=( const HNumber & hn )
 {
-  d->format = hn.format();
-  d->error = hn.error();
-  float_copy(&d->fnum, &hn.d->fnum, EXACT);
+  if (hn.d != d)
+  {
+    HMATH_REF(hn.d->ref);
+    release(d);
+    d = hn.d;
+  }
   return *this;
 }
 
+#if __cplusplus >= 201103L
+/**
+ * Takes over the value of another number, which gets the old value of
+ * this number in exchange.
+ */
+HNumber& HNumber::operator=( HNumber && hn )
+{
+  HNumberPrivate * tmp = d;
+  d = hn.d;
+  hn.d = tmp;
+  return *this;
+}
+#endif
+
 /**
  * Adds another number.
  */
 HNumber HNumber::operator+( const HNumber & num ) const
 {
   HNumber result;
-  call2Args(result.d, d, num.d, checkAdd);
+  addInto(result.d, d, num.d);
   return result;
 }
 
@@ -385,7 +746,10 @@ HNumber HNumber::operator+( const HNumber & num ) const
  */
 HNumber& HNumber::operator+=( const HNumber & num )
 {
-  return operator=( *this + num );
+  if (isShared(d))
+    return operator=( *this + num );
+  addInto(d, d, num.d);
+  return *this;
 }
 
 /**
@@ -394,7 +758,7 @@ HNumber& HNumber::operator+=( const HNumber & num )
 HNumber operator-( const HNumber & n1, const HNumber & n2 )
 {
   HNumber result;
-  call2Args(result.d, n1.d, n2.d, checkSub);
+  subInto(result.d, n1.d, n2.d);
   return result;
 }
 
@@ -403,7 +767,10 @@ HNumber operator-( const HNumber & n1, const HNumber & n2 )
  */
 HNumber& HNumber::operator-=( const HNumber & num )
 {
-  return operator=( *this - num );
+  if (isShared(d))
+    return operator=( *this - num );
+  subInto(d, d, num.d);
+  return *this;
 }
 
 /**
@@ -412,7 +779,7 @@ HNumber& HNumber::operator-=( const HNumber & num )
 HNumber HNumber::operator*( const HNumber & num ) const
 {
   HNumber result;
-  call2Args(result.d, d, num.d, float_mul);
+  mulInto(result.d, d, num.d);
   return result;
 }
 
@@ -421,7 +788,10 @@ HNumber HNumber::operator*( const HNumber & num ) const
  */
 HNumber& HNumber::operator*=( const HNumber & num )
 {
-  return operator=( *this * num );
+  if (isShared(d))
+    return operator=( *this * num );
+  mulInto(d, d, num.d);
+  return *this;
 }
 
 /**
@@ -430,7 +800,7 @@ HNumber& HNumber::operator*=( const HNumber & num )
 HNumber HNumber::operator/( const HNumber & num ) const
 {
   HNumber result;
-  call2Args(result.d, d, num.d, float_div);
+  divInto(result.d, d, num.d);
   return result;
 }
 
@@ -439,16 +809,119 @@ HNumber HNumber::operator/( const HNumber & num ) const
  */
 HNumber& HNumber::operator/=( const HNumber & num )
 {
-  return operator=( *this / num );
+  if (isShared(d))
+    return operator=( *this / num );
+  divInto(d, d, num.d);
+  return *this;
+}
+
+#if __cplusplus >= 201103L
+// operands that are temporaries keep the result, so that chained
+// expressions like a*b + c*d allocate no new number per operation;
+// a temporary sharing its value with another number cannot
+
+HNumber operator+( HNumber && n1, const HNumber & n2 )
+{
+  if (isShared(n1.d))
+    return n1 + n2;
+  addInto(n1.d, n1.d, n2.d);
+  return std::move(n1);
+}
+
+HNumber operator+( const HNumber & n1, HNumber && n2 )
+{
+  if (isShared(n2.d))
+    return n1 + n2;
+  addInto(n2.d, n1.d, n2.d);
+  return std::move(n2);
+}
+
+HNumber operator+( HNumber && n1, HNumber && n2 )
+{
+  return std::move(n1) + n2;
+}
+
+HNumber operator-( HNumber && n1, const HNumber & n2 )
+{
+  if (isShared(n1.d))
+    return n1 - n2;
+  subInto(n1.d, n1.d, n2.d);
+  return std::move(n1);
+}
+
+HNumber operator-( const HNumber & n1, HNumber && n2 )
+{
+  if (isShared(n2.d))
+    return n1 - n2;
+  subInto(n2.d, n1.d, n2.d);
+  return std::move(n2);
+}
+
+HNumber operator-( HNumber && n1, HNumber && n2 )
+{
+  return std::move(n1) - n2;
+}
+
+HNumber operator*( HNumber && n1, const HNumber & n2 )
+{
+  if (isShared(n1.d))
+    return n1 * n2;
+  mulInto(n1.d, n1.d, n2.d);
+  return std::move(n1);
+}
+
+HNumber operator*( const HNumber & n1, HNumber && n2 )
+{
+  if (isShared(n2.d))
+    return n1 * n2;
+  mulInto(n2.d, n1.d, n2.d);
+  return std::move(n2);
+}
+
+HNumber operator*( HNumber && n1, HNumber && n2 )
+{
+  return std::move(n1) * n2;
+}
+
+HNumber operator/( HNumber && n1, const HNumber & n2 )
+{
+  if (isShared(n1.d))
+    return n1 / n2;
+  divInto(n1.d, n1.d, n2.d);
+  return std::move(n1);
+}
+
+HNumber operator/( const HNumber & n1, HNumber && n2 )
+{
+  if (isShared(n2.d))
+    return n1 / n2;
+  divInto(n2.d, n1.d, n2.d);
+  return std::move(n2);
+}
+
+HNumber operator/( HNumber && n1, HNumber && n2 )
+{
+  return std::move(n1) / n2;
 }
 
+HNumber operator-( HNumber && x )
+{
+  if (isShared(x.d))
+    return -x;
+  negInto(x.d, x.d);
+  return std::move(x);
+}
+#endif
+
 /**
  * Modulo (rest of integer division)
  */
 HNumber HNumber::operator%( const HNumber & num ) const
 {
   HNumber result;
-  call2Args(result.d, d, num.d, modwrap);
+  if (!bothSmall(d, num.d) || num.d->small == 0
+      || !result.d->setSmall(d->small % num.d->small))
+    call2Args(result.d, d, num.d, modwrap);
   return result;
 }
 
@@ -457,7 +930,9 @@ HNumber HNumber::operator%( const HNumber & num ) const
  */
 int HNumber::compare( const HNumber & other ) const
 {
-  int result = float_relcmp(&d->fnum, &other.d->fnum, HMATH_EVAL_PREC-1);
+  if (d->isSmall && other.d->isSmall)
+    return d->small < other.d->small ? -1 : d->small > other.d->small;
+  int result = float_relcmp(ConstFloat(d), ConstFloat(other.d), HMATH_EVAL_PREC-1);
   float_geterror(); // clears error, if one operand was a NaN
   return result;
 }
@@ -517,7 +992,7 @@ bool operator!=( const HNumber& l, const HNumber& r )
 HNumber HNumber::operator&( const HNumber & num ) const
 {
   HNumber result;
-  call2ArgsND(result.d, d, num.d, float_and);
+  andInto(result.d, d, num.d);
   return result;
 }
 
@@ -527,7 +1002,10 @@ HNumber HNumber::operator&( const HNumber & num ) const
  */
 HNumber& HNumber::operator&=( const HNumber & num )
 {
-  return operator=( *this & num );
+  if (isShared(d))
+    return operator=( *this & num );
+  andInto(d, d, num.d);
+  return *this;
 }
 
 /**
@@ -537,7 +1015,7 @@ HNumber& HNumber::operator&=( const HNumber & num )
 HNumber HNumber::operator|( const HNumber & num ) const
 {
   HNumber result;
-  call2ArgsND(result.d, d, num.d, float_or);
+  orInto(result.d, d, num.d);
   return result;
 }
 
@@ -547,7 +1025,10 @@ HNumber HNumber::operator|( const HNumber & num ) const
  */
 HNumber& HNumber::operator|=( const HNumber & num )
 {
-  return operator=( *this | num );
+  if (isShared(d))
+    return operator=( *this | num );
+  orInto(d, d, num.d);
+  return *this;
 }
 
 /**
@@ -557,7 +1038,7 @@ HNumber& HNumber::operator|=( const HNumber & num )
 HNumber HNumber::operator^( const HNumber & num ) const
 {
   HNumber result;
-  call2ArgsND(result.d, d, num.d, float_xor);
+  xorInto(result.d, d, num.d);
   return result;
 }
 
@@ -567,7 +1048,10 @@ HNumber HNumber::operator^( const HNumber & num ) const
  */
 HNumber& HNumber::operator^=( const HNumber& num )
 {
-  return operator=( *this ^ num );
+  if (isShared(d))
+    return operator=( *this ^ num );
+  xorInto(d, d, num.d);
+  return *this;
 }
 
 /**
@@ -577,7 +1061,8 @@ HNumber& HNumber::operator^=( const HNumber& num )
 HNumber HNumber::operator~() const
 {
   HNumber result;
-  call1ArgND(result.d, d, float_not);
+  if (!d->isSmall || !result.d->setSmall(~d->small))
+    call1ArgND(result.d, d, float_not);
   return result;
 }
 
@@ -587,7 +1072,7 @@ HNumber HNumber::operator~() const
 HNumber operator-( const HNumber & x )
 {
   HNumber result;
-  call1ArgND(result.d, x.d, float_neg);
+  negInto(result.d, x.d);
   return result;
 }
 
@@ -601,7 +1086,11 @@ HNumber operator-( const HNumber & x )
 HNumber HNumber::operator<<( const HNumber & num ) const
 {
   HNumber result;
-  call2ArgsND(result.d, d, num.d, float_shl);
+  long long n = num.d->small;
+  if (!bothSmall(d, num.d) || n < 0 || n > 61
+      || d->small > (HMATH_SMALL_MAX >> n) || d->small < -(HMATH_SMALL_MAX >> n)
+      || !result.d->setSmall(d->small * (1LL << n)))
+    call2ArgsND(result.d, d, num.d, float_shl);
   return result;
 }
 
@@ -616,13 +1105,28 @@ HNumber HNumber::operator<<( const HNumber & num ) const
 HNumber HNumber::operator>>( const HNumber & num ) const
 {
   HNumber result;
-  call2ArgsND(result.d, d, num.d, float_shr);
+  long long n = num.d->small < 62 ? num.d->small : 62;
+  if (!bothSmall(d, num.d) || n < 0
+      || !result.d->setSmall(d->small >= 0 ? d->small >> n : ~(~d->small >> n)))
+    call2ArgsND(result.d, d, num.d, float_shr);
   return result;
 }
 
 namespace /* unnamed */ {
 
-char* _doFormat(
+// the text of a formatted number goes to the caller's buffer, if it fits,
+// or to a buffer allocated for it
+struct FormatOutput
+{
+  char* buf;
+  int size;
+  // the size of the text, including the terminating zero
+  int needed;
+  bool allocate;
+};
+
+bool _doFormat(
+  FormatOutput& out,
   cfloatnum x,
   signed char base,
   signed char expbase,
@@ -630,11 +1134,13 @@ char* _doFormat(
   int prec,
   unsigned flags)
 {
+  enum { BufSize = (MAXDECPRECISION > BINPRECISION
+                    ? MAXDECPRECISION : BINPRECISION) + 1 };
   t_otokens tokens;
-  char intbuf[BINPRECISION+1];
-  char fracbuf[BINPRECISION+1];
+  char intbuf[BufSize];
+  char fracbuf[BufSize];
   int sz = 0;
-  char* str = NULL;
+  bool ok;
   switch (base)
   {
   case 2:
@@ -644,7 +1150,7 @@ char* _doFormat(
     sz = OCTPRECISION+1;
     break;
   case 10:
-    sz = DECPRECISION+1;
+    sz = h_precision+1;
     break;
   case 16:
     sz = HEXPRECISION+1;
@@ -657,22 +1163,28 @@ char* _doFormat(
 
   floatstruct tmp;
   float_create(&tmp);
-  float_copy(&tmp, x, DECPRECISION + 2);
-  if (float_out(&tokens, &tmp, prec, base, outmode) == Success)
+  float_copy(&tmp, x, h_precision + 2);
+  ok = float_out(&tokens, &tmp, prec, base, outmode) == Success;
+  if (ok)
   {
     sz = cattokens(NULL, -1, &tokens, expbase, flags);
-    str = (char*)malloc( sz );
-    cattokens(str, sz, &tokens, expbase, flags);
+    out.needed = sz;
+    if (out.allocate)
+    {
+      out.buf = (char*)malloc( sz );
+      out.size = sz;
+    }
+    if (sz <= out.size)
+      cattokens(out.buf, sz, &tokens, expbase, flags);
   }
   float_free(&tmp);
-  return str;
+  return ok;
 }
 
 /**
  * Formats the given number as string, using specified decimal digits.
- * Note that the returned string must be freed.
  */
-char* formatFixed( cfloatnum x, int prec )
+bool formatFixed( FormatOutput& out, cfloatnum x, int prec )
 {
   int scale = float_getlength(x) - float_getexponent(x) - 1;
   if (scale < 0)
@@ -685,16 +1197,14 @@ char* formatFixed( cfloatnum x, int prec )
     if( scale < HMATH_MAX_SHOWN )
       prec = scale;
   }
-  char* result = _doFormat(x, 10, 10, IO_MODE_FIXPOINT, prec, flags);
-  return result ? result
-      : _doFormat(x, 10, 10, IO_MODE_SCIENTIFIC, HMATH_MAX_SHOWN, flags);
+  return _doFormat(out, x, 10, 10, IO_MODE_FIXPOINT, prec, flags)
+      || _doFormat(out, x, 10, 10, IO_MODE_SCIENTIFIC, HMATH_MAX_SHOWN, flags);
 }
 
 /**
  * Formats the given number as string, in scientific format.
- * Note that the returned string must be freed.
  */
-char* formatScientific( cfloatnum x, int prec )
+bool formatScientific( FormatOutput& out, cfloatnum x, int prec )
 {
   unsigned flags = IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_DOT
       + IO_FLAG_SUPPRESS_EXPPLUS;
@@ -703,14 +1213,13 @@ char* formatScientific( cfloatnum x, int prec )
     flags |= IO_FLAG_SUPPRESS_TRL_ZERO;
     prec = HMATH_MAX_SHOWN;
   }
-  return _doFormat(x, 10, 10, IO_MODE_SCIENTIFIC, prec, flags);
+  return _doFormat(out, x, 10, 10, IO_MODE_SCIENTIFIC, prec, flags);
 }
 
 /**
  * Formats the given number as string, in engineering notation.
- * Note that the returned string must be freed.
  */
-char* formatEngineering( cfloatnum x, int prec )
+bool formatEngineering( FormatOutput& out, cfloatnum x, int prec )
 {
   unsigned flags = IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_EXPPLUS;
   if( prec <= 1 )
@@ -718,44 +1227,53 @@ char* formatEngineering( cfloatnum x, int prec )
     flags |= IO_FLAG_SUPPRESS_TRL_ZERO + IO_FLAG_SUPPRESS_DOT;
     prec = HMATH_MAX_SHOWN;
   }
-  return _doFormat(x, 10, 10, IO_MODE_ENG, prec, flags);
+  return _doFormat(out, x, 10, 10, IO_MODE_ENG, prec, flags);
 }
 
 /**
  * Formats the given number as string, using specified decimal digits.
- * Note that the returned string must be freed.
  */
-char* formatGeneral( cfloatnum x, int prec )
+bool formatGeneral( FormatOutput& out, cfloatnum x, int prec )
 {
   // find the exponent and the factor
   int expd = float_getexponent(x);
 
-  char* str;
   if( expd > 5 )
-    str = formatScientific( x, prec );
+    return formatScientific( out, x, prec );
   else if( expd < -4 )
-    str = formatScientific( x, prec );
+    return formatScientific( out, x, prec );
   else if ( (expd < 0) && (prec>0) && (expd < -prec) )
-    str = formatScientific( x, prec );
+    return formatScientific( out, x, prec );
   else
-    str = formatFixed( x, prec );
-
-  return str;
+    return formatFixed( out, x, prec );
 }
 
-char* formathexfp( cfloatnum x, char base,
-                   char expbase, int scale )
+bool formathexfp( FormatOutput& out, cfloatnum x, char base,
+                  char expbase, int scale )
 {
   int tmpscale = scale;
   if (float_isinteger(x))
     tmpscale = 0;
-  char* result = _doFormat(x, base, expbase, IO_MODE_FIXPOINT, tmpscale,
-                      IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_DOT
-                      + IO_FLAG_SHOW_BASE + IO_FLAG_SUPPRESS_EXPZERO);
-  return result ? result
-      : _doFormat(x, base, expbase, IO_MODE_SCIENTIFIC, scale,
-                    IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_DOT
-                    + IO_FLAG_SHOW_BASE + IO_FLAG_SHOW_EXPBASE);
+  return _doFormat(out, x, base, expbase, IO_MODE_FIXPOINT, tmpscale,
+                   IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_DOT
+                   + IO_FLAG_SHOW_BASE + IO_FLAG_SUPPRESS_EXPZERO)
+      || _doFormat(out, x, base, expbase, IO_MODE_SCIENTIFIC, scale,
+                   IO_FLAG_SUPPRESS_PLUS + IO_FLAG_SUPPRESS_DOT
+                   + IO_FLAG_SHOW_BASE + IO_FLAG_SHOW_EXPBASE);
+}
+
+bool formatAny( FormatOutput& out, cfloatnum x, char format, int prec )
+{
+  switch (format)
+  {
+  case 'f': return formatFixed( out, x, prec );
+  case 'e': return formatScientific( out, x, prec );
+  case 'n': return formatEngineering( out, x, prec );
+  case 'h': return formathexfp( out, x, 16, 10, HMATH_HEX_MAX_SHOWN );
+  case 'o': return formathexfp( out, x, 8, 10, HMATH_OCT_MAX_SHOWN );
+  case 'b': return formathexfp( out, x, 2, 10, HMATH_BIN_MAX_SHOWN );
+  case 'g': default: return formatGeneral( out, x, prec );
+  }
 }
 
 } /* unnamed namespace */
@@ -766,20 +1284,161 @@ char* formathexfp( cfloatnum x, char base,
  */
 char* HMath::format( const HNumber& hn, char format, int prec )
 {
-  char* rs = 0;
+  FormatOutput out = { 0, 0, 0, true };
+  formatAny(out, ConstFloat(hn.d), format, prec);
+  return out.buf;
+}
 
-  switch (format)
+/**
+ * Formats the given number like format() does, into buf. Returns the
+ * size of the text including the terminating zero, which is written only
+ * if it is not more than size, or 0 if the number cannot be formatted.
+ */
+int HMath::formatInto( const HNumber& hn, char* buf, int size,
+                       char format, int prec )
+{
+  FormatOutput out = { buf, size, 0, false };
+  if (!formatAny(out, ConstFloat(hn.d), format, prec))
+    return 0;
+  return out.needed;
+}
+
+/**
+ * Formats the given number in count formats at once, each given by an
+ * entry of formats and precs. The texts follow each other in buf, each
+ * terminated by a zero, a number that cannot be formatted leaves an empty
+ * one. A format requested twice is formatted once only. Returns the size
+ * of all texts, which are written only if it is not more than size.
+ */
+int HMath::formatInto( const HNumber& hn, const char* formats,
+                       const int* precs, int count, char* buf, int size )
+{
+  ConstFloat x(hn.d);
+  int pos = 0;
+  for (int i = 0; i < count; ++i)
   {
-  case 'f': rs = formatFixed(&hn.d->fnum, prec ); break;
-  case 'e': rs = formatScientific(&hn.d->fnum, prec ); break;
-  case 'n': rs = formatEngineering(&hn.d->fnum, prec ); break;
-  case 'h': rs = formathexfp(&hn.d->fnum, 16, 10, HMATH_HEX_MAX_SHOWN); break;
-  case 'o': rs = formathexfp(&hn.d->fnum, 8, 10, HMATH_OCT_MAX_SHOWN); break;
-  case 'b': rs = formathexfp(&hn.d->fnum, 2, 10, HMATH_BIN_MAX_SHOWN); break;
-  case 'g': default: rs = formatGeneral(&hn.d->fnum, prec );
+    int needed = 0;
+    int j = 0;
+    int at = 0;
+    // the texts before are there only if all of them fit
+    if (pos <= size)
+      for (; j < i && (formats[j] != formats[i] || precs[j] != precs[i]); ++j)
+        at += strlen(buf + at) + 1;
+    if (pos <= size && j < i)
+    {
+      needed = strlen(buf + at) + 1;
+      if (pos + needed <= size)
+        memcpy(buf + pos, buf + at, needed);
+    }
+    else
+    {
+      FormatOutput out = { buf + pos, pos < size ? size - pos : 0, 0, false };
+      if (formatAny(out, x, formats[i], precs[i]))
+        needed = out.needed;
+      else
+      {
+        needed = 1;
+        if (pos < size)
+          buf[pos] = 0;
+      }
+    }
+    pos += needed;
   }
+  return pos;
+}
+
+/**
+ * Returns the number of decimal digits results are computed with.
+ */
+int HMath::workingPrecision()
+{
+  return h_precision;
+}
+
+/**
+ * Sets the number of decimal digits results are computed with, between
+ * DECPRECISION and MAXDECPRECISION. Constants and the math library limit
+ * are raised to match, and decimal literals are read up to this many
+ * digits. Must not be called while another thread is evaluating.
+ */
+void HMath::setWorkingPrecision( int digits )
+{
+  h_init();
+  floatmath_setprecision(digits);
+  h_precision = decprecision;
+  h_threaddigits = MATHDIGITS;
+  t_ioparams params = *getioparams(10);
+  params.maxdigits = h_precision;
+  setioparams(&params);
+}
 
-  return rs;
+/**
+ * Returns the number of decimal digits results are computed with in the
+ * calling thread.
+ */
+int HMath::evaluationPrecision()
+{
+  return HMATH_DIGITS;
+}
+
+/**
+ * Computes results in the calling thread with only the given number of
+ * decimal digits, for cheap approximations. A value of 0, or one not
+ * below the working precision, returns to the working precision.
+ * Formatting and integer division are not affected.
+ */
+void HMath::setEvaluationPrecision( int digits )
+{
+  if (digits <= 0 || digits >= h_precision)
+    digits = 0;
+  else if (digits < 2)
+    digits = 2;
+  h_evalprecision = digits;
+  h_cancelled = 0;
+}
+
+/**
+ * Returns the most leading digits an addition or subtraction in the
+ * calling thread cancelled since the last call of setEvaluationPrecision.
+ * A result of zero from non-zero operands counts as all digits.
+ */
+int HMath::cancelledDigits()
+{
+  return h_cancelled;
+}
+
+/**
+ * Returns the number of values the calling thread has created so far.
+ * Copies sharing a value do not count.
+ */
+long HMath::numberCount()
+{
+  return h_numbercount;
+}
+
+/**
+ * Returns the number of values the calling thread has created so far,
+ * that could not reuse the memory of a freed one.
+ */
+long HMath::numberAllocCount()
+{
+  return h_numberalloccount;
+}
+
+/**
+ * Returns the memory the calling thread keeps for reuse to the system.
+ * A thread that did calculations should call this before it exits.
+ */
+void HMath::releasePool()
+{
+  while (h_pool)
+  {
+    HNumberBlock* block = h_pool;
+    h_pool = block->next;
+    ::operator delete(block);
+  }
+  h_poolsize = 0;
+  bc_release_pool();
 }
 
 /**
@@ -804,7 +1463,7 @@ HNumber HMath::deg2rad( const HNumber & angle )
 HNumber HMath::e()
 {
   HNumber value;
-  float_copy(&value.d->fnum, &cExp, HMATH_EVAL_PREC);
+  float_copy(value.d->fnum(), &cExp, HMATH_EVAL_PREC);
   return value;
 }
 
@@ -814,7 +1473,7 @@ HNumber HMath::e()
 HNumber HMath::pi()
 {
   HNumber value;
-  float_copy(&value.d->fnum, &cPi, HMATH_EVAL_PREC);
+  float_copy(value.d->fnum(), &cPi, HMATH_EVAL_PREC);
   return value;
 }
 
@@ -824,7 +1483,7 @@ HNumber HMath::pi()
 HNumber HMath::phi()
 {
   HNumber value;
-  float_copy(&value.d->fnum, &cPhi, HMATH_EVAL_PREC);
+  float_copy(value.d->fnum(), &cPhi, HMATH_EVAL_PREC);
   return value;
 }
 
@@ -844,7 +1503,7 @@ HNumber HMath::nan(Error error)
  */
 HNumber HMath::max( const HNumber & n1, const HNumber & n2 )
 {
-  switch ( float_cmp(&n1.d->fnum, &n2.d->fnum) )
+  switch ( float_cmp(ConstFloat(n1.d), ConstFloat(n2.d)) )
   {
     case 0:
     case 1:  return n1;
@@ -858,7 +1517,7 @@ HNumber HMath::max( const HNumber & n1, const HNumber & n2 )
  */
 HNumber HMath::min( const HNumber & n1, const HNumber & n2 )
 {
-  switch ( float_cmp(&n1.d->fnum, &n2.d->fnum) )
+  switch ( float_cmp(ConstFloat(n1.d), ConstFloat(n2.d)) )
   {
     case 0:
     case 1:  return n2;
@@ -885,7 +1544,8 @@ HNumber HMath::round( const HNumber & n, int prec )
   if (n.isNan())
     return HMath::nan(checkNaNParam(*n.d));
   HNumber result(n);
-  floatnum rnum = &result.d->fnum;
+  result.detach();
+  floatnum rnum = result.d->fnum();
   int exp = float_getexponent(rnum);
   /* avoid exponent overflow later */
   if (prec > HMATH_WORKING_PREC && exp > 0)
@@ -909,7 +1569,8 @@ HNumber HMath::trunc( const HNumber & n, int prec )
   if (n.isNan())
     return HMath::nan(checkNaNParam(*n.d));
   HNumber result(n);
-  floatnum rnum = &result.d->fnum;
+  result.detach();
+  floatnum rnum = result.d->fnum();
   int exp = float_getexponent(rnum);
   /* avoid exponent overflow later on */
   if (prec > HMATH_WORKING_PREC && exp > 0)
@@ -953,7 +1614,8 @@ HNumber HMath::floor( const HNumber & n )
   if (n.isNan())
     return HMath::nan(checkNaNParam(*n.d));
   HNumber r(n);
-  float_roundtoint(&r.d->fnum, TOMINUSINFINITY);
+  r.detach();
+  float_roundtoint(r.d->fnum(), TOMINUSINFINITY);
   return r;
 }
 
@@ -965,7 +1627,8 @@ HNumber HMath::ceil( const HNumber & n )
   if (n.isNan())
     return HMath::nan(checkNaNParam(*n.d));
   HNumber r(n);
-  float_roundtoint(&r.d->fnum, TOPLUSINFINITY);
+  r.detach();
+  float_roundtoint(r.d->fnum(), TOPLUSINFINITY);
   return r;
 }
 
@@ -1027,6 +1690,17 @@ HNumber HMath::sqrt( const HNumber & n )
   return result;
 }
 
+/**
+ * Returns the reciprocal of the square root of n. If n is not positive,
+ * returns NaN.
+ */
+HNumber HMath::rsqrt( const HNumber & n )
+{
+  HNumber result;
+  call1Arg(result.d, n.d, float_rsqrt);
+  return result;
+}
+
 /**
  * Returns the cube root of n.
  */
@@ -1037,7 +1711,7 @@ HNumber HMath::cbrt( const HNumber & n )
   if( n.isZero() )
     return n;
   HNumber r;
-  floatnum rnum = &r.d->fnum;
+  floatnum rnum = r.d->fnum();
 
   // iterations to approximate result
   // X[i+1] = (2/3)X[i] + n / (3 * X[i]^2))
@@ -1047,7 +1721,7 @@ HNumber HMath::cbrt( const HNumber & n )
   floatstruct a, q;
   float_create(&a);
   float_create(&q);
-  float_copy(&a, &n.d->fnum, HMATH_EVAL_PREC);
+  float_copy(&a, ConstFloat(n.d), HMATH_EVAL_PREC);
   signed char sign = float_getsign(&a);
   float_abs(&a);
   int expn = float_getexponent(&a);
@@ -1079,7 +1753,7 @@ HNumber HMath::cbrt( const HNumber & n )
   float_setsign(rnum, sign);
   float_addexp(rnum, expn);
 
-  roundResult(&r.d->fnum);
+  roundResult(r.d->fnum());
   return r;
 }
 
@@ -1091,7 +1765,7 @@ HNumber HMath::raise( const HNumber & n1, int n )
   if (n1.isNan())
     return HMath::nan(checkNaNParam(*n1.d));
   HNumber r;
-  float_raisei(&r.d->fnum, &n1.d->fnum, n, HMATH_EVAL_PREC);
+  float_raisei(r.d->fnum(), ConstFloat(n1.d), n, HMATH_EVAL_PREC);
   roundSetError(r.d);
   return r;
 }
@@ -1340,7 +2014,7 @@ HNumber HMath::sgn( const HNumber & x )
   if (x.isNan())
     return HMath::nan(checkNaNParam(*x.d));
 
-  return float_getsign(&x.d->fnum);
+  return float_getsign(ConstFloat(x.d));
 }
 
 /**
@@ -1368,11 +2042,12 @@ HNumber HMath::nCr( const HNumber & n, const HNumber & r )
           && n <= 1000 && r1 <= 50 )
       return factorial(n, r2+1) / factorial(r1, 1);
     HNumber result(n);
-    floatnum rnum = &result.d->fnum;
+    result.detach();
+    floatnum rnum = result.d->fnum();
     floatstruct fn, fr;
     float_create(&fn);
     float_create(&fr);
-    float_copy(&fr, &r1.d->fnum, HMATH_EVAL_PREC);
+    float_copy(&fr, ConstFloat(r1.d), HMATH_EVAL_PREC);
     float_copy(&fn, rnum, EXACT);
     float_sub(rnum, rnum, &fr, HMATH_EVAL_PREC)
         && float_add(&fn, &fn, &c1, HMATH_EVAL_PREC)
@@ -1416,7 +2091,7 @@ HNumber HMath::factorial( const HNumber & x, const HNumber & base )
 {
   floatstruct tmp;
 
-  if (float_cmp(&c1, &base.d->fnum) == 0)
+  if (float_cmp(&c1, ConstFloat(base.d)) == 0)
   {
     HNumber result;
     call1Arg(result.d, x.d, float_factorial);
@@ -1424,9 +2099,10 @@ HNumber HMath::factorial( const HNumber & x, const HNumber & base )
   }
   float_create(&tmp);
   HNumber r(base);
-  float_sub(&tmp, &x.d->fnum, &base.d->fnum, HMATH_EVAL_PREC)
+  r.detach();
+  float_sub(&tmp, ConstFloat(x.d), ConstFloat(base.d), HMATH_EVAL_PREC)
   && float_add(&tmp, &tmp, &c1, HMATH_EVAL_PREC)
-  && float_pochhammer(&r.d->fnum, &tmp, HMATH_EVAL_PREC);
+  && float_pochhammer(r.d->fnum(), &tmp, HMATH_EVAL_PREC);
   roundSetError(r.d);
   float_free(&tmp);
   return r;
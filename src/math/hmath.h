@@ -39,10 +39,28 @@ class HNumber
   friend bool operator<=( const HNumber& l, const HNumber& r );
   friend bool operator==( const HNumber& l, const HNumber& r );
   friend bool operator!=( const HNumber& l, const HNumber& r );
+#if __cplusplus >= 201103L
+  friend HNumber operator+( HNumber&&, const HNumber& );
+  friend HNumber operator+( const HNumber&, HNumber&& );
+  friend HNumber operator+( HNumber&&, HNumber&& );
+  friend HNumber operator-( HNumber&&, const HNumber& );
+  friend HNumber operator-( const HNumber&, HNumber&& );
+  friend HNumber operator-( HNumber&&, HNumber&& );
+  friend HNumber operator*( HNumber&&, const HNumber& );
+  friend HNumber operator*( const HNumber&, HNumber&& );
+  friend HNumber operator*( HNumber&&, HNumber&& );
+  friend HNumber operator/( HNumber&&, const HNumber& );
+  friend HNumber operator/( const HNumber&, HNumber&& );
+  friend HNumber operator/( HNumber&&, HNumber&& );
+  friend HNumber operator-( HNumber&& );
+#endif
 
   public:
     HNumber();
     HNumber( const HNumber& );
+#if __cplusplus >= 201103L
+    HNumber( HNumber&& );
+#endif
     HNumber( int i );
     HNumber( const char* );
     ~HNumber();
@@ -69,6 +87,9 @@ class HNumber
     Error error() const;
 
     HNumber& operator=( const HNumber& );
+#if __cplusplus >= 201103L
+    HNumber& operator=( HNumber&& );
+#endif
     HNumber operator+( const HNumber& ) const;
     HNumber& operator+=( const HNumber& );
     HNumber& operator-=( const HNumber& );
@@ -90,6 +111,7 @@ class HNumber
   private:
     HNumberPrivate * d;
 
+    void detach();
     int compare( const HNumber & other ) const;
 };
 
@@ -98,6 +120,22 @@ class HMath
   public:
     // FORMAT
     static char * format( const HNumber & n, char format = 'g', int prec = -1 );
+    static int formatInto( const HNumber & n, char * buf, int size,
+                           char format = 'g', int prec = -1 );
+    static int formatInto( const HNumber & n, const char * formats,
+                           const int * precs, int count, char * buf, int size );
+
+    // PRECISION
+    static int workingPrecision();
+    static void setWorkingPrecision( int digits );
+    static int evaluationPrecision();
+    static void setEvaluationPrecision( int digits );
+    static int cancelledDigits();
+
+    // MEMORY
+    static long numberCount();
+    static long numberAllocCount();
+    static void releasePool();
     // CONSTANTS
     static HNumber e();
     static HNumber phi();
@@ -118,6 +156,7 @@ class HMath
     static HNumber round( const HNumber & n, int prec = 0 );
     static HNumber trunc( const HNumber & n, int prec = 0 );
     static HNumber sqrt( const HNumber & n );
+    static HNumber rsqrt( const HNumber & n );
     static HNumber cbrt( const HNumber & n );
     static HNumber raise( const HNumber & n1, int n );
     static HNumber raise( const HNumber & n1, const HNumber & n2 );
@@ -39,11 +39,15 @@
 *************************************************************************/
 
 #include "number.h"
+#include "floatconfig.h"
 
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
 #include <ctype.h>/* Prototypes needed for external utility routines. */
 
 #define bc_rt_warn rt_warn
@@ -74,7 +78,151 @@ bc_num _zero_;
 bc_num _one_;
 bc_num _two_;
 
-static bc_num _bc_Free_list = NULL;
+/* Memory pools.  The headers and digit buffers of numbers and the
+   scratch buffers of the arithmetic are recycled through caches kept
+   per thread, so the arithmetic rarely calls malloc and several
+   threads may calculate at once.  Buffers come in power of two size
+   classes from 16 bytes to 64K, larger ones are malloc'ed directly.
+   A thread caches at most bc_pool_limit bytes, anything freed beyond
+   that goes back to the system.  The limit is shared by all threads
+   and may be changed while they run, so it is read and written
+   atomically. */
+
+#if defined(__ATOMIC_RELAXED)
+#define _bc_get_limit() __atomic_load_n(&bc_pool_limit, __ATOMIC_RELAXED)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define _bc_get_limit() (*(volatile long *) &bc_pool_limit)
+#else
+#define _bc_get_limit() (bc_pool_limit)
+#endif
+
+#define POOL_MIN_SHIFT 4
+#define POOL_CLASSES 13
+
+#ifndef POOL_LIMIT
+#define POOL_LIMIT (1024*1024)
+#endif
+
+/* Precedes every pooled buffer, keeping the data aligned. */
+typedef union bc_block
+{
+  union bc_block *next;
+  int cls;
+  double align;
+} bc_block;
+
+static FLOAT_THREAD_LOCAL bc_block *_bc_pool[POOL_CLASSES];
+static FLOAT_THREAD_LOCAL bc_num _bc_Free_list = NULL;
+static FLOAT_THREAD_LOCAL long _bc_pool_size = 0;
+static FLOAT_THREAD_LOCAL long _bc_alloc_count = 0;
+static long bc_pool_limit = POOL_LIMIT;
+
+static void *
+_bc_pool_alloc (size_t size)
+{
+  bc_block *block;
+  int cls;
+
+  for (cls = 0; cls < POOL_CLASSES; cls++)
+    if (((size_t) 1 << (cls + POOL_MIN_SHIFT)) >= size)
+      break;
+  _bc_alloc_count++;
+  if (cls < POOL_CLASSES && _bc_pool[cls] != NULL)
+    {
+      block = _bc_pool[cls];
+      _bc_pool[cls] = block->next;
+      _bc_pool_size -= 1L << (cls + POOL_MIN_SHIFT);
+    }
+  else
+    {
+      if (cls < POOL_CLASSES)
+        size = (size_t) 1 << (cls + POOL_MIN_SHIFT);
+      block = (bc_block *) malloc (sizeof(bc_block) + size);
+      if (block == NULL)
+        {
+          bc_out_of_memory ();
+          return NULL;
+        }
+    }
+  block->cls = cls;
+  return block + 1;
+}
+
+static void
+_bc_pool_free (void *ptr)
+{
+  bc_block *block;
+  int cls;
+
+  if (ptr == NULL) return;
+  block = (bc_block *) ptr - 1;
+  cls = block->cls;
+  if (cls >= POOL_CLASSES
+      || _bc_pool_size + (1L << (cls + POOL_MIN_SHIFT)) > _bc_get_limit ())
+    {
+      free (block);
+      return;
+    }
+  block->next = _bc_pool[cls];
+  _bc_pool[cls] = block;
+  _bc_pool_size += 1L << (cls + POOL_MIN_SHIFT);
+}
+
+/* Sets the number of bytes a thread may keep cached for reuse and
+   returns the previous limit.  Safe to call while other threads
+   calculate, they apply the new limit to their next free. */
+
+long
+bc_set_pool_limit (limit)
+     long limit;
+{
+#if defined(__ATOMIC_RELAXED)
+  return __atomic_exchange_n (&bc_pool_limit, limit, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+  return _InterlockedExchange (&bc_pool_limit, limit);
+#else
+  long old = bc_pool_limit;
+
+  bc_pool_limit = limit;
+  return old;
+#endif
+}
+
+/* Returns all memory cached by the calling thread to the system.  A
+   thread that did calculations should call this before it exits. */
+
+void
+bc_release_pool ()
+{
+  bc_block *block;
+  bc_num num;
+  int cls;
+
+  for (cls = 0; cls < POOL_CLASSES; cls++)
+    while (_bc_pool[cls] != NULL)
+      {
+        block = _bc_pool[cls];
+        _bc_pool[cls] = block->next;
+        free (block);
+      }
+  while (_bc_Free_list != NULL)
+    {
+      num = _bc_Free_list;
+      _bc_Free_list = num->n_next;
+      free (num);
+    }
+  _bc_pool_size = 0;
+}
+
+/* Returns the number of buffers the calling thread has requested so
+   far.  Digits stored inline in a number header do not count. */
+
+long
+bc_alloc_count ()
+{
+  return _bc_alloc_count;
+}
 
 /* new_num allocates a number and sets fields to known values. */
 
@@ -87,6 +235,7 @@ bc_new_num (length, scale)
   if (_bc_Free_list != NULL) {
     temp = _bc_Free_list;
     _bc_Free_list = temp->n_next;
+    _bc_pool_size -= sizeof(bc_struct);
   } else {
     temp = (bc_num) malloc (sizeof(bc_struct));
     if (temp == NULL) bc_out_of_memory ();
@@ -95,13 +244,21 @@ bc_new_num (length, scale)
   temp->n_len = length;
   temp->n_scale = scale;
   temp->n_refs = 1;
-  temp->n_ptr = (char *) malloc (length+scale+1);
+  if (length+scale+1 <= BC_INLINE_DIGITS)
+    temp->n_ptr = temp->n_inline;
+  else
+    temp->n_ptr = (char *) _bc_pool_alloc (length+scale+1);
   if (temp->n_ptr == NULL) bc_out_of_memory();
   temp->n_value = temp->n_ptr;
   memset (temp->n_ptr, 0, length+scale);
   return temp;
 }
 
+/* The constants _zero_, _one_ and _two_ are shared by all threads and
+   live as long as the program, so their reference count is left alone. */
+
+#define BC_IMMORTAL(num) ((num) == _zero_ || (num) == _one_ || (num) == _two_)
+
 /* "Frees" a bc_num NUM.  Actually decreases reference count and only
    frees the storage if reference count is zero. */
 
@@ -110,17 +267,28 @@ bc_free_num (num)
     bc_num *num;
 {
   if (*num == NULL) return;
+  if (BC_IMMORTAL (*num)) {
+    *num = NULL;
+    return;
+  }
   (*num)->n_refs--;
   if ((*num)->n_refs == 0) {
-    if ((*num)->n_ptr)
-      free ((*num)->n_ptr);
-    (*num)->n_next = _bc_Free_list;
-    _bc_Free_list = *num;
+    if ((*num)->n_ptr && (*num)->n_ptr != (*num)->n_inline)
+      _bc_pool_free ((*num)->n_ptr);
+    if (_bc_pool_size + (long) sizeof(bc_struct) > _bc_get_limit ())
+      free (*num);
+    else {
+      (*num)->n_next = _bc_Free_list;
+      _bc_Free_list = *num;
+      _bc_pool_size += sizeof(bc_struct);
+    }
   }
   *num = NULL;
 }
 
 
+static void _bc_select_kernels (void);
+
 /* Intitialize the number package! */
 
 void
@@ -131,6 +299,7 @@ bc_init_numbers ()
   _one_->n_value[0] = 1;
   _two_  = bc_new_num (1,0);
   _two_->n_value[0] = 2;
+  _bc_select_kernels ();
 }
 
 
@@ -140,7 +309,8 @@ bc_num
 bc_copy_num (num)
      bc_num num;
 {
-  num->n_refs++;
+  if (!BC_IMMORTAL (num))
+    num->n_refs++;
   return num;
 }
 
@@ -354,6 +524,282 @@ bc_is_near_zero (num, scale)
 }
 
 
+/* Digit-wise addition and subtraction kernels.  They work on COUNT
+   digits at A and B, most significant first, put the result into R and
+   return the carry (borrow) out of the most significant digit, CARRY
+   going into the least significant one.
+
+   The vector versions add or subtract whole blocks of digits at once
+   and then resolve the carries of the block in bulk: a digit generates
+   a carry if its sum exceeds 9 (its difference is below 0) and passes
+   an incoming carry on if it is exactly 9 (exactly 0).  With one bit
+   per digit in two masks G and P, least significant digit in bit 0,
+   the carries into all digits are ((G|P) + G + CARRY) ^ P, a single
+   integer addition.  The kernels are picked at run time by what the
+   CPU supports, the scalar ones are the fallback. */
+
+static int
+_bc_digits_add_scalar (const char *a, const char *b, char *r, int count,
+                       int carry)
+{
+  int i, val;
+
+  for (i = count - 1; i >= 0; i--)
+    {
+      val = a[i] + b[i] + carry;
+      carry = val > BASE - 1;
+      r[i] = carry ? val - BASE : val;
+    }
+  return carry;
+}
+
+static int
+_bc_digits_sub_scalar (const char *a, const char *b, char *r, int count,
+                       int borrow)
+{
+  int i, val;
+
+  for (i = count - 1; i >= 0; i--)
+    {
+      val = a[i] - b[i] - borrow;
+      borrow = val < 0;
+      r[i] = borrow ? val + BASE : val;
+    }
+  return borrow;
+}
+
+static int (*_bc_digits_add) (const char *a, const char *b, char *r,
+                              int count, int carry) = _bc_digits_add_scalar;
+static int (*_bc_digits_sub) (const char *a, const char *b, char *r,
+                              int count, int borrow) = _bc_digits_sub_scalar;
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) \
+    || defined(_M_IX86)
+#if defined(__clang__) || defined(_MSC_VER) \
+    || (defined(__GNUC__) \
+        && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define BC_SIMD
+#endif
+#endif
+
+#ifdef BC_SIMD
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BC_TARGET(isa)
+#else
+#define BC_TARGET(isa) __attribute__ ((target (isa)))
+#endif
+
+/* Reverses the bit order of X. */
+
+static uint32_t
+_bc_rev32 (uint32_t x)
+{
+  x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+  x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+  x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+/* Resolves the carries of a block of BITS digits with the movemask
+   results G and P (bit i for the i-th digit in memory, the most
+   significant one first).  Returns the carries into the digits in the
+   same order and sets *CARRY to the carry out of the block. */
+
+static uint32_t
+_bc_block_carries (uint32_t g, uint32_t p, int bits, int *carry)
+{
+  uint64_t sum;
+
+  g = _bc_rev32 (g) >> (32 - bits);
+  p = _bc_rev32 (p) >> (32 - bits);
+  sum = (uint64_t) (g | p) + g + *carry;
+  *carry = (int) (sum >> bits) & 1;
+  return _bc_rev32 ((uint32_t) (sum ^ p)) >> (32 - bits);
+}
+
+BC_TARGET ("sse2") static __m128i
+_bc_expand_sse2 (uint32_t bits)
+{
+  const __m128i sel = _mm_set_epi8 ((char) 128, 64, 32, 16, 8, 4, 2, 1,
+                                    (char) 128, 64, 32, 16, 8, 4, 2, 1);
+  __m128i v;
+
+  v = _mm_cvtsi32_si128 ((int) bits);
+  v = _mm_unpacklo_epi8 (v, v);
+  v = _mm_unpacklo_epi16 (v, v);
+  v = _mm_unpacklo_epi32 (v, v);
+  return _mm_cmpeq_epi8 (_mm_and_si128 (v, sel), sel);
+}
+
+BC_TARGET ("sse2") static int
+_bc_digits_add_sse2 (const char *a, const char *b, char *r, int count,
+                     int carry)
+{
+  const __m128i nine = _mm_set1_epi8 (9), ten = _mm_set1_epi8 (10);
+  __m128i s, c;
+  uint32_t g, p;
+
+  while (count >= 16)
+    {
+      count -= 16;
+      s = _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *) (a + count)),
+                        _mm_loadu_si128 ((const __m128i *) (b + count)));
+      g = _mm_movemask_epi8 (_mm_cmpgt_epi8 (s, nine));
+      p = _mm_movemask_epi8 (_mm_cmpeq_epi8 (s, nine));
+      c = _bc_expand_sse2 (_bc_block_carries (g, p, 16, &carry));
+      s = _mm_sub_epi8 (s, c);
+      s = _mm_sub_epi8 (s, _mm_and_si128 (_mm_cmpgt_epi8 (s, nine), ten));
+      _mm_storeu_si128 ((__m128i *) (r + count), s);
+    }
+  return _bc_digits_add_scalar (a, b, r, count, carry);
+}
+
+BC_TARGET ("sse2") static int
+_bc_digits_sub_sse2 (const char *a, const char *b, char *r, int count,
+                     int borrow)
+{
+  const __m128i zero = _mm_setzero_si128 (), ten = _mm_set1_epi8 (10);
+  __m128i d, c;
+  uint32_t g, p;
+
+  while (count >= 16)
+    {
+      count -= 16;
+      d = _mm_sub_epi8 (_mm_loadu_si128 ((const __m128i *) (a + count)),
+                        _mm_loadu_si128 ((const __m128i *) (b + count)));
+      g = _mm_movemask_epi8 (_mm_cmplt_epi8 (d, zero));
+      p = _mm_movemask_epi8 (_mm_cmpeq_epi8 (d, zero));
+      c = _bc_expand_sse2 (_bc_block_carries (g, p, 16, &borrow));
+      d = _mm_add_epi8 (d, c);
+      d = _mm_add_epi8 (d, _mm_and_si128 (_mm_cmplt_epi8 (d, zero), ten));
+      _mm_storeu_si128 ((__m128i *) (r + count), d);
+    }
+  return _bc_digits_sub_scalar (a, b, r, count, borrow);
+}
+
+BC_TARGET ("avx2") static __m256i
+_bc_expand_avx2 (uint32_t bits)
+{
+  const __m256i sel = _mm256_set1_epi64x ((long long) 0x8040201008040201ULL);
+  const __m256i idx = _mm256_set_epi8 (3, 3, 3, 3, 3, 3, 3, 3,
+                                       2, 2, 2, 2, 2, 2, 2, 2,
+                                       1, 1, 1, 1, 1, 1, 1, 1,
+                                       0, 0, 0, 0, 0, 0, 0, 0);
+  __m256i v;
+
+  v = _mm256_shuffle_epi8 (_mm256_set1_epi32 ((int) bits), idx);
+  return _mm256_cmpeq_epi8 (_mm256_and_si256 (v, sel), sel);
+}
+
+BC_TARGET ("avx2") static int
+_bc_digits_add_avx2 (const char *a, const char *b, char *r, int count,
+                     int carry)
+{
+  const __m256i nine = _mm256_set1_epi8 (9), ten = _mm256_set1_epi8 (10);
+  __m256i s, c;
+  uint32_t g, p;
+
+  while (count >= 32)
+    {
+      count -= 32;
+      s = _mm256_add_epi8 (
+            _mm256_loadu_si256 ((const __m256i *) (a + count)),
+            _mm256_loadu_si256 ((const __m256i *) (b + count)));
+      g = _mm256_movemask_epi8 (_mm256_cmpgt_epi8 (s, nine));
+      p = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (s, nine));
+      c = _bc_expand_avx2 (_bc_block_carries (g, p, 32, &carry));
+      s = _mm256_sub_epi8 (s, c);
+      s = _mm256_sub_epi8 (s, _mm256_and_si256 (_mm256_cmpgt_epi8 (s, nine),
+                                                ten));
+      _mm256_storeu_si256 ((__m256i *) (r + count), s);
+    }
+  return _bc_digits_add_sse2 (a, b, r, count, carry);
+}
+
+BC_TARGET ("avx2") static int
+_bc_digits_sub_avx2 (const char *a, const char *b, char *r, int count,
+                     int borrow)
+{
+  const __m256i zero = _mm256_setzero_si256 (), ten = _mm256_set1_epi8 (10);
+  __m256i d, c;
+  uint32_t g, p;
+
+  while (count >= 32)
+    {
+      count -= 32;
+      d = _mm256_sub_epi8 (
+            _mm256_loadu_si256 ((const __m256i *) (a + count)),
+            _mm256_loadu_si256 ((const __m256i *) (b + count)));
+      g = _mm256_movemask_epi8 (_mm256_cmpgt_epi8 (zero, d));
+      p = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (d, zero));
+      c = _bc_expand_avx2 (_bc_block_carries (g, p, 32, &borrow));
+      d = _mm256_add_epi8 (d, c);
+      d = _mm256_add_epi8 (d, _mm256_and_si256 (_mm256_cmpgt_epi8 (zero, d),
+                                                ten));
+      _mm256_storeu_si256 ((__m256i *) (r + count), d);
+    }
+  return _bc_digits_sub_sse2 (a, b, r, count, borrow);
+}
+
+/* Sets *SSE2 and *AVX2 to whether the CPU and the operating system
+   support these instruction sets. */
+
+static void
+_bc_cpu_features (int *sse2, int *avx2)
+{
+#if defined(_MSC_VER)
+  int regs[4];
+
+  __cpuid (regs, 0);
+  if (regs[0] < 1)
+    {
+      *sse2 = *avx2 = 0;
+      return;
+    }
+  __cpuid (regs, 1);
+  *sse2 = (regs[3] >> 26) & 1;
+  *avx2 = 0;
+  if (((regs[2] >> 27) & 1) && (_xgetbv (0) & 6) == 6)
+    {
+      __cpuidex (regs, 7, 0);
+      *avx2 = (regs[1] >> 5) & 1;
+    }
+#else
+  __builtin_cpu_init ();
+  *sse2 = __builtin_cpu_supports ("sse2");
+  *avx2 = __builtin_cpu_supports ("avx2");
+#endif
+}
+
+#endif /* BC_SIMD */
+
+/* Picks the fastest digit kernels for this CPU. */
+
+static void
+_bc_select_kernels (void)
+{
+#ifdef BC_SIMD
+  int sse2, avx2;
+
+  _bc_cpu_features (&sse2, &avx2);
+  if (avx2)
+    {
+      _bc_digits_add = _bc_digits_add_avx2;
+      _bc_digits_sub = _bc_digits_sub_avx2;
+    }
+  else if (sse2)
+    {
+      _bc_digits_add = _bc_digits_add_sse2;
+      _bc_digits_sub = _bc_digits_sub_sse2;
+    }
+#endif
+}
+
+
 /* Perform addition: N1 is added to N2 and the value is
    returned.  The signs of N1 and N2 are ignored.
    SCALE_MIN is to set the minimum scale of the result. */
@@ -403,26 +849,20 @@ _bc_do_add (n1, n2, scale_min)
   /* Now add the remaining fraction part and equal size integer parts. */
   n1bytes += n1->n_len;
   n2bytes += n2->n_len;
-  carry = 0;
-  while ((n1bytes > 0) && (n2bytes > 0))
-    {
-      *sumptr = *n1ptr-- + *n2ptr-- + carry;
-      if (*sumptr > (BASE-1))
-	{
-	   carry = 1;
-	   *sumptr -= BASE;
-	}
-      else
-	carry = 0;
-      sumptr--;
-      n1bytes--;
-      n2bytes--;
-    }
-
-  /* Now add carry the longer integer part. */
+  count = MIN (n1bytes, n2bytes);
+  carry = _bc_digits_add (n1ptr - count + 1, n2ptr - count + 1,
+			  sumptr - count + 1, count, 0);
+  n1ptr -= count;
+  n2ptr -= count;
+  sumptr -= count;
+  n1bytes -= count;
+  n2bytes -= count;
+
+  /* Now add carry the longer integer part, once the carry is gone the
+     rest is a copy. */
   if (n1bytes == 0)
     { n1bytes = n2bytes; n1ptr = n2ptr; }
-  while (n1bytes-- > 0)
+  while (n1bytes > 0 && carry)
     {
       *sumptr = *n1ptr-- + carry;
       if (*sumptr > (BASE-1))
@@ -433,6 +873,12 @@ _bc_do_add (n1, n2, scale_min)
       else
 	carry = 0;
       sumptr--;
+      n1bytes--;
+    }
+  if (n1bytes > 0)
+    {
+      memcpy (sumptr - n1bytes + 1, n1ptr - n1bytes + 1, n1bytes);
+      sumptr -= n1bytes;
     }
 
   /* Set final carry. */
@@ -510,9 +956,18 @@ _bc_do_sub (n1, n2, scale_min)
 
   /* Now do the equal length scale and integer parts. */
 
-  for (count = 0; count < min_len + min_scale; count++)
+  count = min_len + min_scale;
+  borrow = _bc_digits_sub (n1ptr - count + 1, n2ptr - count + 1,
+			   diffptr - count + 1, count, borrow);
+  n1ptr -= count;
+  n2ptr -= count;
+  diffptr -= count;
+
+  /* If n1 has more digits then n2, we now do that subtract.  Once the
+     borrow is gone the rest is a copy. */
+  for (count = diff_len - min_len; count > 0 && borrow; count--)
     {
-      val = *n1ptr-- - *n2ptr-- - borrow;
+      val = *n1ptr-- - borrow;
       if (val < 0)
 	{
 	  val += BASE;
@@ -522,23 +977,8 @@ _bc_do_sub (n1, n2, scale_min)
 	borrow = 0;
       *diffptr-- = val;
     }
-
-  /* If n1 has more digits then n2, we now do that subtract. */
-  if (diff_len != min_len)
-    {
-      for (count = diff_len - min_len; count > 0; count--)
-	{
-	  val = *n1ptr-- - borrow;
-	  if (val < 0)
-	    {
-	      val += BASE;
-	      borrow = 1;
-	    }
-	  else
-	    borrow = 0;
-	  *diffptr-- = val;
-	}
-    }
+  if (count > 0)
+    memcpy (diffptr - count + 1, n1ptr - count + 1, count);
 
   /* Clean up and return. */
   _bc_rm_leading_zeros (diff);
@@ -643,236 +1083,1238 @@ bc_add (n1, n2, result, scale_min)
   *result = sum;
 }
 
-/* Recursive vs non-recursive multiply crossover ranges. */
+/* Multiplication and division work on machine word limbs.  The digits
+   of a bc_num are packed into limbs holding LIMB_DIGITS decimal digits
+   each (base 10^9), least significant limb first, so that the inner
+   loops process nine digits per step.  Storage of a bc_num stays at
+   one digit per char, since the higher layers move the decimal point
+   and patch single digits in place. */
+
+typedef uint32_t bc_limb;
+typedef uint64_t bc_dlimb;
+
+#define LIMB_DIGITS 9
+#define LIMB_BASE 1000000000U
+
+/* Limb buffers up to this size are taken from the stack. */
+#define LIMB_STACK 64
+
+/* Multiply crossover ranges, in digits.  Operands shorter than
+   MUL_BASE_DIGITS are multiplied by the base case, longer ones by
+   Karatsuba, Toom-3 from MUL_TOOM3_DIGITS and by a number theoretic
+   transform from MUL_NTT_DIGITS on. */
 #if defined(MULDIGITS)
 #include "muldigits.h"
 #else
-#define MUL_BASE_DIGITS 80
+#define MUL_BASE_DIGITS 180
+#endif
+
+#ifndef MUL_TOOM3_DIGITS
+#define MUL_TOOM3_DIGITS 2700
+#endif
+#ifndef MUL_NTT_DIGITS
+#define MUL_NTT_DIGITS 18000
 #endif
 
 int mul_base_digits = MUL_BASE_DIGITS;
-#define MUL_SMALL_DIGITS mul_base_digits/4
+int mul_toom3_digits = MUL_TOOM3_DIGITS;
+int mul_ntt_digits = MUL_NTT_DIGITS;
 
-/* Multiply utility routines */
+/* The largest operands bc_tune_multiply tries. */
+#define TUNE_MAX_LIMBS 8000
 
-static bc_num
-new_sub_num (length, scale, value)
-     int length, scale;
-     char *value;
-{
-  bc_num temp;
+/* Products with a shorter operand of at least this many digits are
+   split between threads, see bc_set_mul_threads. */
+#ifndef MUL_THREAD_DIGITS
+#define MUL_THREAD_DIGITS 20000
+#endif
 
-  if (_bc_Free_list != NULL) {
-    temp = _bc_Free_list;
-    _bc_Free_list = temp->n_next;
-  } else {
-    temp = (bc_num) malloc (sizeof(bc_struct));
-    if (temp == NULL) bc_out_of_memory ();
-  }
-  temp->n_sign = PLUS;
-  temp->n_len = length;
-  temp->n_scale = scale;
-  temp->n_refs = 1;
-  temp->n_ptr = NULL;
-  temp->n_value = value;
-  return temp;
+int mul_thread_digits = MUL_THREAD_DIGITS;
+
+/* Divisions with a divisor and a quotient of at least this many digits
+   go through a Newton reciprocal instead of long division. */
+#ifndef DIV_NEWTON_DIGITS
+#define DIV_NEWTON_DIGITS 4500
+#endif
+
+int div_newton_digits = DIV_NEWTON_DIGITS;
+
+static int
+_bc_limb_count (int digits)
+{
+  return (digits + LIMB_DIGITS - 1) / LIMB_DIGITS;
 }
 
-static void
-_bc_simp_mul (bc_num n1, int n1len, bc_num n2, int n2len, bc_num *prod,
-              int full_scale)
+static bc_limb *
+_bc_new_limbs (int count)
 {
-  char *n1ptr, *n2ptr, *pvptr;
-  char *n1end, *n2end;         /* To the end of n1 and n2. */
-  int indx, sum;
-  const int prodlen = n1len + n2len + 1;
+  bc_limb *limbs;
 
-  (void)full_scale;
+  limbs = (bc_limb *) _bc_pool_alloc (count * sizeof(bc_limb) + 1);
+  if (limbs == NULL) bc_out_of_memory ();
+  return limbs;
+}
 
-  *prod = bc_new_num (prodlen, 0);
+/* Packs the LEN digits at DIGITS, followed by ZEROS implicit zero
+   digits, into COUNT limbs.  Limbs beyond the digits are cleared. */
 
-  n1end = (char *) (n1->n_value + n1len - 1);
-  n2end = (char *) (n2->n_value + n2len - 1);
-  pvptr = (char *) ((*prod)->n_value + prodlen - 1);
-  sum = 0;
+static void
+_bc_pack (const char *digits, int len, int zeros, bc_limb *limbs, int count)
+{
+  int i, pos, stop;
+  bc_limb val;
 
-  /* Here is the loop... */
-  for (indx = 0; indx < prodlen-1; indx++)
+  for (i = 0; i < zeros / LIMB_DIGITS && i < count; i++)
+    limbs[i] = 0;
+  pos = len;
+  if (i < count && zeros % LIMB_DIGITS != 0)
+    {
+      /* A limb straddling the implicit zeros. */
+      stop = MAX(0, pos - (LIMB_DIGITS - zeros % LIMB_DIGITS));
+      val = 0;
+      while (stop < pos)
+        val = val*BASE + digits[stop++];
+      for (stop = zeros % LIMB_DIGITS; stop > 0; stop--)
+        val *= BASE;
+      limbs[i++] = val;
+      pos = MAX(0, pos - (LIMB_DIGITS - zeros % LIMB_DIGITS));
+    }
+  for (; i < count; i++)
     {
-      n1ptr = (char *) (n1end - MAX(0, indx-n2len+1));
-      n2ptr = (char *) (n2end - MIN(indx, n2len-1));
-      while ((n1ptr >= n1->n_value) && (n2ptr <= n2end))
-	sum += *n1ptr-- * *n2ptr++;
-      *pvptr-- = sum % BASE;
-      sum = sum / BASE;
+      stop = MAX(0, pos - LIMB_DIGITS);
+      val = 0;
+      while (stop < pos)
+        val = val*BASE + digits[stop++];
+      pos = MAX(0, pos - LIMB_DIGITS);
+      limbs[i] = val;
     }
-  *pvptr = sum;
 }
 
+/* Unpacks COUNT limbs into the LEN digits at DIGITS.  Missing limbs
+   are taken as zero, surplus limbs must be zero. */
 
-/* A special adder/subtractor for the recursive divide and conquer
-   multiply algorithm.  Note: if sub is called, accum must
-   be larger that what is being subtracted.  Also, accum and val
-   must have n_scale = 0.  (e.g. they must look like integers. *) */
 static void
-_bc_shift_addsub (bc_num accum, bc_num val, int shift, int sub)
+_bc_unpack (const bc_limb *limbs, int count, char *digits, int len)
 {
-  signed char *accp, *valp;
-  int  count, carry;
+  char *dptr;
+  bc_limb val;
+  int i, j;
+
+  dptr = digits + len;
+  for (i = 0; i < count && dptr > digits; i++)
+    {
+      val = limbs[i];
+      for (j = 0; j < LIMB_DIGITS && dptr > digits; j++)
+        {
+          *--dptr = val % BASE;
+          val /= BASE;
+        }
+    }
+  if (dptr > digits)
+    memset (digits, 0, dptr - digits);
+}
+
+/* Returns the length of the COUNT limbs at LIMBS without leading zero
+   limbs. */
 
-  count = val->n_len;
-  if (val->n_value[0] == 0)
+static int
+_bc_limb_trim (const bc_limb *limbs, int count)
+{
+  while (count > 0 && limbs[count-1] == 0)
     count--;
-  assert (accum->n_len+accum->n_scale >= shift+count);
+  return count;
+}
 
-  /* Set up pointers and others */
-  accp = (signed char *)(accum->n_value +
-			 accum->n_len + accum->n_scale - shift - 1);
-  valp = (signed char *)(val->n_value + val->n_len - 1);
-  carry = 0;
+/* R = A + B, where ALEN >= BLEN.  R has room for ALEN+1 limbs and may
+   be the same as A.  Returns the number of limbs in R. */
 
-  if (sub) {
-    /* Subtraction, carry is really borrow. */
-    while (count--) {
-      *accp -= *valp-- + carry;
-      if (*accp < 0) {
-	carry = 1;
-        *accp-- += BASE;
-      } else {
-	carry = 0;
-	accp--;
-      }
-    }
-    while (carry) {
-      *accp -= carry;
-      if (*accp < 0)
-	*accp-- += BASE;
-      else
-	carry = 0;
-    }
-  } else {
-    /* Addition */
-    while (count--) {
-      *accp += *valp-- + carry;
-      if (*accp > (BASE-1)) {
-	carry = 1;
-        *accp-- -= BASE;
-      } else {
-	carry = 0;
-	accp--;
-      }
+static int
+_bc_limb_add (const bc_limb *a, int alen, const bc_limb *b, int blen,
+              bc_limb *r)
+{
+  bc_limb carry, sum;
+  int i;
+
+  carry = 0;
+  for (i = 0; i < blen; i++)
+    {
+      sum = a[i] + b[i] + carry;
+      carry = sum >= LIMB_BASE;
+      r[i] = carry ? sum - LIMB_BASE : sum;
     }
-    while (carry) {
-      *accp += carry;
-      if (*accp > (BASE-1))
-	*accp-- -= BASE;
-      else
-	carry = 0;
+  for (; i < alen; i++)
+    {
+      sum = a[i] + carry;
+      carry = sum >= LIMB_BASE;
+      r[i] = carry ? sum - LIMB_BASE : sum;
     }
-  }
+  r[i] = carry;
+  return alen + carry;
 }
 
-/* Recursive divide and conquer multiply algorithm.
-   Based on
-   Let u = u0 + u1*(b^n)
-   Let v = v0 + v1*(b^n)
-   Then uv = (B^2n+B^n)*u1*v1 + B^n*(u1-u0)*(v0-v1) + (B^n+1)*u0*v0
+/* ACC += VAL, the carry is propagated through ACC.  ACC must be large
+   enough to hold the sum. */
 
-   B is the base of storage, number of digits in u1,u0 close to equal.
-*/
 static void
-_bc_rec_mul (bc_num u, int ulen, bc_num v, int vlen, bc_num *prod,
-	     int full_scale)
+_bc_limb_addto (bc_limb *acc, const bc_limb *val, int vlen)
 {
-  bc_num u0, u1, v0, v1;
-  /*int u0len, v0len;*/
-  bc_num m1, m2, m3, d1, d2;
-  int n, prodlen, m1zero;
-  int d1len, d2len;
-
-  /* Base case? */
-  if ((ulen+vlen) < mul_base_digits
-      || ulen < MUL_SMALL_DIGITS
-      || vlen < MUL_SMALL_DIGITS ) {
-    _bc_simp_mul (u, ulen, v, vlen, prod, full_scale);
-    return;
-  }
-
-  /* Calculate n -- the u and v split point in digits. */
-  n = (MAX(ulen, vlen)+1) / 2;
+  bc_limb carry, sum;
+  int i;
 
-  /* Split u and v. */
-  if (ulen < n) {
-    u1 = bc_copy_num (_zero_);
-    u0 = new_sub_num (ulen,0, u->n_value);
-  } else {
-    u1 = new_sub_num (ulen-n, 0, u->n_value);
-    u0 = new_sub_num (n, 0, u->n_value+ulen-n);
-  }
-  if (vlen < n) {
-    v1 = bc_copy_num (_zero_);
-    v0 = new_sub_num (vlen,0, v->n_value);
-  } else {
-    v1 = new_sub_num (vlen-n, 0, v->n_value);
-    v0 = new_sub_num (n, 0, v->n_value+vlen-n);
+  carry = 0;
+  for (i = 0; i < vlen; i++)
+    {
+      sum = acc[i] + val[i] + carry;
+      carry = sum >= LIMB_BASE;
+      acc[i] = carry ? sum - LIMB_BASE : sum;
     }
-  _bc_rm_leading_zeros (u1);
-  _bc_rm_leading_zeros (u0);
-  /*u0len = u0->n_len;*/
-  _bc_rm_leading_zeros (v1);
-  _bc_rm_leading_zeros (v0);
-  /*v0len = v0->n_len;*/
-
-  m1zero = bc_is_zero(u1) || bc_is_zero(v1);
-
-  /* Calculate sub results ... */
+  for (; carry; i++)
+    {
+      sum = acc[i] + 1;
+      carry = sum >= LIMB_BASE;
+      acc[i] = carry ? 0 : sum;
+    }
+}
 
-  bc_init_num(&d1);
-  bc_init_num(&d2);
-  bc_sub (u1, u0, &d1, 0);
-  d1len = d1->n_len;
-  bc_sub (v0, v1, &d2, 0);
-  d2len = d2->n_len;
+/* ACC -= VAL, the borrow is propagated through ACC.  ACC must be larger
+   than VAL. */
 
+static void
+_bc_limb_subfrom (bc_limb *acc, const bc_limb *val, int vlen)
+{
+  bc_limb borrow, diff;
+  int i;
+
+  borrow = 0;
+  for (i = 0; i < vlen; i++)
+    {
+      diff = val[i] + borrow;
+      borrow = acc[i] < diff;
+      acc[i] = borrow ? acc[i] + LIMB_BASE - diff : acc[i] - diff;
+    }
+  for (; borrow; i++)
+    {
+      borrow = acc[i] == 0;
+      acc[i] = borrow ? LIMB_BASE - 1 : acc[i] - 1;
+    }
+}
+
+/* Schoolbook multiply.  PROD gets ULEN+VLEN limbs. */
+
+static void
+_bc_simp_mul (const bc_limb *u, int ulen, const bc_limb *v, int vlen,
+              bc_limb *prod)
+{
+  bc_dlimb acc;
+  bc_limb carry, ui;
+  int i, j;
+
+  memset (prod, 0, (ulen + vlen) * sizeof(bc_limb));
+  for (i = 0; i < ulen; i++)
+    {
+      ui = u[i];
+      if (ui == 0)
+        continue;
+      carry = 0;
+      for (j = 0; j < vlen; j++)
+        {
+          acc = (bc_dlimb) ui * v[j] + prod[i+j] + carry;
+          carry = (bc_limb) (acc / LIMB_BASE);
+          prod[i+j] = (bc_limb) (acc - (bc_dlimb) carry * LIMB_BASE);
+        }
+      prod[i+vlen] = carry;
+    }
+}
+
+/* Schoolbook square.  Every product u[i]*u[j] with i < j is formed
+   once and doubled afterwards, then the squares u[i]*u[i] are added,
+   which is about half the work of _bc_simp_mul.  PROD gets 2*ULEN
+   limbs. */
+
+static void
+_bc_simp_sqr (const bc_limb *u, int ulen, bc_limb *prod)
+{
+  bc_dlimb acc;
+  bc_limb carry, ui;
+  int i, j;
+
+  memset (prod, 0, 2 * ulen * sizeof(bc_limb));
+  for (i = 0; i < ulen - 1; i++)
+    {
+      ui = u[i];
+      if (ui == 0)
+        continue;
+      carry = 0;
+      for (j = i + 1; j < ulen; j++)
+        {
+          acc = (bc_dlimb) ui * u[j] + prod[i+j] + carry;
+          carry = (bc_limb) (acc / LIMB_BASE);
+          prod[i+j] = (bc_limb) (acc - (bc_dlimb) carry * LIMB_BASE);
+        }
+      prod[i+ulen] = carry;
+    }
+
+  carry = 0;
+  for (i = 0; i < ulen; i++)
+    {
+      acc = (bc_dlimb) u[i] * u[i] + 2 * (bc_dlimb) prod[2*i] + carry;
+      carry = (bc_limb) (acc / LIMB_BASE);
+      prod[2*i] = (bc_limb) (acc - (bc_dlimb) carry * LIMB_BASE);
+      acc = 2 * (bc_dlimb) prod[2*i+1] + carry;
+      carry = (bc_limb) (acc / LIMB_BASE);
+      prod[2*i+1] = (bc_limb) (acc - (bc_dlimb) carry * LIMB_BASE);
+    }
+}
+
+static void _bc_rec_mul (const bc_limb *u, int ulen, const bc_limb *v,
+                         int vlen, bc_limb *prod);
+
+/* Parallel multiplication.  After bc_set_mul_threads (N) with N > 1,
+   products of operands with at least mul_thread_digits digits hand
+   their independent parts, the sub products of Karatsuba and Toom-3
+   and the transforms of the NTT, to a pool of N-1 worker threads.  A
+   thread waiting for such a task runs queued tasks in the meantime, so
+   idle threads take over whatever work is left.  Every task writes
+   only its own limbs, the result does not depend on the scheduling. */
+
+#if defined(_WIN32)
+#include <windows.h>
+typedef CRITICAL_SECTION bc_mutex;
+typedef CONDITION_VARIABLE bc_cond;
+typedef HANDLE bc_thread;
+#define bc_mutex_init(m) InitializeCriticalSection (m)
+#define bc_mutex_lock(m) EnterCriticalSection (m)
+#define bc_mutex_unlock(m) LeaveCriticalSection (m)
+#define bc_cond_init(c) InitializeConditionVariable (c)
+#define bc_cond_wait(c, m) SleepConditionVariableCS (c, m, INFINITE)
+#define bc_cond_signal(c) WakeConditionVariable (c)
+#define bc_cond_broadcast(c) WakeAllConditionVariable (c)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t bc_mutex;
+typedef pthread_cond_t bc_cond;
+typedef pthread_t bc_thread;
+#define bc_mutex_init(m) pthread_mutex_init (m, NULL)
+#define bc_mutex_lock(m) pthread_mutex_lock (m)
+#define bc_mutex_unlock(m) pthread_mutex_unlock (m)
+#define bc_cond_init(c) pthread_cond_init (c, NULL)
+#define bc_cond_wait(c, m) pthread_cond_wait (c, m)
+#define bc_cond_signal(c) pthread_cond_signal (c)
+#define bc_cond_broadcast(c) pthread_cond_broadcast (c)
+#endif
+
+/* Must be a power of 2. */
+#define BC_MAX_THREADS 64
+
+/* A unit of work.  The structures describing the work embed a bc_task
+   as their first member. */
+
+typedef struct bc_task
+{
+  void (*run) (struct bc_task *task);
+  int queued;
+  int done;
+  struct bc_task *next;
+} bc_task;
+
+static int _bc_workers = 0;
+static int _bc_stopping = 0;
+static bc_task *_bc_task_queue = NULL;
+static bc_thread _bc_worker_threads[BC_MAX_THREADS];
+static bc_mutex _bc_task_lock;
+static bc_cond _bc_task_cond;	/* A task was queued. */
+static bc_cond _bc_done_cond;	/* A task has finished. */
+
+/* Runs the queued task at the head of the queue.  Called and returns
+   with _bc_task_lock held. */
+
+static void
+_bc_task_run_queued (void)
+{
+  bc_task *task;
+
+  task = _bc_task_queue;
+  _bc_task_queue = task->next;
+  bc_mutex_unlock (&_bc_task_lock);
+  task->run (task);
+  bc_mutex_lock (&_bc_task_lock);
+  task->done = 1;
+  bc_cond_broadcast (&_bc_done_cond);
+}
+
+static void
+_bc_worker (void)
+{
+  bc_mutex_lock (&_bc_task_lock);
+  for (;;)
+    {
+      while (_bc_task_queue == NULL && !_bc_stopping)
+        bc_cond_wait (&_bc_task_cond, &_bc_task_lock);
+      if (_bc_task_queue == NULL)
+        break;
+      _bc_task_run_queued ();
+    }
+  bc_mutex_unlock (&_bc_task_lock);
+  bc_release_pool ();
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI
+_bc_worker_main (LPVOID arg)
+{
+  (void) arg;
+  _bc_worker ();
+  return 0;
+}
+#else
+static void *
+_bc_worker_main (void *arg)
+{
+  (void) arg;
+  _bc_worker ();
+  return NULL;
+}
+#endif
+
+/* Sets the number of threads a single multiplication may use and
+   returns the previous number.  1, the default, keeps everything on
+   the calling thread.  Must not be called while a multiplication is
+   in progress. */
+
+int
+bc_set_mul_threads (threads)
+     int threads;
+{
+  static int initialized = 0;
+  int old, i;
+
+  old = _bc_workers + 1;
+  threads = MAX(1, MIN(threads, BC_MAX_THREADS));
+  if (threads == old)
+    return old;
+  if (!initialized)
+    {
+      bc_mutex_init (&_bc_task_lock);
+      bc_cond_init (&_bc_task_cond);
+      bc_cond_init (&_bc_done_cond);
+      initialized = 1;
+    }
+
+  /* Stop the current workers ... */
+  bc_mutex_lock (&_bc_task_lock);
+  _bc_stopping = 1;
+  bc_cond_broadcast (&_bc_task_cond);
+  bc_mutex_unlock (&_bc_task_lock);
+  for (i = 0; i < _bc_workers; i++)
+    {
+#if defined(_WIN32)
+      WaitForSingleObject (_bc_worker_threads[i], INFINITE);
+      CloseHandle (_bc_worker_threads[i]);
+#else
+      pthread_join (_bc_worker_threads[i], NULL);
+#endif
+    }
+  _bc_stopping = 0;
+
+  /* ... and start the new ones. */
+  for (_bc_workers = 0; _bc_workers < threads - 1; _bc_workers++)
+    {
+#if defined(_WIN32)
+      _bc_worker_threads[_bc_workers]
+        = CreateThread (NULL, 0, _bc_worker_main, NULL, 0, NULL);
+      if (_bc_worker_threads[_bc_workers] == NULL)
+        break;
+#else
+      if (pthread_create (&_bc_worker_threads[_bc_workers], NULL,
+                          _bc_worker_main, NULL) != 0)
+        break;
+#endif
+    }
+  return old;
+}
+
+/* Runs TASK, on another thread if PAR is set. */
+
+static void
+_bc_task_fork (bc_task *task, int par)
+{
+  task->queued = par;
+  task->done = 0;
+  if (!par)
+    {
+      task->run (task);
+      return;
+    }
+  bc_mutex_lock (&_bc_task_lock);
+  task->next = _bc_task_queue;
+  _bc_task_queue = task;
+  bc_cond_signal (&_bc_task_cond);
+  bc_mutex_unlock (&_bc_task_lock);
+}
+
+/* Waits until TASK has finished, running queued tasks meanwhile. */
+
+static void
+_bc_task_join (bc_task *task)
+{
+  if (!task->queued)
+    return;
+  bc_mutex_lock (&_bc_task_lock);
+  while (!task->done)
+    {
+      if (_bc_task_queue != NULL)
+        _bc_task_run_queued ();
+      else
+        bc_cond_wait (&_bc_done_cond, &_bc_task_lock);
+    }
+  bc_mutex_unlock (&_bc_task_lock);
+}
+
+/* Tells whether the sub products of a product with a shorter operand
+   of VLEN limbs are worth a thread. */
+
+static int
+_bc_mul_parallel (int vlen)
+{
+  return _bc_workers > 0 && vlen >= mul_thread_digits / LIMB_DIGITS;
+}
+
+/* A product U*V to be put into PROD.  The NTT jobs also use N, K and
+   PAR. */
+
+typedef struct
+{
+  bc_task task;
+  const bc_limb *u, *v;
+  int ulen, vlen;
+  bc_limb *prod;
+  int n, k, par;
+} bc_mul_job;
+
+static void
+_bc_mul_job_run (bc_task *task)
+{
+  bc_mul_job *job = (bc_mul_job *) task;
+
+  _bc_rec_mul (job->u, job->ulen, job->v, job->vlen, job->prod);
+}
+
+static void
+_bc_mul_fork (bc_mul_job *job, const bc_limb *u, int ulen, const bc_limb *v,
+              int vlen, bc_limb *prod, int par)
+{
+  job->task.run = _bc_mul_job_run;
+  job->u = u;
+  job->ulen = ulen;
+  job->v = v;
+  job->vlen = vlen;
+  job->prod = prod;
+  _bc_task_fork (&job->task, par);
+}
+
+/* Karatsuba multiply.
+   Based on
+   Let u = u0 + u1*(b^n)
+   Let v = v0 + v1*(b^n)
+   Then uv = (b^2n)*u1*v1 + b^n*((u0+u1)*(v0+v1) - u1*v1 - u0*v0) + u0*v0
+
+   b is the limb base, number of limbs in u1,u0 close to equal, that is
+   ULEN >= VLEN > N.  PROD gets ULEN+VLEN limbs.  When squaring, u1+u0
+   is formed once and all three sub products are squares again. */
+
+static void
+_bc_kara_mul (const bc_limb *u, int ulen, const bc_limb *v, int vlen,
+              int n, bc_limb *prod)
+{
+  bc_mul_job jobs[2];
+  bc_limb *tmp, *su, *sv, *mid;
+  int sulen, svlen, midlen, par;
+
+  /* Calculate sub results ... */
+  tmp = _bc_new_limbs (4 * n + 4);
+  su = tmp;
+  sv = tmp + n + 1;
+  mid = tmp + 2 * n + 2;
+  sulen = _bc_limb_add (u, n, u + n, ulen - n, su);
+  if (u == v && ulen == vlen)
+    {
+      sv = su;
+      svlen = sulen;
+    }
+  else
+    svlen = _bc_limb_add (v, n, v + n, vlen - n, sv);
 
   /* Do recursive multiplies and shifted adds. */
-  if (m1zero)
-    m1 = bc_copy_num (_zero_);
+  par = _bc_mul_parallel (vlen);
+  _bc_mul_fork (&jobs[0], u, n, v, n, prod, par);
+  _bc_mul_fork (&jobs[1], u + n, ulen - n, v + n, vlen - n, prod + 2 * n,
+                par);
+  _bc_rec_mul (su, sulen, sv, svlen, mid);
+  _bc_task_join (&jobs[0].task);
+  _bc_task_join (&jobs[1].task);
+  midlen = _bc_limb_trim (mid, sulen + svlen);
+  _bc_limb_subfrom (mid, prod, _bc_limb_trim (prod, 2 * n));
+  _bc_limb_subfrom (mid, prod + 2 * n,
+                    _bc_limb_trim (prod + 2 * n, ulen + vlen - 2 * n));
+  _bc_limb_addto (prod + n, mid, midlen);
+
+  /* Now clean up! */
+  _bc_pool_free (tmp);
+}
+
+/* Signed limb numbers, needed for the Toom-3 interpolation.  The
+   magnitude is kept in D, LEN limbs without leading zero limbs. */
+
+typedef struct
+{
+  bc_limb *d;
+  int len;
+  int neg;
+} bc_slimbs;
+
+/* Compares the magnitudes of A and B. */
+
+static int
+_bc_limb_cmp (const bc_limb *a, int alen, const bc_limb *b, int blen)
+{
+  if (alen != blen)
+    return alen > blen ? 1 : -1;
+  while (alen-- > 0)
+    if (a[alen] != b[alen])
+      return a[alen] > b[alen] ? 1 : -1;
+  return 0;
+}
+
+/* R = A - B, where A >= B.  R may be the same as A or B.  Returns the
+   number of limbs in R. */
+
+static int
+_bc_limb_sub (const bc_limb *a, int alen, const bc_limb *b, int blen,
+              bc_limb *r)
+{
+  bc_limb borrow, diff;
+  int i;
+
+  borrow = 0;
+  for (i = 0; i < alen; i++)
+    {
+      diff = (i < blen ? b[i] : 0) + borrow;
+      borrow = a[i] < diff;
+      r[i] = borrow ? a[i] + LIMB_BASE - diff : a[i] - diff;
+    }
+  return _bc_limb_trim (r, alen);
+}
+
+/* R = A + B, or R = A - B if SUB is set.  R may be the same as A or B
+   and must have room for MAX(A->len, B->len)+1 limbs. */
+
+static void
+_bc_slimbs_addsub (bc_slimbs *r, const bc_slimbs *a, const bc_slimbs *b,
+                   int sub)
+{
+  int bneg = b->neg ^ sub;
+
+  if (a->neg == bneg)
+    {
+      if (a->len >= b->len)
+        r->len = _bc_limb_add (a->d, a->len, b->d, b->len, r->d);
+      else
+        r->len = _bc_limb_add (b->d, b->len, a->d, a->len, r->d);
+      r->neg = bneg;
+    }
+  else if (_bc_limb_cmp (a->d, a->len, b->d, b->len) >= 0)
+    {
+      r->neg = a->neg;
+      r->len = _bc_limb_sub (a->d, a->len, b->d, b->len, r->d);
+    }
   else
-    _bc_rec_mul (u1, u1->n_len, v1, v1->n_len, &m1, 0);
+    {
+      r->neg = bneg;
+      r->len = _bc_limb_sub (b->d, b->len, a->d, a->len, r->d);
+    }
+  if (r->len == 0)
+    r->neg = 0;
+}
+
+/* Divides A exactly by the small number D in place. */
+
+static void
+_bc_slimbs_divexact (bc_slimbs *a, bc_limb d)
+{
+  bc_dlimb rem;
+  int i;
+
+  rem = 0;
+  for (i = a->len - 1; i >= 0; i--)
+    {
+      rem = rem * LIMB_BASE + a->d[i];
+      a->d[i] = (bc_limb) (rem / d);
+      rem -= (bc_dlimb) a->d[i] * d;
+    }
+  a->len = _bc_limb_trim (a->d, a->len);
+}
+
+/* Multiplies A by the small number M in place. */
+
+static void
+_bc_slimbs_mul1 (bc_slimbs *a, bc_limb m)
+{
+  bc_dlimb acc;
+  bc_limb carry;
+  int i;
+
+  carry = 0;
+  for (i = 0; i < a->len; i++)
+    {
+      acc = (bc_dlimb) a->d[i] * m + carry;
+      carry = (bc_limb) (acc / LIMB_BASE);
+      a->d[i] = (bc_limb) (acc - (bc_dlimb) carry * LIMB_BASE);
+    }
+  if (carry != 0)
+    a->d[a->len++] = carry;
+}
+
+/* Starts R = U * V for signed U and V, on another thread if PAR is
+   set.  R is complete after _bc_slimbs_join with the same JOB.  R->d
+   needs U->len+V->len limbs. */
+
+static void
+_bc_slimbs_fork (bc_mul_job *job, bc_slimbs *r, const bc_slimbs *u,
+                 const bc_slimbs *v, int par)
+{
+  if (u->len == 0 || v->len == 0)
+    {
+      r->len = 0;
+      r->neg = 0;
+      job->task.queued = 0;
+      return;
+    }
+  r->len = u->len + v->len;
+  r->neg = u->neg ^ v->neg;
+  _bc_mul_fork (job, u->d, u->len, v->d, v->len, r->d, par);
+}
 
-  if (bc_is_zero(d1) || bc_is_zero(d2))
-    m2 = bc_copy_num (_zero_);
+static void
+_bc_slimbs_join (bc_mul_job *job, bc_slimbs *r)
+{
+  _bc_task_join (&job->task);
+  r->len = _bc_limb_trim (r->d, r->len);
+}
+
+/* Evaluates the three pieces X0, X1, X2 (N limbs each, X2 only X2LEN
+   limbs) at the points 1, -1 and -2, leaving the results in P1, PM1
+   and PM2. */
+
+static void
+_bc_toom3_eval (const bc_limb *x, int n, int x2len, bc_slimbs *p1,
+                bc_slimbs *pm1, bc_slimbs *pm2)
+{
+  bc_slimbs x0, x1, x2;
+
+  x0.d = (bc_limb *) x;
+  x0.len = _bc_limb_trim (x, n);
+  x0.neg = 0;
+  x1.d = (bc_limb *) x + n;
+  x1.len = _bc_limb_trim (x + n, n);
+  x1.neg = 0;
+  x2.d = (bc_limb *) x + 2 * n;
+  x2.len = _bc_limb_trim (x + 2 * n, x2len);
+  x2.neg = 0;
+
+  /* p0 = x0 + x2 is kept in p1 for a moment. */
+  _bc_slimbs_addsub (p1, &x0, &x2, 0);
+  _bc_slimbs_addsub (pm1, p1, &x1, 1);
+  _bc_slimbs_addsub (p1, p1, &x1, 0);
+  _bc_slimbs_addsub (pm2, pm1, &x2, 0);
+  _bc_slimbs_mul1 (pm2, 2);
+  _bc_slimbs_addsub (pm2, pm2, &x0, 1);
+}
+
+/* Toom-3 multiply.
+   Let u = u0 + u1*(b^n) + u2*(b^2n), v likewise, and let r(x) be the
+   product of the polynomials u(x) and v(x).  r is evaluated at the
+   points 0, 1, -1, -2 and infinity by five recursive multiplies, and
+   interpolated with the sequence given by Bodrato.  All coefficients
+   of r are non negative, so they can be added to PROD at the end.
+   A square needs only the evaluation of u.
+
+   Requires ULEN >= VLEN > 2*N.  PROD gets ULEN+VLEN limbs. */
+
+static void
+_bc_toom3_mul (const bc_limb *u, int ulen, const bc_limb *v, int vlen,
+               int n, bc_limb *prod)
+{
+  bc_slimbs up1, upm1, upm2, vp1, vpm1, vpm2;
+  bc_slimbs r0, r1, r2, r3, r4, rm1, rm2;
+  bc_mul_job jobs[5];
+  bc_limb *tmp, *p;
+  int evallen, prodlen, par;
+
+  evallen = n + 2;
+  prodlen = 2 * n + 6;
+  tmp = _bc_new_limbs (6 * evallen + 5 * prodlen);
+  p = tmp;
+  up1.d = p; p += evallen;
+  upm1.d = p; p += evallen;
+  upm2.d = p; p += evallen;
+  vp1.d = p; p += evallen;
+  vpm1.d = p; p += evallen;
+  vpm2.d = p; p += evallen;
+  r1.d = p; p += prodlen;
+  r2.d = p; p += prodlen;
+  r3.d = p; p += prodlen;
+  rm1.d = p; p += prodlen;
+  rm2.d = p;
+
+  _bc_toom3_eval (u, n, ulen - 2 * n, &up1, &upm1, &upm2);
+  if (u == v && ulen == vlen)
+    {
+      vp1 = up1;
+      vpm1 = upm1;
+      vpm2 = upm2;
+    }
   else
-    _bc_rec_mul (d1, d1len, d2, d2len, &m2, 0);
+    _bc_toom3_eval (v, n, vlen - 2 * n, &vp1, &vpm1, &vpm2);
+
+  /* r(0) and r(infinity) go to their final places. */
+  memset (prod + 2 * n, 0, 2 * n * sizeof(bc_limb));
+  par = _bc_mul_parallel (vlen);
+  _bc_mul_fork (&jobs[0], u, n, v, n, prod, par);
+  _bc_mul_fork (&jobs[1], u + 2 * n, ulen - 2 * n, v + 2 * n, vlen - 2 * n,
+                prod + 4 * n, par);
+  _bc_slimbs_fork (&jobs[2], &r1, &up1, &vp1, par);
+  _bc_slimbs_fork (&jobs[3], &rm1, &upm1, &vpm1, par);
+  _bc_slimbs_fork (&jobs[4], &rm2, &upm2, &vpm2, 0);
+  _bc_task_join (&jobs[0].task);
+  _bc_task_join (&jobs[1].task);
+  _bc_slimbs_join (&jobs[2], &r1);
+  _bc_slimbs_join (&jobs[3], &rm1);
+  _bc_slimbs_join (&jobs[4], &rm2);
+  r0.d = prod;
+  r0.len = _bc_limb_trim (prod, 2 * n);
+  r0.neg = 0;
+  r4.d = prod + 4 * n;
+  r4.len = _bc_limb_trim (prod + 4 * n, ulen + vlen - 4 * n);
+  r4.neg = 0;
+
+  /* Interpolation. */
+  _bc_slimbs_addsub (&r3, &rm2, &r1, 1);
+  _bc_slimbs_divexact (&r3, 3);
+  _bc_slimbs_addsub (&r1, &r1, &rm1, 1);
+  _bc_slimbs_divexact (&r1, 2);
+  _bc_slimbs_addsub (&r2, &rm1, &r0, 1);
+  _bc_slimbs_addsub (&r3, &r2, &r3, 1);
+  _bc_slimbs_divexact (&r3, 2);
+  _bc_slimbs_addsub (&r3, &r3, &r4, 0);
+  _bc_slimbs_addsub (&r3, &r3, &r4, 0);
+  _bc_slimbs_addsub (&r2, &r2, &r1, 0);
+  _bc_slimbs_addsub (&r2, &r2, &r4, 1);
+  _bc_slimbs_addsub (&r1, &r1, &r3, 1);
+
+  _bc_limb_addto (prod + n, r1.d, r1.len);
+  _bc_limb_addto (prod + 2 * n, r2.d, r2.len);
+  _bc_limb_addto (prod + 3 * n, r3.d, r3.len);
+
+  _bc_pool_free (tmp);
+}
 
-  if (bc_is_zero(u0) || bc_is_zero(v0))
-    m3 = bc_copy_num (_zero_);
+/* Multiplication by a number theoretic transform.  The limbs are
+   convolved modulo three primes below 2^30, each allowing transforms
+   of up to 2^23 points, and the coefficients are recovered by the
+   chinese remainder theorem.  Their product exceeds 2^23 * LIMB_BASE^2,
+   so the recovered coefficients are exact.  3 is a primitive root of
+   all three primes. */
+
+#define NTT_MAX_POINTS (1 << 23)
+
+/* The smallest block of a transform split up between threads. */
+#define NTT_MIN_BLOCK 1024
+
+static const bc_limb _bc_ntt_primes[3] = { 998244353, 469762049, 167772161 };
+
+/* A prime with its constants for Montgomery multiplication: MINV is
+   -MOD^-1 modulo 2^32, R2 is 2^64 modulo MOD.  The transforms work on
+   residues in Montgomery form a*2^32 modulo MOD. */
+
+typedef struct
+{
+  bc_limb mod;
+  bc_limb minv;
+  bc_limb r2;
+} bc_ntt_prime;
+
+static void
+_bc_ntt_prime_init (bc_ntt_prime *p, bc_limb mod)
+{
+  bc_limb inv, r;
+  int i;
+
+  inv = mod;
+  for (i = 0; i < 5; i++)
+    inv *= 2 - mod * inv;
+  r = (bc_limb) (((bc_dlimb) 1 << 32) % mod);
+  p->mod = mod;
+  p->minv = -inv;
+  p->r2 = (bc_limb) ((bc_dlimb) r * r % mod);
+}
+
+/* Returns A*B/2^32 modulo P, for A, B < P. */
+
+static bc_limb
+_bc_mont_mul (bc_limb a, bc_limb b, const bc_ntt_prime *p)
+{
+  bc_dlimb t;
+  bc_limb m, r;
+
+  t = (bc_dlimb) a * b;
+  m = (bc_limb) t * p->minv;
+  r = (bc_limb) ((t + (bc_dlimb) m * p->mod) >> 32);
+  return r >= p->mod ? r - p->mod : r;
+}
+
+static bc_limb
+_bc_ntt_pow (bc_limb base, bc_limb exp, bc_limb mod)
+{
+  bc_dlimb result, b;
+
+  result = 1;
+  b = base;
+  while (exp != 0)
+    {
+      if (exp & 1)
+        result = result * b % mod;
+      b = b * b % mod;
+      exp >>= 1;
+    }
+  return (bc_limb) result;
+}
+
+/* Fills ROOTS with the N/2 powers of a primitive N-th root of unity
+   (or its inverse) modulo P, in Montgomery form. */
+
+static void
+_bc_ntt_roots (bc_limb *roots, int n, const bc_ntt_prime *p, int inverse)
+{
+  bc_limb w;
+  int i;
+
+  w = _bc_ntt_pow (3, (p->mod - 1) / n, p->mod);
+  if (inverse)
+    w = _bc_ntt_pow (w, p->mod - 2, p->mod);
+  w = _bc_mont_mul (w, p->r2, p);
+  roots[0] = _bc_mont_mul (1, p->r2, p);
+  for (i = 1; i < n / 2; i++)
+    roots[i] = _bc_mont_mul (roots[i-1], w, p);
+}
+
+/* The butterflies of the transform stages of lengths 2 to C on the C
+   points at A, part of a transform of N points. */
+
+static void
+_bc_ntt_stages (bc_limb *a, int c, int n, const bc_limb *roots,
+                const bc_ntt_prime *p)
+{
+  bc_limb x, y, mod;
+  int i, j, len, half, step;
+
+  mod = p->mod;
+  for (len = 2; len <= c; len <<= 1)
+    {
+      half = len / 2;
+      step = n / len;
+      for (i = 0; i < c; i += len)
+        for (j = 0; j < half; j++)
+          {
+            x = a[i + j];
+            y = _bc_mont_mul (a[i + j + half], roots[j * step], p);
+            a[i + j] = x + y >= mod ? x + y - mod : x + y;
+            a[i + j + half] = x >= y ? x - y : x + mod - y;
+          }
+    }
+}
+
+/* The butterflies LO to HI-1 of the stage of length LEN of a transform
+   of the N points at A. */
+
+static void
+_bc_ntt_span (bc_limb *a, int n, int len, int lo, int hi,
+              const bc_limb *roots, const bc_ntt_prime *p)
+{
+  bc_limb x, y, mod;
+  int i, j, end, half, step;
+
+  mod = p->mod;
+  half = len / 2;
+  step = n / len;
+  while (lo < hi)
+    {
+      i = lo / half * len;
+      j = lo % half;
+      end = MIN(half, j + hi - lo);
+      lo += end - j;
+      for (; j < end; j++)
+        {
+          x = a[i + j];
+          y = _bc_mont_mul (a[i + j + half], roots[j * step], p);
+          a[i + j] = x + y >= mod ? x + y - mod : x + y;
+          a[i + j + half] = x >= y ? x - y : x + mod - y;
+        }
+    }
+}
+
+/* A part of a parallel transform: the first stages on C points if LEN
+   is 0, else butterflies LO to HI-1 of the stage of length LEN. */
+
+typedef struct
+{
+  bc_task task;
+  bc_limb *a;
+  int n, c, len, lo, hi;
+  const bc_limb *roots;
+  const bc_ntt_prime *p;
+} bc_ntt_job;
+
+static void
+_bc_ntt_job_run (bc_task *task)
+{
+  bc_ntt_job *job = (bc_ntt_job *) task;
+
+  if (job->len == 0)
+    _bc_ntt_stages (job->a, job->c, job->n, job->roots, job->p);
   else
-    _bc_rec_mul (u0, u0->n_len, v0, v0->n_len, &m3, 0);
+    _bc_ntt_span (job->a, job->n, job->len, job->lo, job->hi, job->roots,
+                  job->p);
+}
 
-  /* Initialize product */
-  prodlen = ulen+vlen+1;
-  *prod = bc_new_num(prodlen, 0);
+/* In place transform of the N points at A modulo P, with the roots of
+   unity from _bc_ntt_roots.  N is a power of 2.  With PAR set, the
+   points are cut into blocks transformed on their own, and the last
+   stages, which combine the blocks, are split up as well. */
 
-  if (!m1zero) {
-    _bc_shift_addsub (*prod, m1, 2*n, 0);
-    _bc_shift_addsub (*prod, m1, n, 0);
-  }
-  _bc_shift_addsub (*prod, m3, n, 0);
-  _bc_shift_addsub (*prod, m3, 0, 0);
-  _bc_shift_addsub (*prod, m2, n, d1->n_sign != d2->n_sign);
+static void
+_bc_ntt (bc_limb *a, int n, const bc_limb *roots, const bc_ntt_prime *p,
+         int par)
+{
+  bc_ntt_job jobs[BC_MAX_THREADS];
+  bc_limb t;
+  int i, j, k, c, len, parts;
 
-  /* Now clean up! */
-  bc_free_num (&u1);
-  bc_free_num (&u0);
-  bc_free_num (&v1);
-  bc_free_num (&m1);
-  bc_free_num (&v0);
-  bc_free_num (&m2);
-  bc_free_num (&m3);
-  bc_free_num (&d1);
-  bc_free_num (&d2);
+  /* Bit reversal permutation. */
+  for (i = 1, j = 0; i < n; i++)
+    {
+      k = n >> 1;
+      for (; j & k; k >>= 1)
+        j ^= k;
+      j ^= k;
+      if (i < j)
+        {
+          t = a[i];
+          a[i] = a[j];
+          a[j] = t;
+        }
+    }
+
+  parts = 1;
+  if (par)
+    while (parts <= _bc_workers && parts < BC_MAX_THREADS
+           && n / parts >= 2 * NTT_MIN_BLOCK)
+      parts <<= 1;
+  if (parts == 1)
+    {
+      _bc_ntt_stages (a, n, n, roots, p);
+      return;
+    }
+
+  c = n / parts;
+  for (k = 0; k < parts; k++)
+    {
+      jobs[k].task.run = _bc_ntt_job_run;
+      jobs[k].a = a + k * c;
+      jobs[k].n = n;
+      jobs[k].c = c;
+      jobs[k].len = 0;
+      jobs[k].roots = roots;
+      jobs[k].p = p;
+      _bc_task_fork (&jobs[k].task, 1);
+    }
+  for (k = 0; k < parts; k++)
+    _bc_task_join (&jobs[k].task);
+
+  for (len = 2 * c; len <= n; len <<= 1)
+    {
+      for (k = 0; k < parts; k++)
+        {
+          jobs[k].a = a;
+          jobs[k].len = len;
+          jobs[k].lo = k * (n / 2 / parts);
+          jobs[k].hi = (k + 1) * (n / 2 / parts);
+          _bc_task_fork (&jobs[k].task, 1);
+        }
+      for (k = 0; k < parts; k++)
+        _bc_task_join (&jobs[k].task);
+    }
+}
+
+/* The cyclic convolution of U and V modulo the K-th prime, on N points
+   into PROD, the job of _bc_ntt_mul for one prime. */
+
+static void
+_bc_ntt_conv (bc_task *task)
+{
+  bc_mul_job *job = (bc_mul_job *) task;
+  bc_ntt_prime p;
+  bc_limb *tmp, *a, *b, *roots, scale;
+  int n, i, square;
+
+  n = job->n;
+  square = job->u == job->v && job->ulen == job->vlen;
+  tmp = _bc_new_limbs (n + n / 2 + 1);
+  a = job->prod;
+  b = square ? a : tmp;
+  roots = tmp + n;
+
+  _bc_ntt_prime_init (&p, _bc_ntt_primes[job->k]);
+  for (i = 0; i < n; i++)
+    a[i] = i < job->ulen ? _bc_mont_mul (job->u[i] % p.mod, p.r2, &p) : 0;
+  if (!square)
+    for (i = 0; i < n; i++)
+      b[i] = i < job->vlen ? _bc_mont_mul (job->v[i] % p.mod, p.r2, &p) : 0;
+  _bc_ntt_roots (roots, n, &p, 0);
+  _bc_ntt (a, n, roots, &p, job->par);
+  if (!square)
+    _bc_ntt (b, n, roots, &p, job->par);
+  for (i = 0; i < n; i++)
+    a[i] = _bc_mont_mul (a[i], b[i], &p);
+  _bc_ntt_roots (roots, n, &p, 1);
+  _bc_ntt (a, n, roots, &p, job->par);
+
+  /* Leave Montgomery form and divide by n. */
+  scale = _bc_ntt_pow (n, p.mod - 2, p.mod);
+  for (i = 0; i < job->ulen + job->vlen; i++)
+    a[i] = _bc_mont_mul (a[i], scale, &p);
+
+  _bc_pool_free (tmp);
+}
+
+/* NTT multiply.  ULEN+VLEN must not exceed NTT_MAX_POINTS.  PROD gets
+   ULEN+VLEN limbs.  A square takes one forward transform per prime
+   instead of two. */
+
+static void
+_bc_ntt_mul (const bc_limb *u, int ulen, const bc_limb *v, int vlen,
+             bc_limb *prod)
+{
+  bc_mul_job jobs[3];
+  bc_limb *tmp, *a[3];
+  bc_limb m1, m2, m3, inv12, inv123, t2, t3;
+  bc_dlimb y, low, carry;
+  int n, i, k, par;
+
+  n = 1;
+  while (n < ulen + vlen)
+    n <<= 1;
+  par = _bc_mul_parallel (vlen);
+  tmp = _bc_new_limbs (3 * n);
+
+  for (k = 0; k < 3; k++)
+    {
+      a[k] = tmp + k * n;
+      jobs[k].task.run = _bc_ntt_conv;
+      jobs[k].u = u;
+      jobs[k].ulen = ulen;
+      jobs[k].v = v;
+      jobs[k].vlen = vlen;
+      jobs[k].prod = a[k];
+      jobs[k].n = n;
+      jobs[k].k = k;
+      jobs[k].par = par;
+      _bc_task_fork (&jobs[k].task, par && k < 2);
+    }
+  for (k = 0; k < 3; k++)
+    _bc_task_join (&jobs[k].task);
+
+  /* Recombination: x = a0 + m1*(t2 + m2*t3), the carry is passed on
+     to the next coefficient. */
+  m1 = _bc_ntt_primes[0];
+  m2 = _bc_ntt_primes[1];
+  m3 = _bc_ntt_primes[2];
+  inv12 = _bc_ntt_pow (m1 % m2, m2 - 2, m2);
+  inv123 = _bc_ntt_pow ((bc_limb) ((bc_dlimb) m1 * m2 % m3), m3 - 2, m3);
+  carry = 0;
+  for (i = 0; i < ulen + vlen; i++)
+    {
+      t2 = (bc_limb) ((bc_dlimb) (a[1][i] + m2 - a[0][i] % m2) * inv12 % m2);
+      t3 = (bc_limb) (((bc_dlimb) a[2][i] + m3 - a[0][i] % m3
+                       + m3 - (bc_dlimb) m1 % m3 * t2 % m3) % m3
+                      * inv123 % m3);
+      y = t2 + (bc_dlimb) m2 * t3;
+      low = a[0][i] + (bc_dlimb) m1 * (y % LIMB_BASE) + carry;
+      prod[i] = (bc_limb) (low % LIMB_BASE);
+      carry = low / LIMB_BASE + (bc_dlimb) m1 * (y / LIMB_BASE);
+    }
+
+  _bc_pool_free (tmp);
+}
+
+/* Multiplies the ULEN limbs at U by the VLEN limbs at V, choosing the
+   algorithm by the operand lengths.  PROD gets ULEN+VLEN limbs.
+   Operands of very different length are cut into pieces of the
+   shorter length first.  U and V being the same limbs selects the
+   squaring variants. */
+
+static void
+_bc_rec_mul (const bc_limb *u, int ulen, const bc_limb *v, int vlen,
+             bc_limb *prod)
+{
+  bc_limb *tmp;
+  int n, chunk;
+
+  if (ulen < vlen)
+    {
+      const bc_limb *t = u; u = v; v = t;
+      n = ulen; ulen = vlen; vlen = n;
+    }
+
+  /* Base case? */
+  if (vlen < MAX(2, mul_base_digits / LIMB_DIGITS))
+    {
+      if (u == v && ulen == vlen)
+        _bc_simp_sqr (u, ulen, prod);
+      else
+        _bc_simp_mul (u, ulen, v, vlen, prod);
+      return;
+    }
+
+  if (vlen >= mul_ntt_digits / LIMB_DIGITS
+      && ulen + vlen <= NTT_MAX_POINTS)
+    {
+      _bc_ntt_mul (u, ulen, v, vlen, prod);
+      return;
+    }
+
+  /* Calculate n -- the u and v split point in limbs. */
+  n = (ulen + 1) / 2;
+
+  if (vlen <= n)
+    {
+      /* Unbalanced: multiply v by vlen-sized pieces of u. */
+      memset (prod, 0, (ulen + vlen) * sizeof(bc_limb));
+      tmp = _bc_new_limbs (2 * vlen);
+      for (n = 0; n < ulen; n += vlen)
+        {
+          chunk = MIN(vlen, ulen - n);
+          _bc_rec_mul (u + n, chunk, v, vlen, tmp);
+          _bc_limb_addto (prod + n, tmp, _bc_limb_trim (tmp, chunk + vlen));
+        }
+      _bc_pool_free (tmp);
+      return;
+    }
+
+  if (vlen >= mul_toom3_digits / LIMB_DIGITS
+      && vlen > 2 * ((ulen + 2) / 3))
+    _bc_toom3_mul (u, ulen, v, vlen, (ulen + 2) / 3, prod);
+  else
+    _bc_kara_mul (u, ulen, v, vlen, n, prod);
 }
 
 /* The multiply routine.  N2 times N1 is put int PROD with the scale of
@@ -885,7 +2327,9 @@ bc_multiply (n1, n2, prod, scale)
      int scale;
 {
   bc_num pval;
-  int len1, len2;
+  bc_limb stackbuf[LIMB_STACK];
+  bc_limb *limbs, *u, *v, *p;
+  int len1, len2, ulen, vlen;
   int full_scale, prod_scale;
 
   /* Initialize things. */
@@ -893,14 +2337,42 @@ bc_multiply (n1, n2, prod, scale)
   len2 = n2->n_len + n2->n_scale;
   full_scale = n1->n_scale + n2->n_scale;
   prod_scale = MIN(full_scale,MAX(scale,MAX(n1->n_scale,n2->n_scale)));
+  ulen = _bc_limb_count (len1);
+  vlen = _bc_limb_count (len2);
+
+  if (2 * (ulen + vlen) <= LIMB_STACK)
+    limbs = stackbuf;
+  else
+    limbs = _bc_new_limbs (2 * (ulen + vlen));
+  u = limbs;
+  v = u + ulen;
+  p = v + vlen;
+  _bc_pack (n1->n_value, len1, 0, u, ulen);
+  ulen = _bc_limb_trim (u, ulen);
+  if (n1 == n2)
+    {
+      /* Squaring, the kernels recognize U == V. */
+      v = u;
+      vlen = ulen;
+    }
+  else
+    {
+      _bc_pack (n2->n_value, len2, 0, v, vlen);
+      vlen = _bc_limb_trim (v, vlen);
+    }
 
   /* Do the multiply */
-  _bc_rec_mul (n1, len1, n2, len2, &pval, full_scale);
+  pval = bc_new_num (len1 + len2 + 1 - full_scale, full_scale);
+  if (ulen != 0 && vlen != 0)
+    {
+      _bc_rec_mul (u, ulen, v, vlen, p);
+      _bc_unpack (p, ulen + vlen, pval->n_value, len1 + len2 + 1);
+    }
+  if (limbs != stackbuf)
+    _bc_pool_free (limbs);
 
   /* Assign to prod and clean up the number. */
   pval->n_sign = ( n1->n_sign == n2->n_sign ? PLUS : MINUS );
-  pval->n_value = pval->n_ptr;
-  pval->n_len = len2 + len1 + 1 - full_scale;
   pval->n_scale = prod_scale;
   _bc_rm_leading_zeros (pval);
   if (bc_is_zero (pval))
@@ -909,50 +2381,424 @@ bc_multiply (n1, n2, prod, scale)
   *prod = pval;
 }
 
-/* Some utility routines for the divide:  First a one digit multiply.
-   NUM (with SIZE digits) is multiplied by DIGIT and the result is
-   placed into RESULT.  It is written so that NUM and RESULT can be
-   the same pointers.  */
+/* The square routine.  Same as bc_multiply (NUM, NUM, RESULT, SCALE),
+   provided for callers that know they are squaring. */
+
+void
+bc_square (num, result, scale)
+     bc_num num, *result;
+     int scale;
+{
+  bc_multiply (num, num, result, scale);
+}
+
+/* Run time calibration of the multiplication thresholds.  The
+   crossovers depend a lot on the CPU and the compiler, so they are
+   measured by timing the algorithms against each other on random
+   operands: each one the size where the faster algorithm wins twice in
+   a row, the sizes growing by a quarter each step.  The cost of the
+   NTT jumps whenever the product length passes a power of 2, so its
+   comparison at N limbs uses the sum of the times at N and 3N/2. */
+
+#define TUNE_SIMPLE 0
+#define TUNE_KARATSUBA 1
+#define TUNE_TOOM3 2
+#define TUNE_RECURSIVE 3
+#define TUNE_NTT 4
+
+/* Returns the seconds one multiplication of N by N limbs with KERNEL
+   takes, the best of three rounds of at least 2.5 ms each. */
+
+static double
+_bc_tune_time (int kernel, const bc_limb *u, const bc_limb *v, int n,
+               bc_limb *prod)
+{
+  clock_t start, now;
+  double t, best;
+  int round, reps;
+
+  best = 0;
+  for (round = 0; round < 3; round++)
+    {
+      reps = 0;
+      start = clock ();
+      do
+        {
+          switch (kernel)
+            {
+            case TUNE_SIMPLE:
+              _bc_simp_mul (u, n, v, n, prod);
+              break;
+            case TUNE_KARATSUBA:
+              _bc_kara_mul (u, n, v, n, (n + 1) / 2, prod);
+              break;
+            case TUNE_TOOM3:
+              _bc_toom3_mul (u, n, v, n, (n + 2) / 3, prod);
+              break;
+            case TUNE_RECURSIVE:
+              _bc_rec_mul (u, n, v, n, prod);
+              break;
+            default:
+              _bc_ntt_mul (u, n, v, n, prod);
+            }
+          reps++;
+          now = clock ();
+        }
+      while (now - start < CLOCKS_PER_SEC / 400);
+      t = (double) (now - start) / reps;
+      if (round == 0 || t < best)
+        best = t;
+    }
+  return best / CLOCKS_PER_SEC;
+}
+
+/* Returns the crossover in digits from kernel SLOW to kernel FAST,
+   trying sizes from LO to HI limbs, or FALLBACK if FAST never wins.
+   LIMIT, if not NULL, points to the threshold that keeps the sub
+   products of the measured kernels on the slower algorithms. */
+
+static int
+_bc_tune_crossover (int slow, int fast, int lo, int hi, int *limit,
+                    const bc_limb *u, const bc_limb *v, bc_limb *prod,
+                    int fallback)
+{
+  double tfast, tslow;
+  int n, last, wins;
+
+  wins = 0;
+  last = lo;
+  for (n = lo; n <= hi; n += MAX(1, n / 4))
+    {
+      if (limit != NULL)
+        *limit = n * LIMB_DIGITS;
+      tfast = _bc_tune_time (fast, u, v, n, prod);
+      tslow = _bc_tune_time (slow, u, v, n, prod);
+      if (fast == TUNE_NTT)
+        {
+          tfast += _bc_tune_time (fast, u, v, 3 * n / 2, prod);
+          tslow += _bc_tune_time (slow, u, v, 3 * n / 2, prod);
+        }
+      if (tfast < tslow)
+        {
+          if (++wins == 2)
+            return last * LIMB_DIGITS;
+        }
+      else
+        wins = 0;
+      last = n;
+    }
+  return fallback;
+}
+
+/* Measures the crossovers of the multiplication algorithms on this
+   machine and sets mul_base_digits, mul_toom3_digits and
+   mul_ntt_digits accordingly.  Takes up to about a second. */
+
+void
+bc_tune_multiply ()
+{
+  bc_limb *u, *v, *prod;
+  uint32_t seed;
+  int i, threads, base, toom3, ntt;
+
+  u = _bc_new_limbs (4 * TUNE_MAX_LIMBS);
+  v = u + TUNE_MAX_LIMBS;
+  prod = v + TUNE_MAX_LIMBS;
+  seed = 12345;
+  for (i = 0; i < 2 * TUNE_MAX_LIMBS; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      u[i] = (seed >> 2) % LIMB_BASE;
+    }
+
+  threads = mul_thread_digits;
+  mul_thread_digits = INT_MAX;
+  mul_toom3_digits = INT_MAX;
+  mul_ntt_digits = INT_MAX;
+
+  base = _bc_tune_crossover (TUNE_SIMPLE, TUNE_KARATSUBA, 4, 100,
+                             &mul_base_digits, u, v, prod, MUL_BASE_DIGITS);
+  mul_base_digits = base;
+  toom3 = _bc_tune_crossover (TUNE_KARATSUBA, TUNE_TOOM3,
+                              MAX(8, 3 * base / LIMB_DIGITS), 1000,
+                              &mul_toom3_digits, u, v, prod,
+                              MUL_TOOM3_DIGITS);
+  mul_toom3_digits = toom3;
+  ntt = _bc_tune_crossover (TUNE_RECURSIVE, TUNE_NTT,
+                            MAX(16, toom3 / LIMB_DIGITS),
+                            2 * TUNE_MAX_LIMBS / 3,
+                            NULL, u, v, prod, MUL_NTT_DIGITS);
+
+  mul_ntt_digits = ntt;
+  mul_thread_digits = threads;
+  _bc_pool_free (u);
+}
+
+/* Divides the ULEN limbs at U by the single limb D.  Q gets ULEN limbs. */
 
 static void
-_one_mult (num, size, digit, result)
-     unsigned char *num;
-     int size, digit;
-     unsigned char *result;
+_bc_limb_div1 (const bc_limb *u, int ulen, bc_limb d, bc_limb *q)
 {
-  int carry, value;
-  unsigned char *nptr, *rptr;
+  bc_dlimb rem;
+  int i;
 
-  if (digit == 0)
-    memset (result, 0, size);
-  else
+  rem = 0;
+  for (i = ulen - 1; i >= 0; i--)
+    {
+      rem = rem * LIMB_BASE + u[i];
+      q[i] = (bc_limb) (rem / d);
+      rem -= (bc_dlimb) q[i] * d;
+    }
+}
+
+/* Multiplies the LEN limbs at U by the single limb M in place.  Returns
+   the carry out. */
+
+static bc_limb
+_bc_limb_mul1 (bc_limb *u, int len, bc_limb m)
+{
+  bc_dlimb acc;
+  bc_limb carry;
+  int i;
+
+  carry = 0;
+  for (i = 0; i < len; i++)
+    {
+      acc = (bc_dlimb) u[i] * m + carry;
+      carry = (bc_limb) (acc / LIMB_BASE);
+      u[i] = (bc_limb) (acc - (bc_dlimb) carry * LIMB_BASE);
+    }
+  return carry;
+}
+
+/* Long division of the ULEN limbs at U by the VLEN limbs at V, with
+   ULEN >= VLEN >= 2 and a non zero top limb in V.  U needs room for
+   ULEN+1 limbs, U and V are destroyed.  Q gets ULEN-VLEN+1 limbs.
+   The algorithm is found in Knuth Vol 2. p272. */
+
+static void
+_bc_limb_div (bc_limb *u, int ulen, bc_limb *v, int vlen, bc_limb *q)
+{
+  bc_dlimb qguess, rguess, acc;
+  bc_limb norm, carry, borrow, sub, vtop, vnext;
+  int i, j;
+
+  /* Normalize */
+  norm = LIMB_BASE / (v[vlen-1] + 1);
+  u[ulen] = _bc_limb_mul1 (u, ulen, norm);
+  _bc_limb_mul1 (v, vlen, norm);
+  vtop = v[vlen-1];
+  vnext = v[vlen-2];
+
+  for (j = ulen - vlen; j >= 0; j--)
+    {
+      /* Calculate the quotient limb guess. */
+      acc = (bc_dlimb) u[j+vlen] * LIMB_BASE + u[j+vlen-1];
+      qguess = acc / vtop;
+      rguess = acc - qguess * vtop;
+
+      /* Test qguess. */
+      while (qguess >= LIMB_BASE
+             || qguess * vnext > rguess * LIMB_BASE + u[j+vlen-2])
+        {
+          qguess--;
+          rguess += vtop;
+          if (rguess >= LIMB_BASE)
+            break;
+        }
+
+      /* Multiply and subtract. */
+      carry = 0;
+      borrow = 0;
+      for (i = 0; i < vlen; i++)
+        {
+          acc = qguess * v[i] + carry;
+          carry = (bc_limb) (acc / LIMB_BASE);
+          sub = (bc_limb) (acc - (bc_dlimb) carry * LIMB_BASE) + borrow;
+          borrow = u[i+j] < sub;
+          u[i+j] = borrow ? u[i+j] + LIMB_BASE - sub : u[i+j] - sub;
+        }
+      sub = carry + borrow;
+      borrow = u[j+vlen] < sub;
+      u[j+vlen] -= sub;
+
+      /* Test for negative result. */
+      if (borrow)
+        {
+          qguess--;
+          _bc_limb_addto (u + j, v, vlen);
+        }
+
+      /* We now know the quotient limb. */
+      q[j] = (bc_limb) qguess;
+    }
+}
+
+/* Reciprocals for the Newton division.  Below this many limbs the
+   reciprocal is computed by long division. */
+#define RECIP_BASE_LIMBS 16
+
+/* Computes X, T+1 limbs, within a few units of b^2T / D for the T
+   limbs at D, where the top limb of D is not zero.  The reciprocal of
+   the top H limbs of D is refined by one Newton step
+     x = y + y*(1 - d*y),
+   where the precision roughly doubles; H includes a guard limb so that
+   the error stays in the last limb. */
+
+static void
+_bc_limb_recip (const bc_limb *d, int t, bc_limb *x)
+{
+  bc_limb *tmp, *u, *v, *q, *y, *dy, *p, *w;
+  bc_limb one = 1;
+  int h, i, len, clen, neg;
+
+  if (t <= RECIP_BASE_LIMBS)
     {
-      if (digit == 1)
-	memcpy (result, num, size);
+      tmp = _bc_new_limbs (4 * t + 4);
+      u = tmp;
+      v = u + 2 * t + 2;
+      q = v + t;
+      memset (u, 0, 2 * t * sizeof(bc_limb));
+      u[2 * t] = 1;
+      memcpy (v, d, t * sizeof(bc_limb));
+      _bc_limb_div (u, 2 * t + 1, v, t, q);
+      if (q[t + 1] != 0)
+        for (i = 0; i <= t; i++)
+          x[i] = LIMB_BASE - 1;
       else
-	{
-	  /* Initialize */
-	  nptr = (unsigned char *) (num+size-1);
-	  rptr = (unsigned char *) (result+size-1);
-	  carry = 0;
+        memcpy (x, q, (t + 1) * sizeof(bc_limb));
+      _bc_pool_free (tmp);
+      return;
+    }
 
-	  while (size-- > 0)
-	    {
-	      value = *nptr-- * digit + carry;
-	      *rptr-- = value % BASE;
-	      carry = value / BASE;
-	    }
+  h = (t + 4) / 2;
+  tmp = _bc_new_limbs ((h + 1) + (t + h + 1) + (2 * h + t + 2) + (t + 2));
+  y = tmp;
+  dy = y + h + 1;
+  p = dy + t + h + 1;
+  w = p + 2 * h + t + 2;
+  _bc_limb_recip (d + t - h, h, y);
+
+  /* The error term e = b^(t+h) - d*y. */
+  _bc_rec_mul (d, t, y, h + 1, dy);
+  neg = dy[t + h] != 0;
+  if (neg)
+    dy[t + h]--;
+  else
+    {
+      for (i = 0; i < t + h; i++)
+        dy[i] = LIMB_BASE - 1 - dy[i];
+      _bc_limb_addto (dy, &one, 1);
+    }
+  len = _bc_limb_trim (dy, t + h + 1);
 
-	  if (carry != 0) *rptr = carry;
-	}
+  /* x = y*b^(t-h) + y*e/b^2h */
+  memset (w, 0, (t + 2) * sizeof(bc_limb));
+  memcpy (w + t - h, y, (h + 1) * sizeof(bc_limb));
+  if (len > 0)
+    {
+      _bc_rec_mul (y, h + 1, dy, len, p);
+      clen = _bc_limb_trim (p, h + 1 + len) - 2 * h;
+      if (clen > 0)
+        {
+          if (neg)
+            _bc_limb_subfrom (w, p + 2 * h, clen);
+          else
+            _bc_limb_addto (w, p + 2 * h, clen);
+        }
     }
+  if (w[t + 1] != 0)
+    for (i = 0; i <= t; i++)
+      x[i] = LIMB_BASE - 1;
+  else
+    memcpy (x, w, (t + 1) * sizeof(bc_limb));
+  _bc_pool_free (tmp);
 }
 
+/* Division of the ULEN limbs at U by the VLEN limbs at V via a
+   reciprocal of V, for ULEN >= VLEN >= 2 and a non zero top limb in
+   V.  The quotient estimate from the reciprocal is corrected against
+   the exact remainder, so Q gets the same ULEN-VLEN+1 limbs as from
+   _bc_limb_div, plus room for one more. */
+
+static void
+_bc_newton_div (const bc_limb *u, int ulen, const bc_limb *v, int vlen,
+                bc_limb *q)
+{
+  bc_slimbs a, b, r, vs;
+  bc_limb *tmp, *d, *n, *x, *p;
+  bc_limb one = 1;
+  int m, t, nlen, plen, shift;
+
+  /* m quotient limbs need a reciprocal of m+2 limbs.  Only the top
+     limbs of v matter for it, a short v is padded with zero limbs, and
+     u is shifted by the same amount. */
+  m = ulen - vlen + 1;
+  t = m + 2;
+  shift = vlen - t;
+  nlen = ulen - shift;
+  plen = MAX(nlen + t + 1, m + 1 + vlen);
+  tmp = _bc_new_limbs (t + nlen + (t + 1) + plen + (ulen + 2));
+  d = tmp;
+  n = d + t;
+  x = n + nlen;
+  p = x + t + 1;
+  r.d = p + plen;
+  if (shift >= 0)
+    {
+      memcpy (d, v + shift, t * sizeof(bc_limb));
+      memcpy (n, u + shift, nlen * sizeof(bc_limb));
+    }
+  else
+    {
+      memset (d, 0, -shift * sizeof(bc_limb));
+      memcpy (d - shift, v, vlen * sizeof(bc_limb));
+      memset (n, 0, -shift * sizeof(bc_limb));
+      memcpy (n - shift, u, ulen * sizeof(bc_limb));
+    }
+  _bc_limb_recip (d, t, x);
+
+  /* q = (u/b^shift) * x / b^2t */
+  _bc_rec_mul (n, nlen, x, t + 1, p);
+  memcpy (q, p + 2 * t, m * sizeof(bc_limb));
+  q[m] = 0;
+
+  /* r = u - q*v, reusing p. */
+  a.d = (bc_limb *) u;
+  a.len = _bc_limb_trim (u, ulen);
+  a.neg = 0;
+  b.d = p;
+  b.len = _bc_limb_trim (q, m);
+  b.neg = 0;
+  if (b.len > 0)
+    {
+      _bc_rec_mul (q, b.len, v, vlen, p);
+      b.len = _bc_limb_trim (p, b.len + vlen);
+    }
+  _bc_slimbs_addsub (&r, &a, &b, 1);
+
+  /* Correct the estimate. */
+  vs.d = (bc_limb *) v;
+  vs.len = vlen;
+  vs.neg = 0;
+  while (r.neg)
+    {
+      _bc_limb_subfrom (q, &one, 1);
+      _bc_slimbs_addsub (&r, &r, &vs, 0);
+    }
+  while (_bc_limb_cmp (r.d, r.len, v, vlen) >= 0)
+    {
+      _bc_limb_addto (q, &one, 1);
+      _bc_slimbs_addsub (&r, &r, &vs, 1);
+    }
+
+  _bc_pool_free (tmp);
+}
 
 /* The full division routine. This computes N1 / N2.  It returns
    0 if the division is ok and the result is in QUOT.  The number of
    digits after the decimal point is SCALE. It returns -1 if division
-   by zero is tried.  The algorithm is found in Knuth Vol 2. p237. */
+   by zero is tried. */
 
 int
 bc_divide (n1, n2, quot, scale)
@@ -960,14 +2806,11 @@ bc_divide (n1, n2, quot, scale)
      int scale;
 {
   bc_num qval;
-  unsigned char *num1, *num2;
-  unsigned char *ptr1, *ptr2, *n2ptr, *qptr;
-  int  scale1, val;
-  unsigned int  len1, len2, scale2, qdigits, extra, count;
-  unsigned int  qdig, qguess, borrow, carry;
-  unsigned char *mval;
-  char zero;
-  unsigned int  norm;
+  bc_limb stackbuf[LIMB_STACK];
+  bc_limb *limbs, *u, *v, *q;
+  char *n2ptr;
+  int len1, len2, scale2, shift, numlen;
+  int ulen, vlen, count;
 
   /* Test for divide by zero. */
   if (bc_is_zero (n2)) return -1;
@@ -988,146 +2831,63 @@ bc_divide (n1, n2, quot, scale)
 	}
     }
 
-  /* Set up the divide.  Move the decimal point on n1 by n2's scale.
-     Remember, zeros on the end of num2 are wasted effort for dividing. */
+  /* Set up the divide.  The quotient is the integer part of
+     n1 * 10^(scale2+scale-n1_scale) / n2 * 10^scale2, scaled down by
+     10^scale.  Remember, zeros on the end of num2 are wasted effort
+     for dividing. */
   scale2 = n2->n_scale;
-  n2ptr = (unsigned char *) n2->n_value+n2->n_len+scale2-1;
+  n2ptr = n2->n_value + n2->n_len + scale2 - 1;
   while ((scale2 > 0) && (*n2ptr-- == 0)) scale2--;
-
-  len1 = n1->n_len + scale2;
-  scale1 = n1->n_scale - scale2;
-  if (scale1 < scale)
-    extra = scale - scale1;
-  else
-    extra = 0;
-  num1 = (unsigned char *) malloc (n1->n_len+n1->n_scale+extra+2);
-  if (num1 == NULL) bc_out_of_memory();
-  memset (num1, 0, n1->n_len+n1->n_scale+extra+2);
-  memcpy (num1+1, n1->n_value, n1->n_len+n1->n_scale);
-
   len2 = n2->n_len + scale2;
-  num2 = (unsigned char *) malloc (len2+1);
-  if (num2 == NULL) bc_out_of_memory();
-  memcpy (num2, n2->n_value, len2);
-  *(num2+len2) = 0;
-  n2ptr = num2;
+  n2ptr = n2->n_value;
   while (*n2ptr == 0)
     {
       n2ptr++;
       len2--;
     }
 
-  /* Calculate the number of quotient digits. */
-  if (len2 > len1+scale)
-    {
-      qdigits = scale+1;
-      zero = TRUE;
-    }
-  else
+  len1 = n1->n_len + n1->n_scale;
+  shift = scale2 + scale - n1->n_scale;
+  if (shift < 0)
     {
-      zero = FALSE;
-      if (len2>len1)
-	qdigits = scale+1;  	/* One for the zero integer part. */
-      else
-	qdigits = len1-len2+scale+1;
+      len1 = MAX(0, len1 + shift);
+      shift = 0;
     }
+  numlen = len1 + shift;
 
-  /* Allocate and zero the storage for the quotient. */
-  qval = bc_new_num (qdigits-scale,scale);
-  memset (qval->n_value, 0, qdigits);
-
-  /* Allocate storage for the temporary storage mval. */
-  mval = (unsigned char *) malloc (len2+1);
-  if (mval == NULL) bc_out_of_memory ();
+  /* Allocate storage for the quotient. */
+  qval = bc_new_num (MAX(1, numlen - scale), scale);
 
   /* Now for the full divide algorithm. */
-  if (!zero)
+  if (numlen >= len2)
     {
-      /* Normalize */
-      norm =  10 / ((int)*n2ptr + 1);
-      if (norm != 1)
-	{
-	  _one_mult (num1, len1+scale1+extra+1, norm, num1);
-	  _one_mult (n2ptr, len2, norm, n2ptr);
-	}
-
-      /* Initialize divide loop. */
-      qdig = 0;
-      if (len2 > len1)
-	qptr = (unsigned char *) qval->n_value+len2-len1;
+      ulen = _bc_limb_count (numlen);
+      vlen = _bc_limb_count (len2);
+      count = 2 * ulen + vlen + 1;
+      if (count <= LIMB_STACK)
+        limbs = stackbuf;
       else
-	qptr = (unsigned char *) qval->n_value;
-
-      /* Loop */
-      while (qdig <= len1+scale-len2)
-	{
-	  /* Calculate the quotient digit guess. */
-	  if (*n2ptr == num1[qdig])
-	    qguess = 9;
-	  else
-	    qguess = (num1[qdig]*10 + num1[qdig+1]) / *n2ptr;
-
-	  /* Test qguess. */
-	  if (n2ptr[1]*qguess >
-	      (num1[qdig]*10 + num1[qdig+1] - *n2ptr*qguess)*10
-	       + num1[qdig+2])
-	    {
-	      qguess--;
-	      /* And again. */
-	      if (n2ptr[1]*qguess >
-		  (num1[qdig]*10 + num1[qdig+1] - *n2ptr*qguess)*10
-		  + num1[qdig+2])
-		qguess--;
-	    }
-
-	  /* Multiply and subtract. */
-	  borrow = 0;
-	  if (qguess != 0)
-	    {
-	      *mval = 0;
-	      _one_mult (n2ptr, len2, qguess, mval+1);
-	      ptr1 = (unsigned char *) num1+qdig+len2;
-	      ptr2 = (unsigned char *) mval+len2;
-	      for (count = 0; count < len2+1; count++)
-		{
-		  val = (int) *ptr1 - (int) *ptr2-- - borrow;
-		  if (val < 0)
-		    {
-		      val += 10;
-		      borrow = 1;
-		    }
-		  else
-		    borrow = 0;
-		  *ptr1-- = val;
-		}
-	    }
-
-	  /* Test for negative result. */
-	  if (borrow == 1)
-	    {
-	      qguess--;
-	      ptr1 = (unsigned char *) num1+qdig+len2;
-	      ptr2 = (unsigned char *) n2ptr+len2-1;
-	      carry = 0;
-	      for (count = 0; count < len2; count++)
-		{
-		  val = (int) *ptr1 + (int) *ptr2-- + carry;
-		  if (val > 9)
-		    {
-		      val -= 10;
-		      carry = 1;
-		    }
-		  else
-		    carry = 0;
-		  *ptr1-- = val;
-		}
-	      if (carry == 1) *ptr1 = (*ptr1 + 1) % 10;
-	    }
-
-	  /* We now know the quotient digit. */
-	  *qptr++ =  qguess;
-	  qdig++;
-	}
+        limbs = _bc_new_limbs (count);
+      u = limbs;
+      v = u + ulen + 1;
+      q = v + vlen;
+      _bc_pack (n1->n_value, len1, shift, u, ulen);
+      _bc_pack (n2ptr, len2, 0, v, vlen);
+      ulen = _bc_limb_trim (u, ulen);
+      if (ulen >= vlen)
+        {
+          if (vlen == 1)
+            _bc_limb_div1 (u, ulen, v[0], q);
+          else if (vlen >= div_newton_digits / LIMB_DIGITS
+                   && ulen - vlen >= div_newton_digits / LIMB_DIGITS)
+            _bc_newton_div (u, ulen, v, vlen, q);
+          else
+            _bc_limb_div (u, ulen, v, vlen, q);
+          _bc_unpack (q, ulen - vlen + 1, qval->n_value,
+                      qval->n_len + scale);
+        }
+      if (limbs != stackbuf)
+        _bc_pool_free (limbs);
     }
 
   /* Clean up and return the number. */
@@ -1137,11 +2897,6 @@ bc_divide (n1, n2, quot, scale)
   bc_free_num (quot);
   *quot = qval;
 
-  /* Clean up temporary storage. */
-  free (mval);
-  free (num1);
-  free (num2);
-
   return 0;	/* Everything is OK. */
 }
 
@@ -1341,6 +3096,273 @@ bc_raise (num1, num2, result, scale)
    bc_free_num (&power);
 }
 
+/* Square roots work on limbs as well.  Below this many limbs an
+   integer square root is found by Newton's iteration on long
+   divisions, above it the reciprocal square root is refined with
+   precision doubling steps that need multiplications only. */
+#define RSQRT_BASE_LIMBS 8
+
+/* Returns floor(sqrt(T)). */
+
+static bc_dlimb
+_bc_isqrt2 (bc_dlimb t)
+{
+  bc_dlimb x, y;
+
+  if (t < 2)
+    return t;
+  x = t;
+  y = x / 2 + 1;
+  while (y < x)
+    {
+      x = y;
+      y = (x + t / x) / 2;
+    }
+  return x;
+}
+
+/* S = floor(sqrt(M)) for the 2T limbs at M, where the top limb of M
+   is at least 10^8.  S gets T limbs.  Newton's iteration
+     s = (s + m/s) / 2
+   decreases monotonically from a first guess above the root. */
+
+static void
+_bc_limb_isqrt_base (const bc_limb *m, int t, bc_limb *s)
+{
+  bc_limb *tmp, *cur, *next, *u, *v, *q;
+  bc_dlimb top;
+  int curlen, qlen, nlen;
+
+  tmp = _bc_new_limbs (2 * (t + 2) + (2 * t + 1) + (t + 1) + 2 * t);
+  cur = tmp;
+  next = cur + t + 2;
+  u = next + t + 2;
+  v = u + 2 * t + 1;
+  q = v + t + 1;
+
+  top = _bc_isqrt2 ((bc_dlimb) m[2*t-1] * LIMB_BASE + m[2*t-2]) + 1;
+  memset (cur, 0, (t + 1) * sizeof(bc_limb));
+  if (top == LIMB_BASE)
+    cur[t] = 1;
+  else
+    cur[t-1] = (bc_limb) top;
+
+  for (;;)
+    {
+      curlen = _bc_limb_trim (cur, t + 1);
+      if (curlen == 1)
+        {
+          _bc_limb_div1 (m, 2 * t, cur[0], q);
+          qlen = 2 * t;
+        }
+      else
+        {
+          memcpy (u, m, 2 * t * sizeof(bc_limb));
+          memcpy (v, cur, curlen * sizeof(bc_limb));
+          _bc_limb_div (u, 2 * t, v, curlen, q);
+          qlen = 2 * t - curlen + 1;
+        }
+      qlen = _bc_limb_trim (q, qlen);
+      if (qlen >= curlen)
+        nlen = _bc_limb_add (q, qlen, cur, curlen, next);
+      else
+        nlen = _bc_limb_add (cur, curlen, q, qlen, next);
+      _bc_limb_div1 (next, nlen, 2, next);
+      nlen = _bc_limb_trim (next, nlen);
+      if (_bc_limb_cmp (next, nlen, cur, curlen) >= 0)
+        break;
+      memset (cur, 0, (t + 1) * sizeof(bc_limb));
+      memcpy (cur, next, nlen * sizeof(bc_limb));
+    }
+
+  memcpy (s, cur, t * sizeof(bc_limb));
+  _bc_pool_free (tmp);
+}
+
+/* Computes X, T+1 limbs, approximately b^2T / sqrt(M) for the 2T limbs
+   at M, where the top limb of M is at least 10^8.  The relative error
+   is below b^(1-T).  The reciprocal square root y of the top 2H limbs
+   of M is refined by one Newton step
+     x = y + y*(1 - m*y*y)/2,
+   which roughly doubles the precision.  The low limbs of M do not
+   contribute to the error term and are dropped there. */
+
+static void
+_bc_limb_rsqrt (const bc_limb *m, int t, bc_limb *x)
+{
+  bc_limb *tmp, *u, *s, *q, *y, *y2, *p, *c, *w;
+  bc_limb one = 1;
+  int h, k, i, len, plen, clen, shift, neg;
+
+  if (t <= RSQRT_BASE_LIMBS)
+    {
+      /* x = b^2t / floor(sqrt(m)) */
+      tmp = _bc_new_limbs ((2 * t + 2) + t + (t + 2));
+      u = tmp;
+      s = u + 2 * t + 2;
+      q = s + t;
+      _bc_limb_isqrt_base (m, t, s);
+      memset (u, 0, 2 * t * sizeof(bc_limb));
+      u[2 * t] = 1;
+      if (t == 1)
+        _bc_limb_div1 (u, 3, s[0], q);
+      else
+        _bc_limb_div (u, 2 * t + 1, s, t, q);
+      memcpy (x, q, (t + 1) * sizeof(bc_limb));
+      _bc_pool_free (tmp);
+      return;
+    }
+
+  h = (t + 3) / 2;
+  k = t - 4;
+  plen = (2 * t - k) + (2 * h + 2);
+  tmp = _bc_new_limbs ((h + 1) + (2 * h + 2) + plen + (h + 1 + plen)
+                       + (t + 2));
+  y = tmp;
+  y2 = y + h + 1;
+  p = y2 + 2 * h + 2;
+  c = p + plen;
+  w = c + h + 1 + plen;
+  _bc_limb_rsqrt (m + 2 * (t - h), h, y);
+
+  /* The error term e = b^len - m*y*y, len = 2t+2h-k. */
+  _bc_rec_mul (y, h + 1, y, h + 1, y2);
+  _bc_rec_mul (m + k, 2 * t - k, y2, 2 * h + 2, p);
+  len = 2 * t + 2 * h - k;
+  neg = _bc_limb_trim (p, plen) > len;
+  if (neg)
+    _bc_limb_subfrom (p + len, &one, 1);
+  else
+    {
+      for (i = 0; i < len; i++)
+        p[i] = LIMB_BASE - 1 - p[i];
+      _bc_limb_addto (p, &one, 1);
+    }
+  plen = _bc_limb_trim (p, plen);
+
+  /* x = y*b^(t-h) +- y*e/(2*b^(t+3h-k)) */
+  memset (w, 0, (t + 2) * sizeof(bc_limb));
+  memcpy (w + t - h, y, (h + 1) * sizeof(bc_limb));
+  if (plen > 0)
+    {
+      _bc_rec_mul (y, h + 1, p, plen, c);
+      shift = t + 3 * h - k;
+      clen = _bc_limb_trim (c, h + 1 + plen) - shift;
+      if (clen > 0)
+        {
+          _bc_limb_div1 (c + shift, clen, 2, c + shift);
+          clen = _bc_limb_trim (c + shift, clen);
+          if (neg)
+            _bc_limb_subfrom (w, c + shift, clen);
+          else
+            _bc_limb_addto (w, c + shift, clen);
+        }
+    }
+  if (w[t + 1] != 0)
+    for (i = 0; i <= t; i++)
+      x[i] = LIMB_BASE - 1;
+  else
+    memcpy (x, w, (t + 1) * sizeof(bc_limb));
+  _bc_pool_free (tmp);
+}
+
+/* S = floor(sqrt(M)) for the 2T limbs at M, where the top limb of M
+   is at least 10^8.  S needs room for T+1 limbs and gets T.  Above the
+   base case s = m * rsqrt(m), corrected against the exact remainder. */
+
+static void
+_bc_limb_isqrt (const bc_limb *m, int t, bc_limb *s)
+{
+  bc_slimbs r, a, b, twos;
+  bc_limb *tmp, *mp, *x, *p;
+  bc_limb one = 1;
+
+  if (t <= RSQRT_BASE_LIMBS)
+    {
+      _bc_limb_isqrt_base (m, t, s);
+      return;
+    }
+
+  /* A reciprocal of m*b^4 gives two more limbs of precision. */
+  tmp = _bc_new_limbs ((2 * t + 4) + (t + 3) + (3 * t + 3) + (2 * t + 4)
+                       + (t + 2));
+  mp = tmp;
+  x = mp + 2 * t + 4;
+  p = x + t + 3;
+  r.d = p + 3 * t + 3;
+  twos.d = r.d + 2 * t + 4;
+  memset (mp, 0, 4 * sizeof(bc_limb));
+  memcpy (mp + 4, m, 2 * t * sizeof(bc_limb));
+  _bc_limb_rsqrt (mp, t + 2, x);
+  _bc_rec_mul (m, 2 * t, x, t + 3, p);
+  memcpy (s, p + 2 * t + 2, (t + 1) * sizeof(bc_limb));
+
+  /* r = m - s*s, reusing p. */
+  a.d = (bc_limb *) m;
+  a.len = _bc_limb_trim (m, 2 * t);
+  a.neg = 0;
+  b.d = p;
+  b.len = _bc_limb_trim (s, t + 1);
+  b.neg = 0;
+  if (b.len > 0)
+    {
+      _bc_rec_mul (s, b.len, s, b.len, p);
+      b.len = _bc_limb_trim (p, 2 * b.len);
+    }
+  _bc_slimbs_addsub (&r, &a, &b, 1);
+
+  /* Correct the estimate, with (s+1)^2 - s^2 = 2s+1. */
+  twos.neg = 0;
+  while (r.neg)
+    {
+      _bc_limb_subfrom (s, &one, 1);
+      twos.len = _bc_limb_trim (s, t + 1);
+      memcpy (twos.d, s, twos.len * sizeof(bc_limb));
+      _bc_slimbs_mul1 (&twos, 2);
+      _bc_limb_addto (twos.d, &one, 1);
+      _bc_slimbs_addsub (&r, &r, &twos, 0);
+    }
+  for (;;)
+    {
+      twos.len = _bc_limb_trim (s, t + 1);
+      memcpy (twos.d, s, twos.len * sizeof(bc_limb));
+      _bc_slimbs_mul1 (&twos, 2);
+      _bc_limb_addto (twos.d, &one, 1);
+      if (_bc_limb_cmp (r.d, r.len, twos.d, twos.len) < 0)
+        break;
+      _bc_slimbs_addsub (&r, &r, &twos, 1);
+      _bc_limb_addto (s, &one, 1);
+    }
+
+  _bc_pool_free (tmp);
+}
+
+/* Packs the LEN digits at DIGITS, followed by ZEROS zero digits, into
+   an even number 2T of limbs with at least eight digits in the top
+   limb, as needed by the square root routines.  For this, *PAD more
+   zero digits are appended, which scales the root by 10^*PAD.  Returns
+   the limbs, *T and *PAD are set. */
+
+static bc_limb *
+_bc_sqrt_pack (const char *digits, int len, int zeros, int *t, int *pad)
+{
+  bc_limb *limbs;
+  int total, r;
+
+  /* Total digits must be 0 or 35 modulo 36. */
+  total = len + zeros;
+  r = total % (4 * LIMB_DIGITS);
+  r = (4 * LIMB_DIGITS - r) % (4 * LIMB_DIGITS);
+  if (r & 1)
+    r = (r + 4 * LIMB_DIGITS - 1) % (4 * LIMB_DIGITS);
+  *pad = r / 2;
+  total += r;
+  *t = (total + 2 * LIMB_DIGITS - 1) / (2 * LIMB_DIGITS);
+  limbs = _bc_new_limbs (2 * *t);
+  _bc_pack (digits, len, zeros + r, limbs, 2 * *t);
+  return limbs;
+}
+
 /* Take the square root NUM and return it in NUM with SCALE digits
    after the decimal place. */
 
@@ -1349,9 +3371,11 @@ bc_sqrt (num, scale)
      bc_num *num;
      int scale;
 {
-  int rscale, cmp_res, done;
-  int cscale;
-  bc_num guess, guess1, point5, diff;
+  int rscale, cmp_res;
+  int len, t, pad;
+  char *nptr, *digits;
+  bc_limb *m, *s;
+  bc_num root;
 
   /* Initial checks. */
   cmp_res = bc_compare (*num, _zero_);
@@ -1374,61 +3398,146 @@ bc_sqrt (num, scale)
       return 1;
     }
 
-  /* Initialize the variables. */
+  /* The root is floor(sqrt(n*10^(2*rscale))) / 10^rscale. */
   rscale = MAX (scale, (*num)->n_scale);
-  bc_init_num(&guess);
-  bc_init_num(&guess1);
-  bc_init_num(&diff);
-  point5 = bc_new_num (1,1);
-  point5->n_value[1] = 5;
+  nptr = (*num)->n_value;
+  len = (*num)->n_len + (*num)->n_scale;
+  while (*nptr == 0)
+    {
+      nptr++;
+      len--;
+    }
+  m = _bc_sqrt_pack (nptr, len, 2 * rscale - (*num)->n_scale, &t, &pad);
+  s = _bc_new_limbs (t + 1);
+  _bc_limb_isqrt (m, t, s);
+
+  /* Drop the padding digits. */
+  digits = (char *) _bc_pool_alloc (t * LIMB_DIGITS);
+  if (digits == NULL) bc_out_of_memory ();
+  _bc_unpack (s, t, digits, t * LIMB_DIGITS);
+  len = t * LIMB_DIGITS - pad;
+  root = bc_new_num (MAX(1, len - rscale), rscale);
+  memcpy (root->n_value + root->n_len + rscale - len, digits, len);
+  _bc_rm_leading_zeros (root);
 
+  /* Assign the number and clean up. */
+  bc_free_num (num);
+  *num = root;
+  _bc_pool_free (digits);
+  _bc_pool_free (s);
+  _bc_pool_free (m);
+  return 1;
+}
 
-  /* Calculate the initial guess. */
-  if (cmp_res < 0)
+/* Take the reciprocal square root of NUM and return it in NUM with
+   SCALE digits after the decimal place, truncated.  Returns 0 if NUM
+   is not positive. */
+
+int
+bc_rsqrt (num, scale)
+     bc_num *num;
+     int scale;
+{
+  int len, zeros, nscale, t, pad, xdigits, rdigits, rlen, klen, exp;
+  char *nptr, *digits;
+  bc_limb *m, *x, *n, *k, *r, *p, *sq;
+  bc_limb one = 1;
+  int nlen, plen, up;
+  bc_num root;
+
+  /* Initial checks. */
+  if (bc_compare (*num, _zero_) <= 0)
+    return 0;		/* error */
+
+  /* With n = N/10^nscale, nscale even, the result is the largest R
+     with R*R*N <= 10^(2*scale+nscale). */
+  nptr = (*num)->n_value;
+  len = (*num)->n_len + (*num)->n_scale;
+  while (*nptr == 0)
     {
-      /* The number is between 0 and 1.  Guess should start at 1. */
-      guess = bc_copy_num (_one_);
-      cscale = (*num)->n_scale;
+      nptr++;
+      len--;
     }
-  else
+  nscale = (*num)->n_scale;
+  zeros = nscale & 1;
+  nscale += zeros;
+
+  /* The estimate 10^(scale+nscale/2) / sqrt(N) has about rdigits digits,
+     its reciprocal square root needs two more limbs than that. */
+  rdigits = scale + nscale / 2 - (len + zeros - 1) / 2 + 1;
+  rlen = _bc_limb_count (MAX(1, rdigits)) + 1;
+  for (pad = 0; ; pad += 2 * LIMB_DIGITS)
     {
-      /* The number is greater than 1.  Guess should start at 10^(exp/2). */
-      bc_int2num (&guess,10);
-
-      bc_int2num (&guess1,(*num)->n_len);
-      bc_multiply (guess1, point5, &guess1, 0);
-      guess1->n_scale = 0;
-      bc_raise (guess, guess1, &guess, 0);
-      bc_free_num (&guess1);
-      cscale = 3;
+      m = _bc_sqrt_pack (nptr, len, zeros + 2 * pad, &t, &exp);
+      if (t >= rlen + 2)
+        break;
+      _bc_pool_free (m);
     }
-
-  /* Find the square root using Newton's algorithm. */
-  done = FALSE;
-  while (!done)
+  pad += exp;
+
+  /* Unpack x * 10^(pad - 18t + scale + nscale/2) into r. */
+  x = _bc_new_limbs (t + 1);
+  _bc_limb_rsqrt (m, t, x);
+  xdigits = (t + 1) * LIMB_DIGITS;
+  digits = (char *) _bc_pool_alloc (xdigits);
+  if (digits == NULL) bc_out_of_memory ();
+  _bc_unpack (x, t + 1, digits, xdigits);
+  exp = pad - 2 * t * LIMB_DIGITS + scale + nscale / 2;
+  rlen = _bc_limb_count (MAX(1, xdigits + exp)) + 1;
+  r = _bc_new_limbs (rlen);
+  if (exp >= 0)
+    _bc_pack (digits, xdigits, exp, r, rlen);
+  else
+    _bc_pack (digits, MAX(0, xdigits + exp), 0, r, rlen);
+
+  /* Correct against k = 10^(2*scale+nscale). */
+  nlen = _bc_limb_count (len + zeros);
+  klen = _bc_limb_count (2 * scale + nscale + 1);
+  plen = 2 * rlen + nlen + 2;
+  n = _bc_new_limbs (nlen + klen + (2 * rlen + 2) + plen);
+  k = n + nlen;
+  sq = k + klen;
+  p = sq + 2 * rlen + 2;
+  _bc_pack (nptr, len, zeros, n, nlen);
+  _bc_pack ("\1", 1, 2 * scale + nscale, k, klen);
+  klen = _bc_limb_trim (k, klen);
+  for (up = 0; ; )
     {
-      bc_free_num (&guess1);
-      guess1 = bc_copy_num (guess);
-      bc_divide (*num, guess, &guess, cscale);
-      bc_add (guess, guess1, &guess, 0);
-      bc_multiply (guess, point5, &guess, cscale);
-      bc_sub (guess, guess1, &diff, cscale+1);
-      if (bc_is_near_zero (diff, cscale))
-	{
-	  if (cscale < rscale+1)
-	    cscale = MIN (cscale*3, rscale+1);
-	  else
-	    done = TRUE;
-	}
+      rdigits = _bc_limb_trim (r, rlen);
+      plen = 0;
+      if (rdigits > 0)
+        {
+          _bc_rec_mul (r, rdigits, r, rdigits, sq);
+          _bc_rec_mul (sq, 2 * rdigits, n, nlen, p);
+          plen = _bc_limb_trim (p, 2 * rdigits + nlen);
+        }
+      if (_bc_limb_cmp (p, plen, k, klen) > 0)
+        {
+          /* Too large, step down. */
+          _bc_limb_subfrom (r, &one, 1);
+          if (up)
+            break;
+        }
+      else
+        {
+          /* Fits, try the next one. */
+          _bc_limb_addto (r, &one, 1);
+          up = 1;
+        }
     }
 
   /* Assign the number and clean up. */
+  rdigits = rlen * LIMB_DIGITS;
+  root = bc_new_num (MAX(1, rdigits - scale), scale);
+  _bc_unpack (r, rlen, root->n_value, root->n_len + scale);
+  _bc_rm_leading_zeros (root);
   bc_free_num (num);
-  bc_divide (guess,_one_,num,rscale);
-  bc_free_num (&guess);
-  bc_free_num (&guess1);
-  bc_free_num (&point5);
-  bc_free_num (&diff);
+  *num = root;
+  _bc_pool_free (n);
+  _bc_pool_free (r);
+  _bc_pool_free (digits);
+  _bc_pool_free (x);
+  _bc_pool_free (m);
   return 1;
 }
 
@@ -46,6 +46,10 @@ typedef enum {PLUS, MINUS} sign;
 
 typedef struct bc_struct *bc_num;
 
+/* Numbers with at most this many digits keep them in the header
+   itself, saving a separate buffer. */
+#define BC_INLINE_DIGITS 24
+
 typedef struct bc_struct
     {
       sign  n_sign;
@@ -60,6 +64,8 @@ typedef struct bc_struct
       char *n_value;	/* The number. Not zero char terminated.
 			   May not point to the same place as n_ptr as
 			   in the case of leading zeros generated. */
+      char n_inline[BC_INLINE_DIGITS]; /* Storage of short numbers,
+			   n_ptr points here then. */
     } bc_struct;
 
 
@@ -97,6 +103,18 @@ extern bc_num _zero_;
 extern bc_num _one_;
 extern bc_num _two_;
 
+/* Multiplication thresholds in digits, see bc_tune_multiply. */
+extern int mul_base_digits;
+extern int mul_toom3_digits;
+extern int mul_ntt_digits;
+
+/* Products split between threads from this many digits on, see
+   bc_set_mul_threads. */
+extern int mul_thread_digits;
+
+/* Division threshold in digits, see bc_divide. */
+extern int div_newton_digits;
+
 
 /* Function Prototypes */
 
@@ -116,6 +134,12 @@ _PROTOTYPE(bc_num bc_new_num, (int length, int scale));
 
 _PROTOTYPE(void bc_free_num, (bc_num *num));
 
+_PROTOTYPE(long bc_set_pool_limit, (long limit));
+
+_PROTOTYPE(void bc_release_pool, (void));
+
+_PROTOTYPE(long bc_alloc_count, (void));
+
 _PROTOTYPE(bc_num bc_copy_num, (bc_num num));
 
 _PROTOTYPE(void bc_init_num, (bc_num *num));
@@ -142,6 +166,12 @@ _PROTOTYPE(void bc_sub, (bc_num n1, bc_num n2, bc_num *result, int scale_min));
 
 _PROTOTYPE(void bc_multiply, (bc_num n1, bc_num n2, bc_num *prod, int scale));
 
+_PROTOTYPE(void bc_square, (bc_num num, bc_num *result, int scale));
+
+_PROTOTYPE(int bc_set_mul_threads, (int threads));
+
+_PROTOTYPE(void bc_tune_multiply, (void));
+
 _PROTOTYPE(int bc_divide, (bc_num n1, bc_num n2, bc_num *quot, int scale));
 
 _PROTOTYPE(int bc_modulo, (bc_num num1, bc_num num2, bc_num *result,
@@ -158,6 +188,8 @@ _PROTOTYPE(void bc_raise, (bc_num num1, bc_num num2, bc_num *result,
 
 _PROTOTYPE(int bc_sqrt, (bc_num *num, int scale));
 
+_PROTOTYPE(int bc_rsqrt, (bc_num *num, int scale));
+
 _PROTOTYPE(void bc_out_num, (bc_num num, int o_base, void (* out_char)(int),
 			     int leading_zero));
                  
@@ -25,6 +25,7 @@ INCLUDEPATH += . math core gui
 
 win32:RC_FILE = resources/speedcrunch.rc
 win32-msvc*:LIBS += User32.lib
+unix:LIBS += -lpthread
 !macx {
     !win32 {
         DEPENDPATH += thirdparty
@@ -0,0 +1,138 @@
+/* benchmul.c: timing of large multiplications on several threads. */
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License , or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; see the file COPYING.  If not, write to:
+
+      The Free Software Foundation, Inc.
+      59 Temple Place, Suite 330
+      Boston, MA 02111-1307 USA.
+
+*************************************************************************/
+
+/* Multiplies random numbers of 20000 to 1000000 digits with 1, 2, 4
+   and 8 threads and prints the best time of a few runs together with
+   the speedup over a single thread.  Every product is compared with the
+   single threaded one, the program fails if they differ.
+
+   With --tune it instead calibrates the multiplication thresholds for
+   this machine and prints them. */
+
+#include "math/number.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define REPEATS 3
+
+static const int sizes[] = { 20000, 100000, 1000000 };
+static const int threads[] = { 1, 2, 4, 8 };
+
+static double
+seconds()
+{
+#if defined(_WIN32)
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return (double)count.QuadPart / freq.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+static bc_num
+random_num(int digits, unsigned *seed)
+{
+  bc_num n;
+  int i;
+
+  n = bc_new_num(digits, 0);
+  for (i = 0; i < digits; ++i)
+  {
+    *seed = *seed * 1103515245 + 12345;
+    n->n_value[i] = (*seed >> 16) % 10;
+  }
+  n->n_value[0] = 1 + n->n_value[0] % 9;
+  return n;
+}
+
+int
+main(int argc, char** argv)
+{
+  bc_num a, b, prod, ref;
+  double start, t, best, single;
+  unsigned seed = 1;
+  int s, i, r, failed = 0;
+
+  bc_init_numbers();
+  if (argc > 1 && strcmp(argv[1], "--tune") == 0)
+  {
+    bc_tune_multiply();
+    printf("base case below %d digits\n", mul_base_digits);
+    printf("Toom-3 from %d digits\n", mul_toom3_digits);
+    printf("NTT from %d digits\n", mul_ntt_digits);
+    return 0;
+  }
+
+  printf("%10s %8s %12s %8s\n", "digits", "threads", "ms", "speedup");
+  for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s)
+  {
+    a = random_num(sizes[s], &seed);
+    b = random_num(sizes[s], &seed);
+    ref = NULL;
+    single = 0;
+    for (i = 0; i < (int)(sizeof(threads) / sizeof(threads[0])); ++i)
+    {
+      bc_set_mul_threads(threads[i]);
+      best = 0;
+      prod = NULL;
+      for (r = 0; r < REPEATS; ++r)
+      {
+        start = seconds();
+        bc_multiply(a, b, &prod, 0);
+        t = seconds() - start;
+        if (r == 0 || t < best)
+          best = t;
+      }
+      if (ref == NULL)
+      {
+        ref = prod;
+        single = best;
+      }
+      else
+      {
+        if (bc_compare(ref, prod) != 0)
+        {
+          printf("%10d %8d product differs\n", sizes[s], threads[i]);
+          failed = 1;
+        }
+        bc_free_num(&prod);
+      }
+      printf("%10d %8d %12.1f %8.2f\n", sizes[s], threads[i], best * 1000,
+             single / best);
+    }
+    bc_free_num(&ref);
+    bc_free_num(&a);
+    bc_free_num(&b);
+  }
+  bc_set_mul_threads(1);
+  return failed;
+}
@@ -19,10 +19,14 @@
 
 #include "core/evaluator.h"
 #include "core/settings.h"
+#include "math/floatconfig.h"
+#include "math/floatconst.h"
+#include "math/number.h"
 
 #include <QtCore/QCoreApplication>
 
 #include <cstring>
+#include <ctime>
 #include <iostream>
 
 using namespace std;
@@ -31,6 +35,7 @@ static Evaluator* eval = 0;
 static int eval_total_tests  = 0;
 static int eval_failed_tests = 0;
 static int eval_new_failed_tests = 0;
+static int eval_expressions = 0;
 
 #define CHECK_AUTOFIX(s,p) checkAutoFix(__FILE__,__LINE__,#s,s,p)
 #define CHECK_DIV_BY_ZERO(s) checkDivisionByZero(__FILE__,__LINE__,#s,s)
@@ -58,6 +63,7 @@ static void checkDivisionByZero(const char* file, int line, const char* msg, con
 
     eval->setExpression(expr);
     HNumber rn = eval->evalUpdateAns();
+    ++eval_expressions;
 
     if (eval->error().isEmpty()) {
         ++eval_failed_tests;
@@ -71,6 +77,7 @@ static void checkEval(const char* file, int line, const char* msg, const QString
 
     eval->setExpression(expr);
     HNumber rn = eval->evalUpdateAns();
+    ++eval_expressions;
 
     if (!eval->error().isEmpty()) {
         ++eval_failed_tests;
@@ -98,6 +105,7 @@ static void checkEvalPrecise(const char* file, int line, const char* msg, const
 
     eval->setExpression(expr);
     HNumber rn = eval->evalUpdateAns();
+    ++eval_expressions;
 
     // We compare up to 50 decimals, not exact number because it's often difficult
     // to represent the result as an irrational number, e.g. PI.
@@ -541,6 +549,62 @@ void test_comments()
     CHECK_EVAL("ncr(3;3) ? this is because foo",  "1");
 }
 
+static void checkEvalApproximate(const char* file, int line, const char* msg, const QString& expr, int prec)
+{
+    ++eval_total_tests;
+
+    eval->setExpression(expr);
+    HNumber approx = eval->evalApproximate('g', prec);
+    HNumber rn = eval->evalNoAssign();
+    ++eval_expressions;
+
+    char* result = HMath::format(approx, 'g', prec);
+    char* expected = HMath::format(rn, 'g', prec);
+    if (strcmp(result, expected)) {
+        ++eval_failed_tests;
+        cerr << "[Line " << line << "]\t" << msg << "\tResult: " << result << "\tExpected: " << expected << endl;
+    }
+    free(result);
+    free(expected);
+}
+
+#define CHECK_APPROXIMATE(x,p) checkEvalApproximate(__FILE__,__LINE__,#x,x,p)
+
+void test_approximate()
+{
+    CHECK_APPROXIMATE("sin(1.2)*exp(0.7)+ln(3)", 10);
+    CHECK_APPROXIMATE("(-2)^11", 10);
+    CHECK_APPROXIMATE("2^0.5", 15);
+    CHECK_APPROXIMATE("arctan(12345.678)*1000", 12);
+    CHECK_APPROXIMATE("0.1+0.2", 15);
+    CHECK_APPROXIMATE("1/3", 15);
+    CHECK_APPROXIMATE("sqrt(2)*sqrt(2)-2", 8);
+    CHECK_APPROXIMATE("sin(pi)", 8);
+    CHECK_APPROXIMATE("1e300*1e300", 8);
+
+    HMath::setWorkingPrecision(300);
+
+    CHECK_APPROXIMATE("sin(1.2)*exp(0.7)+ln(3)", -1);
+    CHECK_APPROXIMATE("sin(1.2)*exp(0.7)+ln(3)", 8);
+    CHECK_APPROXIMATE("1/3", -1);
+    CHECK_APPROXIMATE("arctan(12345.678)*1000", 8);
+    CHECK_APPROXIMATE("(10^40+1)-10^40", -1);
+    CHECK_APPROXIMATE("10^60+1", -1);
+    CHECK_APPROXIMATE("sqrt(2)*sqrt(2)-2", 8);
+    CHECK_APPROXIMATE("sin(1)-sin(1)", -1);
+
+    // integer operations depend on digits far beyond the shown ones
+    HMath::setWorkingPrecision(1000);
+
+    CHECK_APPROXIMATE("(10^50+1) mod 10", -1);
+    CHECK_APPROXIMATE("(10^50+1) \\ 10^50", -1);
+    CHECK_APPROXIMATE("frac(10^40+0.5)", -1);
+    CHECK_APPROXIMATE("mod(10^50+1; 10)", -1);
+    CHECK_APPROXIMATE("floor(10^45+0.7)-10^45", -1);
+
+    HMath::setWorkingPrecision(DECPRECISION);
+}
+
 int main(int argc, char* argv[])
 {
     QCoreApplication app(argc, argv);
@@ -550,6 +614,9 @@ int main(int argc, char* argv[])
     settings->setRadixCharacter('.');
 
     eval = Evaluator::instance();
+    long allocs = bc_alloc_count();
+    long numbers = HMath::numberCount();
+    long numberAllocs = HMath::numberAllocCount();
 
     test_constants();
     test_unary();
@@ -570,10 +637,24 @@ int main(int argc, char* argv[])
     test_auto_fix_untouch();
 
     test_comments();
+    test_approximate();
+
+    cerr << "math library startup: "
+         << floatmath_inittime() * 1000 / CLOCKS_PER_SEC << " ms, "
+         << floatmath_setuptime() * 1000 / CLOCKS_PER_SEC
+         << " ms setting up constants on demand" << endl;
 
     cerr << eval_total_tests  << " total, " << eval_failed_tests << " failed";
     if (eval_failed_tests)
         cerr << ", " << eval_new_failed_tests << " new";
     cerr << endl;
+
+    if (eval_expressions)
+        cerr << (bc_alloc_count() - allocs) / eval_expressions
+             << " allocations per expression, "
+             << (HMath::numberCount() - numbers) / eval_expressions
+             << " numbers per expression ("
+             << HMath::numberAllocCount() - numberAllocs
+             << " allocated in total)" << endl;
     return 0;
 }
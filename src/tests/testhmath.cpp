@@ -18,17 +18,26 @@
 // Boston, MA 02110-1301, USA.
 
 #include "math/hmath.h"
+#include "math/floatcommon.h"
 #include "math/floatconst.h"
+#include "math/floatexp.h"
+#include "math/floathmath.h"
+#include "math/floatlog.h"
+#include "math/number.h"
 
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <utility>
 
 using namespace std;
 
 #define CHECK(x,y) check_value(__FILE__,__LINE__,#x,x,y)
 #define CHECK_FORMAT(f,p,x,y) check_format(__FILE__,__LINE__,#x,x,f,p,y)
 #define CHECK_PRECISE(x,y) check_precise(__FILE__,__LINE__,#x,x,y)
+#define CHECK_AGMNEWTON(f,x,d) check_agmnewton(__FILE__,__LINE__,#f,f,x,d)
+#define CHECK_NUM(x,y) check_num(__FILE__,__LINE__,#x,x,y)
 
 static int hmath_total_tests  = 0;
 static int hmath_failed_tests = 0;
@@ -53,15 +62,80 @@ static void check_format(const char* file, int line, const char* msg, const HNum
 {
     ++hmath_total_tests;
     char* result = HMath::format(n, format, prec);
+    char small[256];
+    char* buf = strlen(result) < sizeof small? small : (char*)malloc(strlen(result) + 1);
+    int size = HMath::formatInto(n, buf, int(strlen(result)) + 1, format, prec);
     if (strcmp(result, expected)) {
         ++hmath_failed_tests;
         cerr << file << "[" << line << "]: " << msg << endl
              << "  Result  : " << result
              << endl << "  Expected: " << expected << endl << endl;
+    } else if (size != int(strlen(result)) + 1 || strcmp(buf, result)) {
+        ++hmath_failed_tests;
+        cerr << file << "[" << line << "]: " << msg << endl
+             << "  formatInto differs from format" << endl << endl;
     }
+    if (buf != small)
+        free(buf);
     free(result);
 }
 
+// evaluates f(x) to the given digits twice, once by the series and once
+// by the AGM logarithm and Newton exponential, and compares the results
+static void check_agmnewton(const char* file, int line, const char* msg,
+                            char (*f)(floatnum, int), const char* x, int digits)
+{
+    ++hmath_total_tests;
+    floatstruct series, fast, diff;
+    float_create(&series);
+    float_create(&fast);
+    float_create(&diff);
+    float_setasciiz(&series, x);
+    float_setasciiz(&fast, x);
+    int agm = ln_agm_digits;
+    int newton = exp_newton_digits;
+    char ok = f(&series, digits);
+    ln_agm_digits = 0;
+    exp_newton_digits = 0;
+    ok = f(&fast, digits) && ok;
+    ln_agm_digits = agm;
+    exp_newton_digits = newton;
+    float_sub(&diff, &series, &fast, digits + 5);
+    if (!ok || !(float_iszero(&diff)
+                 || float_getexponent(&diff) < float_getexponent(&series) - digits + 3)) {
+        ++hmath_failed_tests;
+        cerr << file << "[" << line << "]: " << msg << "(" << x << ") to "
+             << digits << " digits" << endl
+             << "  AGM/Newton result differs from the series" << endl << endl;
+    }
+    float_free(&diff);
+    float_free(&fast);
+    float_free(&series);
+}
+
+// a random number of the given digits, scale of them after the point
+static bc_num random_num(int digits, int scale, unsigned* seed)
+{
+    bc_num n = bc_new_num(digits - scale, scale);
+    for (int i = 0; i < digits; ++i) {
+        *seed = *seed * 1103515245 + 12345;
+        n->n_value[i] = (*seed >> 16) % 10;
+    }
+    n->n_value[0] = 1 + n->n_value[0] % 9;
+    return n;
+}
+
+static void check_num(const char* file, int line, const char* msg,
+                      const bc_num& n, const bc_num& expected)
+{
+    ++hmath_total_tests;
+    if (bc_compare(n, expected) != 0 || n->n_scale != expected->n_scale) {
+        ++hmath_failed_tests;
+        cerr << file << "[" << line << "]: " << msg << endl
+             << "  Result differs from the schoolbook computation" << endl << endl;
+    }
+}
+
 static void check_precise(const char* file, int line, const char* msg, const HNumber& n, const char* expected)
 {
     ++hmath_total_tests;
@@ -176,6 +250,21 @@ void test_format()
     CHECK_FORMAT('g', 3, HNumber("1403.1977"), "1403.198");
     CHECK_FORMAT('g', 3, HNumber("2604.1980"), "2604.198");
     CHECK_FORMAT('g', 3, HNumber("2.47e4"), "24700.000");
+
+    // Into a buffer, too small or holding several formats.
+    char buf[64];
+    strcpy(buf, "x");
+    CHECK(HNumber(HMath::formatInto(HNumber("2.5"), buf, 3, 'f', 2)), "5");
+    CHECK(HNumber(strcmp(buf, "x")), "0");
+    CHECK(HNumber(HMath::formatInto(HNumber("NaN"), buf, 0, 'f', 2)), "4");
+    const char formats[] = { 'f', 'e', 'f', 'h' };
+    const int precs[] = { 2, 3, 2, -1 };
+    CHECK(HNumber(HMath::formatInto(HNumber("2.5"), formats, precs, 4, buf, sizeof buf)), "40");
+    CHECK(HNumber(strcmp(buf, "2.50")), "0");
+    CHECK(HNumber(strcmp(buf + 5, "2.500e0")), "0");
+    CHECK(HNumber(strcmp(buf + 13, "2.50")), "0");
+    CHECK(HNumber(strcmp(buf + 18, "0x2.80000000000000000")), "0");
+    CHECK(HNumber(HMath::formatInto(HNumber("2.5"), formats, precs, 4, buf, 10)), "40");
 }
 
 void test_op()
@@ -216,6 +305,7 @@ void test_op()
     CHECK_PRECISE(HNumber(3) / HNumber(7), "0.42857142857142857142857142857142857142857142857143");
     CHECK_PRECISE(HNumber(4) / HNumber(7), "0.57142857142857142857142857142857142857142857142857");
     CHECK_PRECISE(HNumber(1) / HNumber(9), "0.11111111111111111111111111111111111111111111111111");
+    CHECK_PRECISE(HNumber("98765432109876543210.5") / HNumber("1234567890.123456789"), "80000000729.00000663430506037213554938643754941658129469088982");
 
     // Multiplication.
     CHECK(HNumber(0)* HNumber(0), "0");
@@ -225,6 +315,92 @@ void test_op()
     CHECK(HNumber(-2)* HNumber(5), "-10");
     CHECK(HNumber(6)* HNumber(7), "42");
     CHECK(HNumber("1.5")* HNumber("1.5"), "2.25");
+    CHECK(HNumber("123456789012345678901234567890")* HNumber("987654321098765432109876543210"), "121932631137021795226185032733622923332237463801111263526900");
+    HNumber x("123456789012345678901234567890");
+    CHECK(x * x, "15241578753238836750495351562536198787501905199875019052100");
+
+    // Small integers, near and beyond the limits of their native form.
+    HNumber m(2147483647);
+    CHECK(m * m, "4611686014132420609");
+    CHECK(m * m * m, "9903520300447984150353281023");
+    CHECK(m * m + m * m, "9223372028264841218");
+    CHECK(-(m * m) - m * m, "-9223372028264841218");
+    CHECK(HNumber(6) / HNumber(3), "2");
+    CHECK(HNumber(6) / HNumber(4), "1.5");
+    CHECK(HNumber(6) / HNumber(0), "NaN");
+    CHECK(HNumber(-7) % HNumber(3), "-1");
+    CHECK(HNumber(7) % HNumber(-3), "1");
+    CHECK(HNumber(7) % HNumber(0), "NaN");
+    CHECK(HNumber(-7) & HNumber(12), "8");
+    CHECK(HNumber(-7) | HNumber(12), "-3");
+    CHECK(HNumber(-7) ^ HNumber(12), "-11");
+    CHECK(~HNumber(-7), "6");
+    CHECK(HNumber(1) << HNumber(61), "2305843009213693952");
+    CHECK(HNumber(1) << HNumber(62), "4611686018427387904");
+    CHECK(HNumber(-3) << HNumber(70), "-3541774862152233910272");
+    CHECK(HNumber(-7) >> HNumber(1), "-4");
+    CHECK(HNumber(-7) >> HNumber(100), "-1");
+
+    // Compound assignment, also with the number itself as operand.
+    HNumber y("1.5");
+    y += HNumber(2);
+    CHECK(y, "3.5");
+    y *= y;
+    CHECK(y, "12.25");
+    y /= HNumber("0.5");
+    CHECK(y, "24.5");
+    y -= y;
+    CHECK(y, "0");
+    y = m;
+    y *= m;
+    y += y;
+    CHECK(y, "9223372028264841218");
+    y /= HNumber(0);
+    CHECK(y, "NaN");
+    y = HNumber(-7);
+    y &= HNumber(12);
+    CHECK(y, "8");
+    y |= HNumber(3);
+    CHECK(y, "11");
+    y ^= y;
+    CHECK(y, "0");
+
+    // Temporaries as either operand.
+    CHECK(HNumber(10) - x * HNumber(2), "-246913578024691357802469135770");
+    CHECK(HNumber(1) / (HNumber(3) - HNumber("0.5")), "0.4");
+    CHECK(-(x - x), "0");
+
+    // Copies share their value until one of them is changed.
+    HNumber c1("2.5");
+    HNumber c2(c1);
+    c2 += HNumber(1);
+    CHECK(c1, "2.5");
+    CHECK(c2, "3.5");
+    c2 = c1;
+    c2 *= c2;
+    CHECK(c2, "6.25");
+    CHECK(HMath::floor(c1), "2");
+    CHECK(HMath::ceil(c1), "3");
+    CHECK(-HNumber(c1), "-2.5");
+    CHECK(HNumber(c1) / HNumber(5), "0.5");
+    CHECK(c1, "2.5");
+
+    // Freed numbers are reused by the next ones.
+    HNumber w = x;
+    long allocs = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+        w = w * HNumber(3) / HNumber(3) + HNumber(1) - HNumber(1);
+        if (i == 1)
+            allocs = HMath::numberAllocCount();
+    }
+    CHECK(w, "123456789012345678901234567890");
+    CHECK(HNumber(int(HMath::numberAllocCount() - allocs)), "0");
+#if __cplusplus >= 201103L
+    HNumber z(std::move(y));
+    y = HNumber("2.5");
+    CHECK(y - z, "2.5");
+#endif
 }
 
 void test_functions()
@@ -355,6 +531,18 @@ void test_functions()
     CHECK_PRECISE(HMath::sqrt(19), "4.35889894354067355223698198385961565913700392523244");
     CHECK_PRECISE(HMath::sqrt(20), "4.47213595499957939281834733746255247088123671922305");
 
+    CHECK(HMath::rsqrt("NaN"), "NaN");
+    CHECK(HMath::rsqrt(-1), "NaN");
+    CHECK(HMath::rsqrt(0), "NaN");
+    CHECK(HMath::rsqrt(1), "1");
+    CHECK(HMath::rsqrt(4), "0.5");
+    CHECK(HMath::rsqrt("0.04"), "5");
+    CHECK(HMath::rsqrt(100), "0.1");
+    CHECK_PRECISE(HMath::rsqrt(2), "0.70710678118654752440084436210484903928483593768847");
+    CHECK_PRECISE(HMath::rsqrt(3), "0.57735026918962576450914878050195745564760175127013");
+    CHECK_PRECISE(HMath::rsqrt("0.5"), "1.41421356237309504880168872420969807856967187537695");
+    CHECK_PRECISE(HMath::rsqrt(1000), "0.03162277660168379331998893544432718533719555139325");
+
     CHECK(HMath::cbrt("NaN"), "NaN");
     CHECK(HMath::cbrt(0), "0");
     CHECK(HMath::cbrt(1), "1");
@@ -878,18 +1066,216 @@ void test_functions()
     CHECK_PRECISE(HMath::cosh("1.0"), "1.54308063481524377847790562075706168260152911236586");
 }
 
+void test_precision()
+{
+    HMath::setWorkingPrecision(200);
+    CHECK_FORMAT('f', 150, HMath::pi(),
+                 "3.141592653589793238462643383279502884197169399375105820974944592307816406286208998628034825342117067982148086513282306647093844609550582231725359408128");
+    CHECK_FORMAT('f', 150, HMath::exp("1"),
+                 "2.718281828459045235360287471352662497757247093699959574966967627724076630353547594571382178525166427427466391932003059921817413596629043572900334295261");
+    CHECK_FORMAT('f', 150, HMath::ln("2"),
+                 "0.693147180559945309417232121458176568075500134360255254120680009493393621969694715605863326996418687542001481020570685733685520235758130557032670751635");
+    CHECK_FORMAT('f', 150, HMath::sqrt("2"),
+                 "1.414213562373095048801688724209698078569671875376948073176679737990732478462107038850387534327641572735013846230912297024924836055850737212644121497100");
+    CHECK_FORMAT('f', 150, HMath::exp("0.5"),
+                 "1.648721270700128146848650787814163571653776100710148011575079311640661021194215608632776520056366643002866637756307797004671166975219609159840971452490");
+    CHECK_FORMAT('f', 150, HMath::sin("1"),
+                 "0.841470984807896506652502321630298999622563060798371065672751709991910404391239668948639743543052695854349037907920674293259118920991898881193410327729");
+
+    // beyond the precision the Bernoulli and erfc tables were laid out for
+    HMath::setWorkingPrecision(320);
+    CHECK_FORMAT('f', 300, HMath::erf("0.5"),
+                 "0.520499877813046537682746653891964528736451575757963700058805725647193521716853570914788218734787757032966124386194391236065414690590890774606218098025036974170019197111861974461665405441098882490188441080500828453049757294736373230522916200753413217037493374603883438860037474305778532879930190345303");
+    CHECK_FORMAT('f', 300, HMath::erfc("3"),
+                 "0.000022090496998585441372776129582320379847707087399249657238954842942456683620132267816254650815316287143446199728161235257003902753796749465660715105834837812745205583686997241979516101782176495799035735354986648847601889619285358842408208218615016179493538097503255513122883767212735681477909643099");
+    CHECK(HMath::erf("1e10"), "1");
+    CHECK(HMath::erf("-1e10"), "-1");
+    CHECK(HMath::erfc("-1e10"), "2");
+    CHECK(HMath::erfc("-150"), "2");
+    CHECK_FORMAT('f', 300, HMath::gamma("3.7"),
+                 "4.170651783796603165393602998617983727940445580989829294572246632460642268581369241150526906690994415387290676713475826788241132123733994761495155347422624444409521798733737185536079670862947702483716960508345257712687252143326535014802371987666847147066921630912435596401358971211831813852184970613450");
+    CHECK_FORMAT('f', 300, HMath::gamma("-2.5"),
+                 "-0.945308720482941881225689324448610764158693043265273135047364154588219351781883830066640350260557154888654305932950704355325948195053025388013383311788153103179753439281656065519960092282107107322097117535609580160093140808187455850942240101432124809912238386397286741500758280280483315416223644000483");
+
+    HMath::setEvaluationPrecision(30);
+    CHECK_FORMAT('f', 25, HMath::pi(), "3.1415926535897932384626434");
+    CHECK(HMath::raise(HNumber(10), 40) + HNumber(1) - HMath::raise(HNumber(10), 40), "0");
+    CHECK(HNumber(HMath::cancelledDigits()), "33");
+    HMath::setEvaluationPrecision(0);
+    CHECK(HMath::raise(HNumber(10), 40) + HNumber(1) - HMath::raise(HNumber(10), 40), "1");
+
+    HMath::setWorkingPrecision(DECPRECISION);
+    CHECK(HMath::pi(), "3.14159265358979323846");
+}
+
+// operand lengths of the multiplication and division tests, in digits
+static const int num_lengths[][2] = {
+    { 3000, 3000 }, { 5000, 4999 }, { 7919, 6007 }, // balanced
+    { 9000, 4000 }, { 8000, 2600 }, { 12000, 1500 }, // unbalanced
+};
+
+// multiplies random operands with the thresholds lowered so that the
+// Toom-3 and the number theoretic transform tiers do the work, on one
+// thread and on four, and compares with the schoolbook products
+void test_multiply()
+{
+    const int n = sizeof num_lengths / sizeof *num_lengths;
+    int base = mul_base_digits;
+    int toom3 = mul_toom3_digits;
+    int ntt = mul_ntt_digits;
+    int thread = mul_thread_digits;
+    bc_num a[n], b[n], prod[n], sqr[n];
+    bc_num result = 0;
+    unsigned seed = 1;
+
+    bc_init_num(&result);
+    mul_base_digits = INT_MAX;
+    for (int i = 0; i < n; ++i) {
+        a[i] = random_num(num_lengths[i][0], i * 100, &seed);
+        b[i] = random_num(num_lengths[i][1], 0, &seed);
+        prod[i] = sqr[i] = 0;
+        bc_multiply(a[i], b[i], &prod[i], INT_MAX);
+        bc_multiply(a[i], a[i], &sqr[i], INT_MAX);
+    }
+    mul_base_digits = base;
+
+    // Karatsuba only, Toom-3 above 900 digits, NTT above 2700 digits;
+    // with threads, the products from 900 digits on are split
+    const int tiers[][2] = {
+        { INT_MAX, INT_MAX }, { 900, INT_MAX }, { 900, 2700 }, { toom3, 2700 }
+    };
+    mul_thread_digits = 900;
+    for (int threads = 1; threads <= 4; threads += 3) {
+        bc_set_mul_threads(threads);
+        for (unsigned t = 0; t < sizeof tiers / sizeof *tiers; ++t) {
+            mul_toom3_digits = tiers[t][0];
+            mul_ntt_digits = tiers[t][1];
+            for (int i = 0; i < n; ++i) {
+                bc_multiply(a[i], b[i], &result, INT_MAX);
+                CHECK_NUM(result, prod[i]);
+                bc_multiply(b[i], a[i], &result, INT_MAX);
+                CHECK_NUM(result, prod[i]);
+                bc_multiply(a[i], a[i], &result, INT_MAX);
+                CHECK_NUM(result, sqr[i]);
+            }
+        }
+    }
+    bc_set_mul_threads(1);
+    mul_thread_digits = thread;
+    mul_toom3_digits = toom3;
+    mul_ntt_digits = ntt;
+
+    for (int i = 0; i < n; ++i) {
+        bc_free_num(&a[i]);
+        bc_free_num(&b[i]);
+        bc_free_num(&prod[i]);
+        bc_free_num(&sqr[i]);
+    }
+    bc_free_num(&result);
+}
+
+// divides random operands with the threshold lowered so that the Newton
+// reciprocal does the work, and compares with the long division quotients
+void test_divide()
+{
+    const int n = sizeof num_lengths / sizeof *num_lengths;
+    const int scales[] = { 0, 4000 };
+    const int ns = sizeof scales / sizeof *scales;
+    int newton = div_newton_digits;
+    int toom3 = mul_toom3_digits;
+    int ntt = mul_ntt_digits;
+    bc_num a[n], b[n], prod[n], quot[n][ns];
+    bc_num result = 0;
+    unsigned seed = 2;
+
+    bc_init_num(&result);
+    div_newton_digits = INT_MAX;
+    for (int i = 0; i < n; ++i) {
+        a[i] = random_num(num_lengths[i][0], i * 100, &seed);
+        b[i] = random_num(num_lengths[i][1], 0, &seed);
+        prod[i] = 0;
+        bc_multiply(a[i], b[i], &prod[i], INT_MAX);
+        for (int j = 0; j < ns; ++j) {
+            quot[i][j] = 0;
+            bc_divide(a[i], b[i], &quot[i][j], scales[j]);
+        }
+    }
+
+    // Newton above 900 digits, with the Karatsuba, and with the Toom-3
+    // and NTT tiers under it
+    const int tiers[][2] = { { toom3, ntt }, { 900, 2700 } };
+    div_newton_digits = 900;
+    for (unsigned t = 0; t < sizeof tiers / sizeof *tiers; ++t) {
+        mul_toom3_digits = tiers[t][0];
+        mul_ntt_digits = tiers[t][1];
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < ns; ++j) {
+                bc_divide(a[i], b[i], &result, scales[j]);
+                CHECK_NUM(result, quot[i][j]);
+            }
+            // exact quotients
+            bc_divide(prod[i], b[i], &result, a[i]->n_scale);
+            CHECK_NUM(result, a[i]);
+        }
+    }
+    div_newton_digits = newton;
+    mul_toom3_digits = toom3;
+    mul_ntt_digits = ntt;
+
+    for (int i = 0; i < n; ++i) {
+        bc_free_num(&a[i]);
+        bc_free_num(&b[i]);
+        bc_free_num(&prod[i]);
+        for (int j = 0; j < ns; ++j)
+            bc_free_num(&quot[i][j]);
+    }
+    bc_free_num(&result);
+}
+
+void test_agmnewton()
+{
+    // the AGM logarithm and Newton exponential take over only for very
+    // long results, so their thresholds are lowered here
+    static const int digits[] = { 300, 1000 };
+    for (unsigned i = 0; i < sizeof digits / sizeof *digits; ++i) {
+        HMath::setWorkingPrecision(digits[i] + 20);
+        CHECK_AGMNEWTON(float_ln, "2", digits[i]);
+        CHECK_AGMNEWTON(float_ln, "0.37", digits[i]);
+        CHECK_AGMNEWTON(float_ln, "123456.789", digits[i]);
+        CHECK_AGMNEWTON(float_lnxplus1, "0.5", digits[i]);
+        CHECK_AGMNEWTON(float_lnxplus1, "-0.3", digits[i]);
+        CHECK_AGMNEWTON(float_lnxplus1, "7.25", digits[i]);
+        CHECK_AGMNEWTON(float_exp, "0.9", digits[i]);
+        CHECK_AGMNEWTON(float_exp, "-2.3", digits[i]);
+        CHECK_AGMNEWTON(float_exp, "15.5", digits[i]);
+        CHECK_AGMNEWTON(float_expminus1, "0.7", digits[i]);
+        CHECK_AGMNEWTON(float_expminus1, "-3.2", digits[i]);
+        CHECK_AGMNEWTON(float_expminus1, "5", digits[i]);
+    }
+    HMath::setWorkingPrecision(DECPRECISION);
+}
+
 int main(int argc, char* argv[])
 {
     hmath_total_tests  = 0;
     hmath_failed_tests = 0;
 
     floatmath_init();
+    // constants are set up on first use only
+    CHECK(HNumber(floatmath_isready(CONSTPI)), "0");
     PI  = HMath::pi();
+    CHECK(HNumber(floatmath_isready(CONSTPI)), "1");
+    CHECK(HNumber(floatmath_isready(CONSTBERNOULLI)), "0");
 
     test_create();
     test_format();
     test_op();
     test_functions();
+    CHECK(HNumber(floatmath_isready(CONSTBERNOULLI)), "1");
+    test_precision();
+    test_agmnewton();
+    test_multiply();
+    test_divide();
 
     if (hmath_failed_tests)
       cerr << hmath_total_tests  << " total, " << hmath_failed_tests << " failed" << endl;